@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core_init.h"
+
+enum struct FileMappingError {
+    Undefined,
+
+    FailedToOpenFile,
+    FailedToStatFile,
+    FailedToMapFile,
+    FailedToReadFile,
+    FailedToWriteFile,
+    FailedToReplaceFile,
+    FailedToRemoveFile,
+    EmptyFile,
+
+    SENTINEL
+};
+
+const char* errorToCstr(FileMappingError err);
+
+// Tells the OS how the mapping is going to be read, so it can tune read-ahead.
+enum struct MappingAccessHint {
+    Normal,
+    Sequential,
+    Random
+};
+
+// A whole file mapped into the address space. Pages are mapped copy-on-write: writing through `memory` is allowed, but
+// never reaches the file. Pages are read from disk on first touch.
+struct MappedFile {
+    core::Memory<u8> memory;
+
+    bool isMapped() const { return memory.data() != nullptr; }
+    void free();
+};
+
+[[nodiscard]] core::expected<MappedFile, FileMappingError> mapFile(const char* path, MappingAccessHint hint = MappingAccessHint::Normal);
+
+// Size and last modification time of a file, for telling whether it changed since it was last looked at.
+struct FileStamp {
+    addr_size size = 0;
+    i64 modifiedTimeNs = 0; // Platform epoch; only meaningful when compared with another stamp of the same file.
+};
+
+[[nodiscard]] core::expected<FileStamp, FileMappingError> statFile(const char* path);
+
+// A file opened for positioned reads. Reading never moves a shared file offset, so it is fine to read the same file
+// from several threads. Use this instead of mapping when only a few small pieces of a (possibly large) file are needed.
+struct ReadOnlyFile {
+    i64 handle = -1;
+    addr_size size = 0;
+
+    bool isOpen() const { return handle != -1; }
+    void free();
+};
+
+[[nodiscard]] core::expected<ReadOnlyFile, FileMappingError> openReadOnlyFile(const char* path);
+// Reads exactly `size` bytes starting at `offset`; reading past the end of the file is an error.
+[[nodiscard]] core::expected<FileMappingError> readFileAt(const ReadOnlyFile& file, addr_size offset, void* dst, addr_size size);
+
+// A file created (or truncated) for writing, written with gathered writes.
+struct WriteOnlyFile {
+    i64 handle = -1;
+
+    bool isOpen() const { return handle != -1; }
+    void free();
+};
+
+struct FileWriteSpan {
+    const void* data;
+    addr_size size;
+};
+
+[[nodiscard]] core::expected<WriteOnlyFile, FileMappingError> createWriteOnlyFile(const char* path);
+// Appends the spans, in order, with as few system calls as possible (writev on POSIX). Short writes are retried.
+[[nodiscard]] core::expected<FileMappingError> writeFileGathered(const WriteOnlyFile& file, const FileWriteSpan* spans, i32 spansCount);
+
+// Moves srcPath over dstPath in one step, both have to be on the same file system. On POSIX, readers see either the old
+// or the new file, and existing mappings of the old file keep their pages.
+[[nodiscard]] core::expected<FileMappingError> replaceFile(const char* srcPath, const char* dstPath);
+[[nodiscard]] core::expected<FileMappingError> removeFile(const char* path);
+
+// For naming temporary files that no other process writes to.
+u32 currentProcessId();
@@ -1,12 +1,81 @@
+#pragma once
+
 #include "core_init.h"
+#include "file_mapping.h"
+
+enum struct VertexLayout : u8 {
+    Interleaved, // Model3D::vertices
+    Separate,    // Model3D::streams
+    Positions,   // Model3D::positions, for models without normals and texture coordinates.
+};
 
 struct Model3D {
     core::AllocatorContext* actx;
+    VertexLayout layout;
+
+    // Everything needed to draw a face corner, so a corner is a single index.
+    struct Vertex {
+        core::vec4f position;
+        core::vec3f normal;       // Zero when the corner has no normal.
+        core::vec2f textureCoord; // Zero when the corner has no texture coordinate.
+    };
+
+    // The same vertices with every position component in an array of its own, so a transform can load the x of
+    // several vertices with one SIMD load. w is very often 1 everywhere, in which case it is not stored.
+    struct VertexStreams {
+        core::Memory<f32> x;
+        core::Memory<f32> y;
+        core::Memory<f32> z;
+        core::Memory<f32> w;                     // Empty when every w is 1.
+        core::Memory<core::vec3f> normals;       // Empty when no corner has a normal.
+        core::Memory<core::vec2f> textureCoords; // Empty when no corner has a texture coordinate.
+    };
 
-    using Face = i32[3];
+    using Face = i32[3]; // Indices into the vertices.
 
-    core::Memory<core::vec4f> vertices;
+    // A named run of faces, from an o or g statement, that can be culled or drawn on its own.
+    struct Submesh {
+        core::vec3f boundsMin; // Axis aligned bounds of the positions its faces use.
+        core::vec3f boundsMax;
+        i32 firstFace;
+        i32 facesCount;
+        i32 nameOffset; // Into submeshNames.
+        i32 nameLength;
+    };
+
+    core::Memory<Vertex> vertices;        // Only with VertexLayout::Interleaved.
+    VertexStreams streams;                // Only with VertexLayout::Separate.
+    core::Memory<core::vec4f> positions; // Only with VertexLayout::Positions.
     core::Memory<Face> faces;
+    core::Memory<Submesh> submeshes; // In face order, covering every face.
+    core::Memory<char> submeshNames; // Not null terminated.
+
+    // Set when the model was loaded from a model cache file. The arrays then point into the mapping and are not
+    // owned by actx.
+    MappedFile mapping;
+
+    addr_size verticesCount() const {
+        switch (layout) {
+            case VertexLayout::Interleaved: return vertices.len();
+            case VertexLayout::Separate:    return streams.x.len();
+            case VertexLayout::Positions:   return positions.len();
+        }
+        return 0;
+    }
+
+    core::vec4f position(addr_size idx) const {
+        switch (layout) {
+            case VertexLayout::Interleaved: return vertices[idx].position;
+            case VertexLayout::Positions:   return positions[idx];
+            case VertexLayout::Separate:    break;
+        }
+        f32 w = streams.w.len() > 0 ? streams.w[idx] : 1.0f;
+        return core::v(streams.x[idx], streams.y[idx], streams.z[idx], w);
+    }
+
+    core::StrView submeshName(const Submesh& s) const {
+        return core::sv(submeshNames.data() + s.nameOffset, addr_size(s.nameLength));
+    }
 
     void free();
 };
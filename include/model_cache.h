@@ -0,0 +1,81 @@
+#pragma once
+
+#include "model.h"
+
+enum struct ModelCacheError {
+    Undefined,
+
+    FailedToOpenFile,
+    FailedToStatFile,
+    FailedToReadFile,
+    FailedToWriteFile,
+    InvalidFileFormat,
+    UnsupportedVersion,
+    ChecksumMismatch,
+    StaleCache,
+
+    SENTINEL
+};
+
+const char* errorToCstr(ModelCacheError err);
+
+/**
+    A model cache file is a Model3D laid out so it can be used straight from a memory mapping:
+
+        ModelCacheHeader
+        zero padding up to MODEL_CACHE_BLOCK_ALIGNMENT
+        verticesCount x Model3D::Vertex, or x core::vec4f for VertexLayout::Positions
+        zero padding up to MODEL_CACHE_BLOCK_ALIGNMENT
+        facesCount x Model3D::Face
+        zero padding up to MODEL_CACHE_BLOCK_ALIGNMENT
+        submeshesCount x Model3D::Submesh
+        namesSize bytes of Model3D::submeshNames
+
+    Everything is in native byte order. The checksum covers the header, with the checksum field zeroed, and every
+    block.
+    Any change to the layout, or to what the parser puts into it, bumps MODEL_CACHE_VERSION.
+*/
+
+constexpr u32 MODEL_CACHE_MAGIC = u32('M') | (u32('3') << 8) | (u32('D') << 16) | (u32('C') << 24);
+constexpr u32 MODEL_CACHE_VERSION = 5;
+constexpr addr_size MODEL_CACHE_BLOCK_ALIGNMENT = 64;
+
+// The file a cache was built from. A cache is stale once any of these changes.
+struct ModelCacheSource {
+    u64 pathHash;
+    u64 size;
+    i64 modifiedTimeNs;
+};
+
+struct ModelCacheHeader {
+    u32 magic;
+    u32 version;
+    u32 vertexLayout; // VertexLayout::Interleaved or VertexLayout::Positions.
+    u32 vertexSize;   // Bytes per element of the vertex block.
+    u64 fileSize;
+    u64 checksum;
+    ModelCacheSource source;
+    u64 verticesOffset;
+    u64 verticesCount;
+    u64 facesOffset;
+    u64 facesCount;
+    u64 submeshesOffset;
+    u64 submeshesCount;
+    u64 namesOffset;
+    u64 namesSize;
+};
+static_assert(sizeof(ModelCacheHeader) == 120);
+
+[[nodiscard]] core::expected<ModelCacheSource, ModelCacheError> modelCacheSourceFor(const char* sourcePath);
+
+// The model has to use VertexLayout::Interleaved or VertexLayout::Positions. The file is written under a temporary name
+// in the same directory and renamed over cachePath, so a process that has the old cache mapped keeps reading it.
+[[nodiscard]] core::expected<ModelCacheError> writeModelCache(const Model3D& model, const char* cachePath,
+                                                              const ModelCacheSource& source = {});
+
+// Maps the cache file and points the model into the mapping; nothing is copied or parsed. The whole file is still read
+// once to verify the checksum, and every submesh range and face index is checked against the blocks, so a damaged or
+// crafted file is InvalidFileFormat instead of out of bounds reads later. When expectedSource is given and does not
+// match the source the cache was written from, the result is StaleCache.
+[[nodiscard]] core::expected<Model3D, ModelCacheError> loadModelCache(const char* cachePath,
+                                                                      const ModelCacheSource* expectedSource = nullptr);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "core_init.h"
+
+// The SIMD kernels in this project are written against SSE2, which is always available on x86_64. SSSE3 and AVX2
+// kernels are compiled for their own target with SIMD_TARGET_SSSE3/SIMD_TARGET_AVX2 and picked at runtime with
+// simdHasSsse3/simdHasAvx2, so a default build runs them on CPUs that have them. Building with -mssse3/-mavx2 (the
+// NATIVE_ARCH CMake option) makes those checks constant and enables the few AVX2 paths that are too small to dispatch.
+// Every kernel has a scalar fallback for other targets. MSVC does not define __SSE2__ or __SSSE3__, so they are derived
+// from the target and from /arch:AVX2.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <immintrin.h>
+    #define SIMD_SSE2_ENABLED 1
+#else
+    #define SIMD_SSE2_ENABLED 0
+#endif
+
+#if defined(__SSSE3__) || (defined(_MSC_VER) && defined(__AVX2__))
+    #define SIMD_SSSE3_ENABLED 1
+#else
+    #define SIMD_SSSE3_ENABLED 0
+#endif
+
+#if defined(__AVX2__)
+    #define SIMD_AVX2_ENABLED 1
+#else
+    #define SIMD_AVX2_ENABLED 0
+#endif
+
+// SIMD_SSSE3_ENABLED and SIMD_AVX2_ENABLED are set only when the whole translation unit may use the instructions.
+// SIMD_DISPATCH_ENABLED is set when kernels for them can still be compiled per function and called after a CPU check.
+#if SIMD_SSE2_ENABLED && (defined(__GNUC__) || defined(__clang__))
+    #define SIMD_DISPATCH_ENABLED 1
+    #define SIMD_TARGET_SSSE3 __attribute__((target("ssse3")))
+    #define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define SIMD_DISPATCH_ENABLED 0
+    #define SIMD_TARGET_SSSE3
+    #define SIMD_TARGET_AVX2
+#endif
+
+#if SIMD_DISPATCH_ENABLED
+inline bool simdHasSsse3() {
+#if SIMD_SSSE3_ENABLED
+    return true;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+inline bool simdHasAvx2() {
+#if SIMD_AVX2_ENABLED
+    return true;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+// Index of the lowest set bit of a movemask result. The mask must not be zero.
+inline i32 simdLowestSetBit(u32 mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return i32(idx);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline i32 simdLowestSetBit64(u64 mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return i32(idx);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
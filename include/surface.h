@@ -74,17 +74,95 @@ enum struct Origin {
     SENTINEL
 };
 
+constexpr Origin originFlippedVertically(Origin origin) {
+    switch (origin) {
+        case Origin::BottomLeft:  return Origin::TopLeft;
+        case Origin::BottomRight: return Origin::TopRight;
+        case Origin::TopLeft:     return Origin::BottomLeft;
+        case Origin::TopRight:    return Origin::BottomRight;
+
+        case Origin::Center:    [[fallthrough]];
+        case Origin::Undefined: [[fallthrough]];
+        case Origin::SENTINEL:  [[fallthrough]];
+        default:                return origin;
+    }
+}
+
+constexpr Origin originFlippedHorizontally(Origin origin) {
+    switch (origin) {
+        case Origin::BottomLeft:  return Origin::BottomRight;
+        case Origin::BottomRight: return Origin::BottomLeft;
+        case Origin::TopLeft:     return Origin::TopRight;
+        case Origin::TopRight:    return Origin::TopLeft;
+
+        case Origin::Center:    [[fallthrough]];
+        case Origin::Undefined: [[fallthrough]];
+        case Origin::SENTINEL:  [[fallthrough]];
+        default:                return origin;
+    }
+}
+
 struct Surface {
     core::AllocatorContext* actx = nullptr;
     Origin origin = Origin::Undefined;
     PixelFormat pixelFormat = PixelFormat::Unknown;
     i32 width = 0;
     i32 height = 0;
+
+    // Byte distance from the start of row y to the start of row y + 1. A negative pitch describes rows that are laid
+    // out bottom-up in memory, which is how vertical flips are done without touching the pixels.
     i32 pitch = 0;
+
+    // Always points to the start of row 0. With a negative pitch this is NOT the lowest address of the pixel memory;
+    // use memoryBegin() for that.
     u8* data = nullptr;
 
-    constexpr i32 size() const { return height * pitch; }
+    // Set when the pixels live inside a bigger allocation the surface took over, like a whole file buffer. free()
+    // then releases that allocation instead of just the pixels.
+    core::Memory<u8> adoptedMemory;
+
+    constexpr i32 absPitch() const { return pitch < 0 ? -pitch : pitch; }
+    constexpr i32 size() const { return height * absPitch(); }
     constexpr i32 bpp() const { return pixelFormatBytesPerPixel(pixelFormat); }
     constexpr bool isOwner() const { return actx != nullptr; }
+    constexpr bool isContiguous() const { return pitch == width * bpp(); }
+
+    constexpr u8* row(i32 y) const { return data + addr_off(y) * addr_off(pitch); }
+    constexpr u8* memoryBegin() const { return pitch < 0 ? row(height - 1) : data; }
+
+    // Non-owning copy of the surface description.
+    constexpr Surface view() const {
+        Surface ret = *this;
+        ret.actx = nullptr;
+        return ret;
+    }
+
+    // Non-owning view of the w x h rectangle at (x, y), in row/column coordinates of this surface. The view keeps this
+    // surface's pitch, so it is only contiguous if it covers whole rows.
+    constexpr Surface subSurface(i32 x, i32 y, i32 w, i32 h) const {
+        Assert(x >= 0 && y >= 0 && w >= 0 && h >= 0 && x + w <= width && y + h <= height, "sub-surface out of bounds");
+        Surface ret = view();
+        ret.data = row(y) + addr_off(x) * addr_off(bpp());
+        ret.width = w;
+        ret.height = h;
+        return ret;
+    }
+
+    // O(1) vertical flip. Ownership moves with the returned value, so `s = s.flippedVertically()` flips in place and
+    // `s.view().flippedVertically()` creates a non-owning view.
+    constexpr Surface flippedVertically() const {
+        Surface ret = *this;
+        ret.origin = originFlippedVertically(origin);
+        ret.data = height > 0 ? row(height - 1) : data;
+        ret.pitch = -pitch;
+        return ret;
+    }
+
     void free();
 };
+
+// Reverses the order of width pixels of bpp bytes each, in place.
+void reversePixels(u8* row, i32 width, i32 bpp);
+
+// Reverses every row of the surface in place and updates the origin accordingly.
+void flipSurfaceHorizontally(Surface& surface);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "surface.h"
+
+enum struct SurfaceCompareError {
+    Undefined,
+
+    SizeMismatch,
+    PixelFormatMismatch,
+    UnsupportedOrigin,
+
+    SENTINEL
+};
+
+const char* errorToCstr(SurfaceCompareError err);
+
+enum struct CompareMode {
+    ExactOnly, // Stop at the first difference; only SurfaceDiff::equal is meaningful.
+    Full       // Collect all statistics.
+};
+
+struct SurfaceDiff {
+    bool equal = true;
+    i64 mismatchedPixels = 0;
+    i32 maxChannelDelta = 0; // In 8 bit units; 5 bit channels are expanded to 8 bits before comparing.
+    f64 psnr = 0;            // In dB. Infinite when the surfaces are equal.
+
+    // Inclusive bounding box of the differing pixels, in the coordinates of the first surface. Only valid when the
+    // surfaces are not equal.
+    i32 minX = 0;
+    i32 minY = 0;
+    i32 maxX = -1;
+    i32 maxY = -1;
+};
+
+// Compares the images described by a and b, which can have different origins and pitches. b is brought to the
+// orientation of a without copying the whole surface. The padding byte of BGRX8888 and the unused bit of BGR555 are
+// ignored.
+[[nodiscard]] core::expected<SurfaceDiff, SurfaceCompareError> compareSurfaces(
+    const Surface& a,
+    const Surface& b,
+    CompareMode mode = CompareMode::Full,
+    core::AllocatorContext& actx = DEF_ALLOC
+);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "surface.h"
+
+struct Color;
+
+enum struct SurfacePoolError {
+    Undefined,
+
+    InvalidArgument,
+    MemoryCeilingReached,
+    NoFreeSlots,
+    NotFromThisPool,
+    AllocationFailed,
+
+    SENTINEL
+};
+
+const char* errorToCstr(SurfacePoolError err);
+
+enum struct SurfaceClear {
+    None, // Contents are whatever the previous user left behind.
+    Zero, // Zero filled. Skipped if the buffer is known to be zero already.
+    Fill  // Filled with the color passed to acquire.
+};
+
+struct SurfacePoolCreateInfo {
+    addr_size memoryCeiling = 256 * core::CORE_MEGABYTE; // Total bytes of pixel memory, leased and idle.
+    i32 maxSurfaces = 64;                                // Total buffers, leased and idle.
+};
+
+// Recycles pixel buffers keyed by (width, height, pixel format) so batch rendering does not allocate and page fault
+// a new framebuffer for every job. Idle buffers are evicted least recently used first when a new buffer would go over
+// the memory ceiling. New buffers come from a zeroing allocation, which the allocator can usually satisfy with fresh
+// pages, so a Zero clear of a new buffer costs nothing.
+//
+// Surfaces handed out by the pool are non-owning; give them back with release() instead of Surface::free().
+// The pool is NOT thread safe.
+struct SurfacePool {
+    struct Entry {
+        core::Memory<u8> memory;
+        PixelFormat pixelFormat;
+        i32 width;
+        i32 height;
+        u64 lastUsed;
+        bool leased;
+        bool zeroed;
+    };
+
+    core::AllocatorContext* actx = nullptr;
+    core::Memory<Entry> entries;
+    addr_size memoryCeiling = 0;
+    addr_size memoryInUse = 0;
+    u64 tick = 0;
+
+    [[nodiscard]] core::expected<Surface, SurfacePoolError> acquire(i32 width, i32 height, PixelFormat pixelFormat,
+                                                                    Origin origin, SurfaceClear clear = SurfaceClear::None,
+                                                                    const Color* clearColor = nullptr);
+    [[nodiscard]] core::expected<SurfacePoolError> release(Surface& surface);
+
+    // Frees every idle buffer.
+    void trim();
+    void free();
+
+    i32 idleCount() const;
+    i32 leasedCount() const;
+};
+
+SurfacePool createSurfacePool(const SurfacePoolCreateInfo& info, core::AllocatorContext& actx = DEF_ALLOC);
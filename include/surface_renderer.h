@@ -33,5 +33,44 @@ void fillLine(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, Color color);
 void strokeTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color);
 void fillTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color);
 
+enum struct BlendMode {
+    SourceOver,              // Straight (non-premultiplied) alpha, composited over the destination alpha too.
+    SourceOverPremultiplied, // Color channels are already multiplied by alpha.
+
+    SENTINEL
+};
+
+// Alpha-blended variants of the fill primitives. Supported for BGRA8888 and BGRA5551 surfaces.
+void blendPixel(Surface& surface, i32 x, i32 y, Color color, BlendMode mode = BlendMode::SourceOver);
+void blendRect(Surface& surface, i32 x, i32 y, Color color, i32 width, i32 height, BlendMode mode = BlendMode::SourceOver);
+void blendLine(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, Color color, BlendMode mode = BlendMode::SourceOver);
+void blendTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color,
+                   BlendMode mode = BlendMode::SourceOver);
+
+// A model projected onto a width x height surface, with its faces binned into bands of bandHeight rows by the rows
+// they cover. It is built once per frame, so rendering the frame band by band projects every vertex once and every
+// band only visits the faces that touch it.
+struct ProjectedModel {
+    const Model3D* model;
+    core::AllocatorContext* actx;
+    i32 width;
+    i32 height;
+    i32 bandHeight;
+    core::Memory<core::vec2i> points;  // Screen position of every vertex.
+    core::Memory<i32> bandFaces;       // Indices of the faces of every band, in face order, one band after the other.
+    core::Memory<i32> bandOffsets;     // Band b owns bandFaces[bandOffsets[b], bandOffsets[b + 1]).
+
+    void free();
+};
+
+ProjectedModel projectModel(const Model3D& model, i32 width, i32 height, i32 bandHeight,
+                            core::AllocatorContext& actx = DEF_ALLOC);
+
 // TODO: pass mvp matrix ?
 void renderModel(Surface& surface, const Model3D& model, bool wireframe = false);
+// Renders only rows [rowBegin, rowEnd) of the surface. Rendering every band of a surface gives the same image as
+// renderModel, so finished bands can be handed off (e.g. to TGA::StreamWriter) while the rest is still rendering.
+// The Model3D overload projects the model on every call, when rendering a frame in bands project it once instead.
+void renderModelRows(Surface& surface, const ProjectedModel& projected, i32 rowBegin, i32 rowEnd,
+                     bool wireframe = false);
+void renderModelRows(Surface& surface, const Model3D& model, i32 rowBegin, i32 rowEnd, bool wireframe = false);
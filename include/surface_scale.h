@@ -0,0 +1,29 @@
+#pragma once
+
+#include "surface.h"
+
+// Writes the 2x2 box-filtered version of src into dst. dst must have the same pixel format and dimensions
+// max(1, width / 2) x max(1, height / 2). An odd trailing source row or column is folded into the last destination row
+// or column, which then averages a 3 pixel tall or wide block.
+void downsample2x2(const Surface& src, Surface& dst);
+
+// Area-average downscale to any dst size that is not larger than src in either dimension. Every destination pixel is
+// the coverage weighted average of the source pixels under it.
+void downscaleAreaAverage(const Surface& src, Surface& dst, core::AllocatorContext& actx = DEF_ALLOC);
+
+struct MipChain {
+    core::AllocatorContext* actx = nullptr;
+
+    // levels[0] is a non-owning view of the base surface, every next level is half the size of the previous one down
+    // to 1x1.
+    core::Memory<Surface> levels;
+
+    i32 count() const { return i32(levels.len()); }
+
+    // Smallest level that is still at least minWidth x minHeight, or the base level when it is already too small.
+    const Surface& levelAtLeast(i32 minWidth, i32 minHeight) const;
+
+    void free();
+};
+
+[[nodiscard]] MipChain createMipChain(const Surface& base, core::AllocatorContext& actx = DEF_ALLOC);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "tga_files.h"
+#include "surface.h"
+
+namespace TGA
+{
+
+struct BatchLoadResult {
+    const char* path = nullptr;
+    i32 index = -1;                    // Position of the path in the input list.
+    TGAError err = TGAError::Undefined; // Undefined when the image was loaded.
+    Surface surface;                   // Owned by the callback from here on; empty when err is set.
+};
+
+// Called once per path, from the worker threads but never concurrently, in completion order.
+using BatchLoadCallback = void (*)(BatchLoadResult& result, void* userData);
+
+struct BatchLoadInfo {
+    BatchLoadCallback callback = nullptr;
+    void* userData = nullptr;
+    i32 workerCount = 0;                                      // 0 uses one worker per hardware thread.
+    addr_size inFlightByteBudget = 256 * core::CORE_MEGABYTE; // File bytes plus decoded pixels being worked on at once.
+};
+
+struct BatchLoadStats {
+    i32 loaded = 0;
+    i32 failed = 0;
+    addr_size peakInFlightBytes = 0;
+};
+
+// Loads and decodes every file on a pool of worker threads. Files are memory mapped, and a worker only starts decoding
+// once the file and its decoded pixels fit in the in-flight budget, so memory use stays bounded however many files
+// there are. An image that is larger than the whole budget is loaded alone.
+//
+// The surfaces are allocated from actx on the worker threads, so it has to be thread safe.
+[[nodiscard]] core::expected<BatchLoadStats, TGAError> loadFilesBatch(const char* const* paths, i32 pathsCount,
+                                                                      const BatchLoadInfo& info,
+                                                                      core::AllocatorContext& actx = DEF_ALLOC);
+
+// Same as above for every *.tga file directly inside the directory.
+[[nodiscard]] core::expected<BatchLoadStats, TGAError> loadDirectoryBatch(const char* dirPath, const BatchLoadInfo& info,
+                                                                          core::AllocatorContext& actx = DEF_ALLOC);
+
+} // namespace TGA
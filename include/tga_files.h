@@ -1,8 +1,10 @@
 #pragma once
 
 #include "core_init.h"
+#include "file_mapping.h"
+#include "surface.h"
 
-struct Surface;
+struct SurfacePool;
 
 namespace TGA
 {
@@ -24,6 +26,7 @@ enum struct TGAError {
     InvalidArgument,
     UnsupportedImageType,
     FailedToCreateSurface,
+    MissingExtensionData,
 
     SENTINEL
 };
@@ -175,14 +178,14 @@ struct PACKED Header {
         return i32(0b1111 & imageSpecification[9]);
     }
     constexpr inline void setAlphaBits(u8 x) {
-        imageSpecification[9] = TGAByte(0b1111 & x);
+        imageSpecification[9] = TGAByte((imageSpecification[9] & ~0b1111) | (0b1111 & x));
     }
 
     constexpr inline i32 origin() const {
         return i32(0b110000 & imageSpecification[9]) >> 4;
     }
     constexpr inline void setOrigin(u8 x) {
-        imageSpecification[9] = TGAByte((0b11 & x) << 4);
+        imageSpecification[9] = TGAByte((imageSpecification[9] & ~0b110000) | ((0b11 & x) << 4));
     }
 };
 PACK_POP
@@ -199,7 +202,39 @@ struct ImageColorMapData {};
 
 struct DeveloperArea {};
 
-struct ExtensionArea {};
+// Optional TGA 2.0 area pointed to by the footer. Strings are zero terminated and zero padded.
+PACK_PUSH
+struct PACKED ExtensionArea {
+    TGAShort extensionSize;        // Bytes 0-1: Always 495 for TGA 2.0.
+    char authorName[41];           // Bytes 2-42
+    char authorComments[324];      // Bytes 43-366: 4 lines of 80 characters, each followed by a zero.
+    TGAShort dateTimeStamp[6];     // Bytes 367-378: Month, day, year, hour, minute, second.
+    char jobName[41];              // Bytes 379-419
+    TGAShort jobTime[3];           // Bytes 420-425: Hours, minutes, seconds.
+    char softwareId[41];           // Bytes 426-466
+    TGAShort softwareVersion;      // Bytes 467-468: Version number times 100.
+    char softwareVersionLetter;    // Byte 469
+    TGALong keyColor;              // Bytes 470-473: A:R:G:B, the background color.
+    TGAShort pixelAspectRatio[2];  // Bytes 474-477: Numerator, denominator; zero denominator means not specified.
+    TGAShort gammaValue[2];        // Bytes 478-481: Numerator, denominator.
+    TGALong colorCorrectionOffset; // Bytes 482-485
+    // Bytes 486-489: Offset of the postage stamp, a small (at most 64x64) uncompressed copy of the image in the same
+    // pixel format, preceded by its width and height as one byte each.
+    TGALong postageStampOffset;
+    // Bytes 490-493: Offset of the scan line table, one TGALong per scan line holding the file offset of the line, in
+    // the order lines are stored. This is what makes run-length encoded rows randomly accessible.
+    TGALong scanLineOffset;
+    // Byte 494: 0 - no alpha, 1 - undefined data that can be ignored, 2 - undefined data that should be retained,
+    // 3 - useful alpha, 4 - pre-multiplied alpha.
+    TGAByte attributesType;
+};
+PACK_POP
+
+constexpr addr_size EXTENSION_AREA_SIZE = 495;
+static_assert(sizeof(ExtensionArea) == EXTENSION_AREA_SIZE);
+
+// Largest postage stamp the spec allows.
+constexpr i32 MAX_POSTAGE_STAMP_SIZE = 64;
 
 enum struct FileType {
     Unknown,
@@ -211,6 +246,7 @@ struct TGAImage {
     core::AllocatorContext* actx = nullptr;
 
     core::Memory<u8> memory;
+    MappedFile mapping; // Set when loaded with loadFileMapped; memory then points into the mapping.
 
     constexpr static addr_off fileHeaderOff = 0;
     constexpr static addr_off imageColorMapDataAreaOff = sizeof(Header);
@@ -226,6 +262,10 @@ struct TGAImage {
 
     core::expected<TGAError> header(const Header*& out) const;
     core::expected<TGAError> footer(const Footer*& out) const;
+    // MissingExtensionData when the file has none.
+    core::expected<TGAError> extensionArea(const ExtensionArea*& out) const;
+    // File offset of a row (in file order) from the scan line table. MissingExtensionData when the file has no table.
+    core::expected<TGAError> scanLineOffset(i32 row, addr_off& out) const;
 
     core::expected<i32, TGAError> imageType() const;
 
@@ -238,12 +278,75 @@ struct CreateFileFromSurfaceParams {
     const char* path = nullptr;
     i32 imageType = 1;
     FileType fileType = FileType::Unknown;
+
+    // Extension area contents, only for FileType::New. The extension area is written when any of these is set.
+    bool writeScanLineTable = false;
+    i32 postageStampSize = 0; // Longest side of the postage stamp, at most MAX_POSTAGE_STAMP_SIZE; 0 writes none.
 };
 
 const char* errorToCstr(TGAError err);
 
+// What a surface created from the file would look like, without decoding (or even reading) the pixels.
+struct ProbeInfo {
+    i32 imageType = 0;
+    i32 width = 0;
+    i32 height = 0;
+    PixelFormat pixelFormat = PixelFormat::Unknown; // The format the pixels decode to.
+    Origin origin = Origin::Undefined;
+    FileType fileType = FileType::Unknown;
+    addr_size fileSize = 0;
+};
+
+struct StreamWriterCreateInfo {
+    const Surface& surface;  // Bands are read from this surface as they are submitted.
+    const char* path = nullptr;
+    i32 imageType = 2;       // 2 (uncompressed) or 10 (run-length encoded).
+    FileType fileType = FileType::New;
+    i32 maxQueuedBands = 4;  // submitRows blocks while this many bands are waiting to be written.
+};
+
+// Writes a true color file on a background I/O thread while the surface is still being rendered. Bands are submitted
+// as the renderer finishes them, in file order (starting from row 0 of the surface). The I/O thread reads the rows
+// straight from the surface, so submitted rows must not change until finish() returns.
+struct StreamWriter {
+    struct State;
+    State* state = nullptr;
+
+    [[nodiscard]] core::expected<TGAError> submitRows(i32 rowBegin, i32 rowCount);
+    // Waits for the queued bands, writes the footer and closes the file. The writer is freed whether it fails or not.
+    [[nodiscard]] core::expected<TGAError> finish();
+    // Abandons the file: bands already queued are still written, but the footer is not.
+    void free();
+};
+
+
 [[nodiscard]] core::expected<TGAImage, TGAError> loadFile(const char* path, core::AllocatorContext& actx = DEF_ALLOC);
+// Same as above, but the file is memory mapped instead of read, so only the pages that are touched get loaded.
+[[nodiscard]] core::expected<TGAImage, TGAError> loadFileMapped(const char* path);
+// Reads only the header and the footer, with two positioned reads, and allocates nothing. Meant for scanning large
+// libraries of images where reading whole files would be bound by their size.
+[[nodiscard]] core::expected<ProbeInfo, TGAError> probeFile(const char* path);
 [[nodiscard]] core::expected<Surface, TGAError> createSurfaceFromTgaImage(const TGA::TGAImage& tgaImage, core::AllocatorContext& actx = DEF_ALLOC);
+// Same as above, but the pixel buffer is recycled from the pool. Give the surface back with SurfacePool::release.
+[[nodiscard]] core::expected<Surface, TGAError> createSurfaceFromTgaImage(const TGA::TGAImage& tgaImage, SurfacePool& pool);
+// Consumes the image. Uncompressed true color images (type 2) loaded with loadFile are not copied: the surface takes
+// over the file buffer and frees it through the image's allocator. Any other image is decoded into a buffer allocated
+// from actx and then freed. On failure the image is left as it was.
+[[nodiscard]] core::expected<Surface, TGAError> createSurfaceByAdoptingTgaImage(TGA::TGAImage&& tgaImage, core::AllocatorContext& actx = DEF_ALLOC);
+// Non-owning view of the pixels stored in the image, valid for as long as the image is. Only uncompressed true color
+// images (type 2) can be viewed; combined with loadFileMapped nothing is copied.
+[[nodiscard]] core::expected<Surface, TGAError> createSurfaceViewFromTgaImage(const TGA::TGAImage& tgaImage);
+// Size, format and origin of the surface the image decodes to; data is left null.
+[[nodiscard]] core::expected<Surface, TGAError> describeSurfaceForTgaImage(const TGA::TGAImage& tgaImage);
+// Decodes rows [rowBegin, rowBegin + rows.height) of the image into rows, which must be a contiguous surface with the
+// described width and pixel format. Row 0 is the first row stored in the file, like row 0 of a decoded surface. Run-length
+// encoded rows are located through the scan line table when the file has one, so bands can be decoded in any order and
+// from several threads at once; without a table everything before rowBegin is skipped packet by packet.
+[[nodiscard]] core::expected<TGAError> decodeTgaImageRows(const TGA::TGAImage& tgaImage, i32 rowBegin, Surface& rows,
+                                                          core::AllocatorContext& scratchActx = DEF_ALLOC);
+// Decodes the postage stamp from the extension area. MissingExtensionData when the file has none.
+[[nodiscard]] core::expected<Surface, TGAError> createPostageStampFromTgaImage(const TGA::TGAImage& tgaImage, core::AllocatorContext& actx = DEF_ALLOC);
 [[nodiscard]] core::expected<TGAError> createFileFromSurface(const CreateFileFromSurfaceParams& params);
+[[nodiscard]] core::expected<StreamWriter, TGAError> createStreamWriter(const StreamWriterCreateInfo& info, core::AllocatorContext& actx = DEF_ALLOC);
 
 } // namespace TGA
@@ -1,8 +1,7 @@
 #pragma once
 
 #include "core_init.h"
-
-struct Model3D;
+#include "model.h"
 
 namespace Wavefront {
 
@@ -24,8 +23,8 @@ const char* errorToCstr(WavefrontError err);
 
     Vertex data:
         * geometric vertices (v) - (supported ✅) - Polygonal and free-form geometry statement.
-        * texture vertices (vt) - (support planned ⚠️)
-        * vertex normals (vn) - (support planned ⚠️)
+        * texture vertices (vt) - (supported ✅)
+        * vertex normals (vn) - (supported ✅)
         * parameter space vertices (vp) - (support planned ⚠️)
 
         NOTE: The vertex data is represented by four vertex lists; one for each type of vertex coordinate. A right-hand
@@ -57,10 +56,10 @@ const char* errorToCstr(WavefrontError err);
         * connect (con)
 
     Grouping:
-        * group name (g) - (support planned ⚠️)
+        * group name (g) - (supported ✅) - The rest of the line is the name, several names are not split.
         * smoothing group (s)
         * merging group (mg)
-        * object name (o) - (support planned ⚠️)
+        * object name (o) - (supported ✅) - Read as a group name.
 
     Display/render attributes:
         * bevel interpolation (bevel)
@@ -114,21 +113,121 @@ struct WavefrontObj {
         i32 setFieldsMask;
     };
 
+    // An o or g statement. The faces from firstFace up to the firstFace of the next group belong to it, the faces
+    // before the first group belong to none.
+    struct Group {
+        i32 firstFace;
+        i32 nameOffset; // Into groupNames.
+        i32 nameLength;
+    };
+
     core::Memory<core::vec4f> vertices;
     i32 verticesCount;
+    core::Memory<core::vec3f> textureCoords; // (u, v, w), the optional v and w default to 0.
+    i32 textureCoordsCount;
+    core::Memory<core::vec3f> normals;
+    i32 normalsCount;
     core::Memory<Face> faces;
     i32 facesCount;
+    core::Memory<Group> groups;
+    i32 groupsCount;
+    core::Memory<char> groupNames; // Not null terminated.
+    i32 groupNamesSize;
+
+    core::StrView groupName(const Group& g) const {
+        return core::sv(groupNames.data() + g.nameOffset, addr_size(g.nameLength));
+    }
 
     constexpr inline void setAllocator(core::AllocatorContext& _actx) { actx = &_actx; }
 
     void free();
 };
 
+// The file is memory mapped and parsed in place, only the arrays of WavefrontObj are allocated from actx.
 [[nodiscard]] core::expected<WavefrontObj, WavefrontError> loadFile(
     const char* path,
     WavefrontVersion fileVersion,
     core::AllocatorContext& actx = DEF_ALLOC
 );
-Model3D createModelFromWavefrontObj(const WavefrontObj& obj, core::AllocatorContext& modelActx = DEF_ALLOC);
+struct ParallelLoadInfo {
+    i32 workerCount = 0;                          // 0 uses one worker per hardware thread.
+    addr_size minChunkSize = core::CORE_MEGABYTE; // The file is not split into chunks smaller than this.
+};
+
+// Same result as loadFile, but the file is split at line boundaries into one chunk per worker and the chunks are parsed
+// in parallel. Each worker first counts the statements in its chunk, a prefix sum over the counts gives every chunk
+// its slice of the final arrays, and the chunks are then parsed straight into their slices. Face indices are stored as
+// written in the file, so no chunk needs to know what came before it.
+//
+// All allocations are made on the calling thread.
+[[nodiscard]] core::expected<WavefrontObj, WavefrontError> loadFileParallel(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const ParallelLoadInfo& info = {},
+    core::AllocatorContext& actx = DEF_ALLOC
+);
+
+struct StreamingLoadInfo {
+    addr_size chunkSize = 4 * core::CORE_MEGABYTE; // Bytes read from the file at a time.
+};
+
+// Receives the statements of a file in the order they are written. A null callback skips that kind of statement.
+struct StreamingCallbacks {
+    void (*vertex)(const core::vec4f& v, void* userData) = nullptr;
+    void (*textureCoord)(const core::vec3f& vt, void* userData) = nullptr;
+    void (*normal)(const core::vec3f& vn, void* userData) = nullptr;
+    void (*face)(const WavefrontObj::Face& f, void* userData) = nullptr;
+    void (*group)(core::StrView name, void* userData) = nullptr; // The faces that follow belong to this group.
+    void* userData = nullptr;
+};
+
+// Reads the file info.chunkSize bytes at a time and hands every statement to the callbacks as soon as it is parsed.
+// Nothing is kept after a callback returns, so memory use is one chunk however large the file is. Lines that straddle
+// two chunks are carried over to the next read. When a statement is invalid, the callbacks have already seen every
+// statement before it.
+[[nodiscard]] core::expected<WavefrontError> streamFile(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const StreamingCallbacks& callbacks,
+    const StreamingLoadInfo& info = {},
+    core::AllocatorContext& actx = DEF_ALLOC
+);
+
+// Same result as loadFile, without mapping the file: it is streamed twice, once to count the statements and once to
+// parse them into storage of exactly the right size. Peak memory is the WavefrontObj plus one chunk.
+[[nodiscard]] core::expected<WavefrontObj, WavefrontError> loadFileStreaming(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const StreamingLoadInfo& info = {},
+    core::AllocatorContext& actx = DEF_ALLOC
+);
+
+// Every distinct (v, vt, vn) combination used by a face corner becomes one vertex, found with an open addressing hash
+// table, so the faces index a single vertex array. Files without texture coordinates and normals keep one vertex per
+// position, and when they ask for VertexLayout::Interleaved they get VertexLayout::Positions instead, since their
+// interleaved vertices would be mostly zeros. layout picks between Model3D::vertices, Model3D::streams and
+// Model3D::positions.
+//
+// Every group that has faces becomes a submesh; faces before the first group make an unnamed submesh of their own.
+Model3D createModelFromWavefrontObj(const WavefrontObj& obj, core::AllocatorContext& modelActx = DEF_ALLOC,
+                                    VertexLayout layout = VertexLayout::Interleaved);
+
+// Same as above, but obj is consumed: each of its arrays is freed as soon as the conversion is done with it, the faces
+// before the vertices are allocated, so the peak is well below holding both objects in full. A positions only obj that
+// was allocated with modelActx gives its vertex array to Model3D::positions without a copy. obj is empty afterwards.
+Model3D createModelFromWavefrontObj(WavefrontObj&& obj, core::AllocatorContext& modelActx = DEF_ALLOC,
+                                    VertexLayout layout = VertexLayout::Interleaved);
+
+// Loads the model through a model cache file in cacheDirectory, named after the hash of path. The cache is used as long
+// as the file at path keeps the size and modification time it had when the cache was written; otherwise the file is
+// parsed and the cache rewritten. Failing to write the cache is logged, but the parsed model is still returned.
+//
+// A model that comes from the cache points into the mapped cache file, see Model3D::mapping.
+[[nodiscard]] core::expected<Model3D, WavefrontError> loadModelCached(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const char* cacheDirectory,
+    core::AllocatorContext& actx = DEF_ALLOC
+);
 
 } // Wavefront
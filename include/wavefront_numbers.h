@@ -0,0 +1,17 @@
+#pragma once
+
+#include "wavefront_files.h"
+
+namespace Wavefront {
+
+// Number parsers for the tokens of a Wavefront file. The whole token has to be the number: no surrounding whitespace and
+// nothing after it, anything else is an InvalidFileFormat error.
+
+// [+-][digits][.[digits]][(e|E)[+-]digits] with at least one mantissa digit. The result is correctly rounded. Plain
+// decimals that fit a float exactly take a single float multiply or divide, everything else goes through Eisel-Lemire.
+[[nodiscard]] core::expected<f32, WavefrontError> parseFloat(const char* s, addr_size len);
+
+// [+-]digits, accumulated eight digits at a time. Values outside of i32 are an error.
+[[nodiscard]] core::expected<i32, WavefrontError> parseInt(const char* s, addr_size len);
+
+} // Wavefront
@@ -6,24 +6,24 @@
 #include "surface_renderer.h"
 #include "wavefront_files.h"
 #include "model.h"
+#include "surface_scale.h"
 
-void renderObjFileIntoASurface(Surface& s, const char* objFilePath, bool wireframe) {
-    auto obj = core::Unpack(Wavefront::loadFile(objFilePath, Wavefront::WavefrontVersion::VERSION_3_0));
-    logInfo("verts={}, faces={}", obj.verticesCount, obj.facesCount);
-
-    auto model = Wavefront::createModelFromWavefrontObj(obj);
-    obj.free();
-
-    renderModel(s, model, wireframe);
-    model.free();
+Model3D loadModel(const char* objFilePath) {
+    // Only the first run parses the OBJ files, later runs map the cached models.
+    auto model = core::Unpack(
+        Wavefront::loadModelCached(objFilePath, Wavefront::WavefrontVersion::VERSION_3_0, OUT_DIRECTORY)
+    );
+    logInfo("verts={}, faces={}", model.verticesCount(), model.faces.len());
+    return model;
 }
 
-void renderObjFilesToTga(const char** objFiles, i32 objFilesLen, const char* outputPath) {
+void renderObjFilesToTga(const char** objFiles, i32 objFilesLen, const char* outputPath, const char* previewPath) {
     constexpr PixelFormat pixelFormat = PixelFormat::BGR888;
     constexpr i32 bpp = pixelFormatBytesPerPixel(pixelFormat);
 
     constexpr addr_size WIDTH = 1024;
     constexpr addr_size HEIGHT = 1024;
+    constexpr i32 BAND_HEIGHT = 64;
 
     static u8 buf[WIDTH*HEIGHT*bpp] = {}; // This might be big
     Surface s = Surface();
@@ -35,20 +35,60 @@ void renderObjFilesToTga(const char** objFiles, i32 objFilesLen, const char* out
     s.pitch = s.width * bpp;
     s.data = buf;
 
-    fillRect(s, 0, 0, BLACK, s.width, s.height);
-
+    constexpr i32 MAX_MODELS = 16;
+    Assert(objFilesLen <= MAX_MODELS, "too many models");
+    Model3D models[MAX_MODELS] = {};
     for (i32 i = 0; i < objFilesLen; i++) {
-        renderObjFileIntoASurface(s, objFiles[i], false);
+        models[i] = loadModel(objFiles[i]);
     }
+    defer {
+        for (i32 i = 0; i < objFilesLen; i++) models[i].free();
+    };
 
-    TGA::CreateFileFromSurfaceParams params = {
+    // Render in row bands and hand every finished band to the writer, so the file is written while the rest of the
+    // image is still being rendered.
+    TGA::StreamWriterCreateInfo writerInfo = {
         .surface = s,
         .path = outputPath,
-        .imageType = 2,
+        .imageType = 10,
         .fileType = TGA::FileType::New,
     };
-    core::Expect(TGA::createFileFromSurface(params));
+    TGA::StreamWriter writer = core::Unpack(TGA::createStreamWriter(writerInfo));
+
+    // Project every model once for the whole frame, each band then only visits the faces binned to it.
+    ProjectedModel projected[MAX_MODELS] = {};
+    for (i32 i = 0; i < objFilesLen; i++) {
+        projected[i] = projectModel(models[i], s.width, s.height, BAND_HEIGHT);
+    }
+    defer {
+        for (i32 i = 0; i < objFilesLen; i++) projected[i].free();
+    };
+
+    for (i32 y = 0; y < s.height; y += BAND_HEIGHT) {
+        i32 rowCount = core::core_min(BAND_HEIGHT, s.height - y);
+        fillRect(s, 0, y, BLACK, s.width, rowCount);
+        for (i32 i = 0; i < objFilesLen; i++) {
+            renderModelRows(s, projected[i], y, y + rowCount, false);
+        }
+        core::Expect(writer.submitRows(y, rowCount));
+    }
+
+    // Emit a preview from the same render while the last bands are still being written.
+    constexpr i32 PREVIEW_SIZE = 256;
+    MipChain mips = createMipChain(s);
+    defer { mips.free(); };
+
+    core::Expect(writer.finish());
     logInfo("Create a file in \"{}\"", outputPath);
+
+    TGA::CreateFileFromSurfaceParams previewParams = {
+        .surface = mips.levelAtLeast(PREVIEW_SIZE, PREVIEW_SIZE),
+        .path = previewPath,
+        .imageType = 10,
+        .fileType = TGA::FileType::New,
+    };
+    core::Expect(TGA::createFileFromSurface(previewParams));
+    logInfo("Create a file in \"{}\"", previewPath);
 }
 
 i32 main() {
@@ -66,7 +106,8 @@ i32 main() {
             ASSETS_DIRECTORY "/test_assets/obj/multipart/eyes.obj",
         };
         const char* output = OUT_DIRECTORY "/output.tga";
-        renderObjFilesToTga(filesToRender, CORE_C_ARRLEN(filesToRender), output);
+        const char* preview = OUT_DIRECTORY "/output_preview.tga";
+        renderObjFilesToTga(filesToRender, CORE_C_ARRLEN(filesToRender), output, preview);
     }
     return 0;
 }
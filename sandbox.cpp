@@ -25,13 +25,15 @@ void openAndTestOneTGAFile(const char* path, bool debugRender = false) {
         const TGA::Header* h = nullptr;
         core::Expect(tgaFile.header(h));
 
-        if (h->imageType == 2) {
+        bool isSupported = h->imageType == 1 || h->imageType == 2 || h->imageType == 3 ||
+                           h->imageType == 9 || h->imageType == 10 || h->imageType == 11;
+        if (isSupported) {
 
             auto surface = core::Unpack(createSurfaceFromTgaImage(tgaFile), "Failed to create surface from TGA file.");
             defer { surface.free(); };
             logInfo_Surface(surface);
 
-            logInfo("Image is True Color; rendering is supported.");
+            logInfo("Image type {} is supported; rendering.", i32(h->imageType));
             debug_immPreviewSurface(surface);
         }
     }
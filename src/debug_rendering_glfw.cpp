@@ -61,16 +61,22 @@ void debug_immPreviewSurface(const Surface& surface) {
     defer { glDeleteTextures(1, &tex); };
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // allow tightly packed rows
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, surface.absPitch() / surface.bpp()); // allow padded rows
+    defer { glPixelStorei(GL_UNPACK_ROW_LENGTH, 0); };
+
+    // GL can't walk rows backwards, so a negative pitch surface is uploaded in memory order and described by the
+    // opposite vertical origin.
+    Origin origin = surface.pitch < 0 ? originFlippedVertically(surface.origin) : surface.origin;
 
     const GLint internalFmt = pickGLInternalFormat(surface.pixelFormat);
     const GLenum fmt = pickGLFormat(surface.pixelFormat);
     const GLenum type = pickGLType(surface.pixelFormat);
     glTexImage2D(GL_TEXTURE_2D, 0, internalFmt, surface.width, surface.height,
-                0, fmt, type, surface.data);
+                0, fmt, type, surface.memoryBegin());
 
     // Choose texture coordinates based on surface origin (default GL origin is bottom-left).
     float u0 = 0.f, u1 = 1.f, v0 = 0.f, v1 = 1.f;
-    switch (surface.origin) {
+    switch (origin) {
         case Origin::BottomLeft:
             break;
         case Origin::BottomRight:
@@ -0,0 +1,381 @@
+#include "file_mapping.h"
+
+#if OS_WIN
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <cstdio>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+#endif
+
+const char* errorToCstr(FileMappingError err) {
+    switch (err) {
+        case FileMappingError::FailedToOpenFile:    return "Failed to open file";
+        case FileMappingError::FailedToStatFile:    return "Failed to stat file";
+        case FileMappingError::FailedToMapFile:     return "Failed to map file";
+        case FileMappingError::FailedToReadFile:    return "Failed to read file";
+        case FileMappingError::FailedToWriteFile:   return "Failed to write file";
+        case FileMappingError::FailedToReplaceFile: return "Failed to replace file";
+        case FileMappingError::FailedToRemoveFile:  return "Failed to remove file";
+        case FileMappingError::EmptyFile:           return "File is empty";
+
+        case FileMappingError::Undefined: [[fallthrough]];
+        case FileMappingError::SENTINEL:  [[fallthrough]];
+        default:                            return "unknown";
+    }
+}
+
+#if OS_WIN
+
+void MappedFile::free() {
+    if (memory.data()) {
+        UnmapViewOfFile(memory.data());
+        memory = {};
+    }
+}
+
+core::expected<MappedFile, FileMappingError> mapFile(const char* path, MappingAccessHint) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return core::unexpected(FileMappingError::FailedToOpenFile);
+    }
+    defer { CloseHandle(file); };
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        return core::unexpected(FileMappingError::FailedToStatFile);
+    }
+    if (size.QuadPart == 0) {
+        // Zero sized files can't be mapped.
+        return core::unexpected(FileMappingError::EmptyFile);
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        return core::unexpected(FileMappingError::FailedToMapFile);
+    }
+    defer { CloseHandle(mapping); }; // The view keeps the mapping alive.
+
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (ptr == nullptr) {
+        return core::unexpected(FileMappingError::FailedToMapFile);
+    }
+
+    MappedFile ret;
+    ret.memory.ptr = reinterpret_cast<u8*>(ptr);
+    ret.memory.length = addr_size(size.QuadPart);
+    return ret;
+}
+
+core::expected<FileStamp, FileMappingError> statFile(const char* path) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes)) {
+        return core::unexpected(FileMappingError::FailedToStatFile);
+    }
+
+    // FILETIME counts 100ns intervals.
+    u64 writeTime = (u64(attributes.ftLastWriteTime.dwHighDateTime) << 32) | u64(attributes.ftLastWriteTime.dwLowDateTime);
+
+    FileStamp ret;
+    ret.size = (addr_size(attributes.nFileSizeHigh) << 32) | addr_size(attributes.nFileSizeLow);
+    ret.modifiedTimeNs = i64(writeTime) * 100;
+    return ret;
+}
+
+void ReadOnlyFile::free() {
+    if (isOpen()) {
+        CloseHandle(reinterpret_cast<HANDLE>(handle));
+        handle = -1;
+        size = 0;
+    }
+}
+
+core::expected<ReadOnlyFile, FileMappingError> openReadOnlyFile(const char* path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return core::unexpected(FileMappingError::FailedToOpenFile);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return core::unexpected(FileMappingError::FailedToStatFile);
+    }
+
+    ReadOnlyFile ret;
+    ret.handle = reinterpret_cast<i64>(file);
+    ret.size = addr_size(size.QuadPart);
+    return ret;
+}
+
+core::expected<FileMappingError> readFileAt(const ReadOnlyFile& file, addr_size offset, void* dst, addr_size size) {
+    if (offset > file.size || size > file.size - offset) {
+        return core::unexpected(FileMappingError::FailedToReadFile);
+    }
+
+    u8* out = reinterpret_cast<u8*>(dst);
+    while (size > 0) {
+        // The offset in OVERLAPPED makes the read positioned; the handle is synchronous, so ReadFile still blocks.
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(u64(offset) >> 32);
+
+        DWORD chunk = DWORD(core::core_min(size, addr_size(1) << 30));
+        DWORD read = 0;
+        if (!ReadFile(reinterpret_cast<HANDLE>(file.handle), out, chunk, &read, &overlapped) || read == 0) {
+            return core::unexpected(FileMappingError::FailedToReadFile);
+        }
+
+        out += read;
+        offset += read;
+        size -= read;
+    }
+
+    return {};
+}
+
+void WriteOnlyFile::free() {
+    if (isOpen()) {
+        CloseHandle(reinterpret_cast<HANDLE>(handle));
+        handle = -1;
+    }
+}
+
+core::expected<WriteOnlyFile, FileMappingError> createWriteOnlyFile(const char* path) {
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return core::unexpected(FileMappingError::FailedToOpenFile);
+    }
+
+    WriteOnlyFile ret;
+    ret.handle = reinterpret_cast<i64>(file);
+    return ret;
+}
+
+core::expected<FileMappingError> writeFileGathered(const WriteOnlyFile& file, const FileWriteSpan* spans, i32 spansCount) {
+    // WriteFileGather only works on unbuffered, page aligned I/O, so spans are written one by one.
+    for (i32 i = 0; i < spansCount; i++) {
+        const u8* data = reinterpret_cast<const u8*>(spans[i].data);
+        addr_size size = spans[i].size;
+        while (size > 0) {
+            DWORD chunk = DWORD(core::core_min(size, addr_size(1) << 30));
+            DWORD written = 0;
+            if (!WriteFile(reinterpret_cast<HANDLE>(file.handle), data, chunk, &written, nullptr) || written == 0) {
+                return core::unexpected(FileMappingError::FailedToWriteFile);
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    return {};
+}
+
+core::expected<FileMappingError> replaceFile(const char* srcPath, const char* dstPath) {
+    if (!MoveFileExA(srcPath, dstPath, MOVEFILE_REPLACE_EXISTING)) {
+        return core::unexpected(FileMappingError::FailedToReplaceFile);
+    }
+    return {};
+}
+
+core::expected<FileMappingError> removeFile(const char* path) {
+    if (!DeleteFileA(path)) {
+        return core::unexpected(FileMappingError::FailedToRemoveFile);
+    }
+    return {};
+}
+
+u32 currentProcessId() {
+    return u32(GetCurrentProcessId());
+}
+
+#else
+
+void MappedFile::free() {
+    if (memory.data()) {
+        munmap(memory.data(), memory.len());
+        memory = {};
+    }
+}
+
+core::expected<MappedFile, FileMappingError> mapFile(const char* path, MappingAccessHint hint) {
+    i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return core::unexpected(FileMappingError::FailedToOpenFile);
+    }
+    defer { close(fd); }; // The mapping stays valid after the descriptor is closed.
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return core::unexpected(FileMappingError::FailedToStatFile);
+    }
+    if (st.st_size == 0) {
+        // Zero sized files can't be mapped.
+        return core::unexpected(FileMappingError::EmptyFile);
+    }
+
+    addr_size size = addr_size(st.st_size);
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return core::unexpected(FileMappingError::FailedToMapFile);
+    }
+
+    switch (hint) {
+        case MappingAccessHint::Sequential: madvise(ptr, size, MADV_SEQUENTIAL); break;
+        case MappingAccessHint::Random:     madvise(ptr, size, MADV_RANDOM);     break;
+        case MappingAccessHint::Normal:     break;
+    }
+
+    MappedFile ret;
+    ret.memory.ptr = reinterpret_cast<u8*>(ptr);
+    ret.memory.length = size;
+    return ret;
+}
+
+core::expected<FileStamp, FileMappingError> statFile(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return core::unexpected(FileMappingError::FailedToStatFile);
+    }
+
+#if defined(__APPLE__)
+    const struct timespec& mtime = st.st_mtimespec;
+#else
+    const struct timespec& mtime = st.st_mtim;
+#endif
+
+    FileStamp ret;
+    ret.size = addr_size(st.st_size);
+    ret.modifiedTimeNs = i64(mtime.tv_sec) * 1000000000 + i64(mtime.tv_nsec);
+    return ret;
+}
+
+void ReadOnlyFile::free() {
+    if (isOpen()) {
+        close(i32(handle));
+        handle = -1;
+        size = 0;
+    }
+}
+
+core::expected<ReadOnlyFile, FileMappingError> openReadOnlyFile(const char* path) {
+    i32 fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return core::unexpected(FileMappingError::FailedToOpenFile);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return core::unexpected(FileMappingError::FailedToStatFile);
+    }
+
+    ReadOnlyFile ret;
+    ret.handle = fd;
+    ret.size = addr_size(st.st_size);
+    return ret;
+}
+
+core::expected<FileMappingError> readFileAt(const ReadOnlyFile& file, addr_size offset, void* dst, addr_size size) {
+    if (offset > file.size || size > file.size - offset) {
+        return core::unexpected(FileMappingError::FailedToReadFile);
+    }
+
+    u8* out = reinterpret_cast<u8*>(dst);
+    while (size > 0) {
+        ssize_t read = pread(i32(file.handle), out, size, off_t(offset));
+        if (read < 0 && errno == EINTR) continue;
+        if (read <= 0) {
+            return core::unexpected(FileMappingError::FailedToReadFile);
+        }
+
+        out += read;
+        offset += addr_size(read);
+        size -= addr_size(read);
+    }
+
+    return {};
+}
+
+
+void WriteOnlyFile::free() {
+    if (isOpen()) {
+        close(i32(handle));
+        handle = -1;
+    }
+}
+
+core::expected<WriteOnlyFile, FileMappingError> createWriteOnlyFile(const char* path) {
+    i32 fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return core::unexpected(FileMappingError::FailedToOpenFile);
+    }
+
+    WriteOnlyFile ret;
+    ret.handle = fd;
+    return ret;
+}
+
+core::expected<FileMappingError> writeFileGathered(const WriteOnlyFile& file, const FileWriteSpan* spans, i32 spansCount) {
+    // Well below IOV_MAX everywhere (1024 on Linux and macOS), and small enough for the stack.
+    constexpr i32 MAX_IOVECS = 64;
+    struct iovec iov[MAX_IOVECS];
+
+    i32 next = 0;
+    while (next < spansCount) {
+        i32 count = 0;
+        for (; next < spansCount && count < MAX_IOVECS; next++) {
+            if (spans[next].size == 0) continue;
+            iov[count].iov_base = const_cast<void*>(spans[next].data);
+            iov[count].iov_len = spans[next].size;
+            count++;
+        }
+
+        i32 first = 0;
+        while (first < count) {
+            ssize_t written = writev(i32(file.handle), iov + first, count - first);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                return core::unexpected(FileMappingError::FailedToWriteFile);
+            }
+
+            // Skip what was written; a short write can stop in the middle of a span.
+            addr_size left = addr_size(written);
+            while (first < count && left >= iov[first].iov_len) {
+                left -= iov[first].iov_len;
+                first++;
+            }
+            if (first < count) {
+                iov[first].iov_base = reinterpret_cast<u8*>(iov[first].iov_base) + left;
+                iov[first].iov_len -= left;
+            }
+        }
+    }
+
+    return {};
+}
+
+core::expected<FileMappingError> replaceFile(const char* srcPath, const char* dstPath) {
+    if (rename(srcPath, dstPath) != 0) {
+        return core::unexpected(FileMappingError::FailedToReplaceFile);
+    }
+    return {};
+}
+
+core::expected<FileMappingError> removeFile(const char* path) {
+    if (unlink(path) != 0) {
+        return core::unexpected(FileMappingError::FailedToRemoveFile);
+    }
+    return {};
+}
+
+u32 currentProcessId() {
+    return u32(getpid());
+}
+
+#endif
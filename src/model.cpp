@@ -1,9 +1,21 @@
 #include "model.h"
 
 void Model3D::free() {
-    if (actx) {
+    if (mapping.isMapped()) {
+        mapping.free();
+    }
+    else if (actx) {
         core::memoryFree(std::move(vertices), *actx);
+        core::memoryFree(std::move(streams.x), *actx);
+        core::memoryFree(std::move(streams.y), *actx);
+        core::memoryFree(std::move(streams.z), *actx);
+        core::memoryFree(std::move(streams.w), *actx);
+        core::memoryFree(std::move(streams.normals), *actx);
+        core::memoryFree(std::move(streams.textureCoords), *actx);
+        core::memoryFree(std::move(positions), *actx);
         core::memoryFree(std::move(faces), *actx);
+        core::memoryFree(std::move(submeshes), *actx);
+        core::memoryFree(std::move(submeshNames), *actx);
     }
 
     *this = {};
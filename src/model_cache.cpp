@@ -0,0 +1,349 @@
+#include "model_cache.h"
+#include "log_utils.h"
+
+static_assert(sizeof(Model3D::Vertex) == 36);
+static_assert(sizeof(core::vec4f) == 16);
+static_assert(sizeof(Model3D::Face) == 12);
+static_assert(sizeof(Model3D::Submesh) == 40);
+
+namespace {
+
+constexpr u8 ZERO_PADDING[MODEL_CACHE_BLOCK_ALIGNMENT] = {};
+
+[[nodiscard]] constexpr u64 alignUp(u64 x, u64 alignment) { return (x + alignment - 1) / alignment * alignment; }
+
+// Size of one element of the vertex block, zero for layouts that can not be cached.
+[[nodiscard]] constexpr u32 cachedVertexSize(VertexLayout layout) {
+    switch (layout) {
+        case VertexLayout::Interleaved: return u32(sizeof(Model3D::Vertex));
+        case VertexLayout::Positions:   return u32(sizeof(core::vec4f));
+        case VertexLayout::Separate:    return 0;
+    }
+    return 0;
+}
+
+constexpr i32 BLOCKS_COUNT = 4; // Vertices, faces, submeshes and names.
+
+[[nodiscard]] u64 computeChecksum(const ModelCacheHeader& header, const FileWriteSpan (&blocks)[BLOCKS_COUNT]);
+[[nodiscard]] u64 hashBytes(const void* data, addr_size len, u64 seed);
+
+} // namespace
+
+const char* errorToCstr(ModelCacheError err) {
+    switch (err) {
+        case ModelCacheError::FailedToOpenFile:   return "Failed to open file";
+        case ModelCacheError::FailedToStatFile:   return "Failed to stat file";
+        case ModelCacheError::FailedToReadFile:   return "Failed to read file";
+        case ModelCacheError::FailedToWriteFile:  return "Failed to write file";
+        case ModelCacheError::InvalidFileFormat:  return "Invalid model cache file";
+        case ModelCacheError::UnsupportedVersion: return "Unsupported model cache version";
+        case ModelCacheError::ChecksumMismatch:   return "Model cache checksum mismatch";
+        case ModelCacheError::StaleCache:         return "Model cache is older than its source";
+
+        case ModelCacheError::Undefined: [[fallthrough]];
+        case ModelCacheError::SENTINEL:  [[fallthrough]];
+        default:                         return "unknown";
+    }
+}
+
+core::expected<ModelCacheSource, ModelCacheError> modelCacheSourceFor(const char* sourcePath) {
+    auto statRes = statFile(sourcePath);
+    if (statRes.hasErr()) {
+        return core::unexpected(ModelCacheError::FailedToStatFile);
+    }
+
+    ModelCacheSource ret;
+    ret.pathHash = hashBytes(sourcePath, core::cstrLen(sourcePath), 0);
+    ret.size = u64(statRes.value().size);
+    ret.modifiedTimeNs = statRes.value().modifiedTimeNs;
+    return ret;
+}
+
+core::expected<ModelCacheError> writeModelCache(const Model3D& model, const char* cachePath,
+                                                const ModelCacheSource& source) {
+    const u32 vertexSize = cachedVertexSize(model.layout);
+    Assert(vertexSize > 0, "models with separate vertex streams can not be cached");
+
+    const void* vertices = model.layout == VertexLayout::Interleaved
+        ? static_cast<const void*>(model.vertices.data())
+        : static_cast<const void*>(model.positions.data());
+    const FileWriteSpan blocks[BLOCKS_COUNT] = {
+        { vertices, model.verticesCount() * vertexSize },
+        { model.faces.data(), model.faces.len() * sizeof(Model3D::Face) },
+        { model.submeshes.data(), model.submeshes.len() * sizeof(Model3D::Submesh) },
+        { model.submeshNames.data(), model.submeshNames.len() },
+    };
+
+    ModelCacheHeader header = {};
+    header.magic = MODEL_CACHE_MAGIC;
+    header.version = MODEL_CACHE_VERSION;
+    header.vertexLayout = u32(model.layout);
+    header.vertexSize = vertexSize;
+    header.source = source;
+    header.verticesOffset = alignUp(sizeof(ModelCacheHeader), MODEL_CACHE_BLOCK_ALIGNMENT);
+    header.verticesCount = model.verticesCount();
+    header.facesOffset = alignUp(header.verticesOffset + blocks[0].size, MODEL_CACHE_BLOCK_ALIGNMENT);
+    header.facesCount = model.faces.len();
+    header.submeshesOffset = alignUp(header.facesOffset + blocks[1].size, MODEL_CACHE_BLOCK_ALIGNMENT);
+    header.submeshesCount = model.submeshes.len();
+    header.namesOffset = header.submeshesOffset + blocks[2].size;
+    header.namesSize = model.submeshNames.len();
+    header.fileSize = header.namesOffset + blocks[3].size;
+    header.checksum = computeChecksum(header, blocks);
+
+    FileWriteSpan spans[8];
+    i32 spansCount = 0;
+    auto push = [&](const void* data, addr_size size) {
+        if (size > 0) spans[spansCount++] = { data, size };
+    };
+    push(&header, sizeof(header));
+    push(ZERO_PADDING, addr_size(header.verticesOffset) - sizeof(header));
+    push(blocks[0].data, blocks[0].size);
+    push(ZERO_PADDING, addr_size(header.facesOffset - header.verticesOffset) - blocks[0].size);
+    push(blocks[1].data, blocks[1].size);
+    push(ZERO_PADDING, addr_size(header.submeshesOffset - header.facesOffset) - blocks[1].size);
+    push(blocks[2].data, blocks[2].size);
+    push(blocks[3].data, blocks[3].size);
+
+    // Another process may have the current cache mapped, and truncating a mapped file makes its reads fault. The new
+    // cache is written next to it, as <cachePath>.tmp<process id in hex>, and renamed over it once complete.
+    constexpr char TEMP_SUFFIX[] = ".tmp";
+    constexpr addr_size PID_DIGITS = 8;
+    addr_size cachePathLen = core::cstrLen(cachePath);
+    addr_size tempPathLen = cachePathLen + sizeof(TEMP_SUFFIX) - 1 + PID_DIGITS + 1;
+    char* tempPath = reinterpret_cast<char*>(DEF_ALLOC.alloc(tempPathLen, sizeof(char)));
+    defer { DEF_ALLOC.free(tempPath, tempPathLen, sizeof(char)); };
+
+    core::memcopy(tempPath, cachePath, cachePathLen);
+    core::memcopy(tempPath + cachePathLen, TEMP_SUFFIX, sizeof(TEMP_SUFFIX) - 1);
+    u32 pid = currentProcessId();
+    for (addr_size i = 0; i < PID_DIGITS; i++) {
+        tempPath[cachePathLen + sizeof(TEMP_SUFFIX) - 1 + i] = "0123456789abcdef"[(pid >> (28 - 4 * i)) & 0xF];
+    }
+    tempPath[tempPathLen - 1] = '\0';
+
+    {
+        auto fileRes = createWriteOnlyFile(tempPath);
+        if (fileRes.hasErr()) {
+            logErr("Failed to create model cache: \"{}\"; reason: {}", tempPath, errorToCstr(fileRes.err()));
+            return core::unexpected(ModelCacheError::FailedToOpenFile);
+        }
+        WriteOnlyFile file = std::move(fileRes.value());
+        defer { file.free(); };
+
+        if (auto res = writeFileGathered(file, spans, spansCount); res.hasErr()) {
+            logErr("Failed to write model cache: \"{}\"; reason: {}", tempPath, errorToCstr(res.err()));
+            file.free();
+            [[maybe_unused]] auto removeRes = removeFile(tempPath);
+            return core::unexpected(ModelCacheError::FailedToWriteFile);
+        }
+    }
+
+    if (auto res = replaceFile(tempPath, cachePath); res.hasErr()) {
+        logErr("Failed to replace model cache: \"{}\"; reason: {}", cachePath, errorToCstr(res.err()));
+        [[maybe_unused]] auto removeRes = removeFile(tempPath);
+        return core::unexpected(ModelCacheError::FailedToWriteFile);
+    }
+
+    return {};
+}
+
+core::expected<Model3D, ModelCacheError> loadModelCache(const char* cachePath, const ModelCacheSource* expectedSource) {
+    auto mapRes = mapFile(cachePath, MappingAccessHint::Sequential);
+    if (mapRes.hasErr()) {
+        switch (mapRes.err()) {
+            case FileMappingError::FailedToOpenFile: return core::unexpected(ModelCacheError::FailedToOpenFile);
+            case FileMappingError::FailedToStatFile: return core::unexpected(ModelCacheError::FailedToStatFile);
+            case FileMappingError::EmptyFile:        return core::unexpected(ModelCacheError::InvalidFileFormat);
+            default:                                 return core::unexpected(ModelCacheError::FailedToReadFile);
+        }
+    }
+
+    Model3D model = {};
+    model.mapping = std::move(mapRes.value());
+    u8* data = model.mapping.memory.data();
+    u64 fileSize = model.mapping.memory.len();
+
+    auto fail = [&model](ModelCacheError err) {
+        model.free();
+        return core::unexpected(err);
+    };
+
+    ModelCacheHeader header;
+    if (fileSize < sizeof(header)) {
+        return fail(ModelCacheError::InvalidFileFormat);
+    }
+    core::memcopy(reinterpret_cast<u8*>(&header), data, sizeof(header));
+
+    if (header.magic != MODEL_CACHE_MAGIC) {
+        return fail(ModelCacheError::InvalidFileFormat);
+    }
+    if (header.version != MODEL_CACHE_VERSION) {
+        return fail(ModelCacheError::UnsupportedVersion);
+    }
+
+    // The size of layouts that are never cached is zero, so it can not match theirs.
+    bool vertexLayoutIsValid =
+        header.vertexLayout <= u32(VertexLayout::Positions) &&
+        header.vertexSize != 0 &&
+        header.vertexSize == cachedVertexSize(VertexLayout(header.vertexLayout));
+    if (!vertexLayoutIsValid) {
+        return fail(ModelCacheError::InvalidFileFormat);
+    }
+    const VertexLayout layout = VertexLayout(header.vertexLayout);
+    const u32 vertexSize = header.vertexSize;
+
+    // The blocks have to be aligned, in order and inside the file. Dividing instead of multiplying the counts keeps
+    // a corrupted count from overflowing.
+    bool layoutIsValid =
+        header.fileSize == fileSize &&
+        header.verticesOffset % MODEL_CACHE_BLOCK_ALIGNMENT == 0 &&
+        header.facesOffset % MODEL_CACHE_BLOCK_ALIGNMENT == 0 &&
+        header.submeshesOffset % MODEL_CACHE_BLOCK_ALIGNMENT == 0 &&
+        header.verticesOffset >= sizeof(header) &&
+        header.verticesOffset <= header.facesOffset &&
+        header.facesOffset <= header.submeshesOffset &&
+        header.submeshesOffset <= header.namesOffset &&
+        header.namesOffset <= fileSize &&
+        header.verticesCount <= (header.facesOffset - header.verticesOffset) / vertexSize &&
+        header.facesCount <= (header.submeshesOffset - header.facesOffset) / sizeof(Model3D::Face) &&
+        header.submeshesCount == (header.namesOffset - header.submeshesOffset) / sizeof(Model3D::Submesh) &&
+        (header.namesOffset - header.submeshesOffset) % sizeof(Model3D::Submesh) == 0 &&
+        header.namesSize == fileSize - header.namesOffset;
+    if (!layoutIsValid) {
+        return fail(ModelCacheError::InvalidFileFormat);
+    }
+
+    if (expectedSource) {
+        bool sameSource =
+            header.source.pathHash == expectedSource->pathHash &&
+            header.source.size == expectedSource->size &&
+            header.source.modifiedTimeNs == expectedSource->modifiedTimeNs;
+        if (!sameSource) {
+            return fail(ModelCacheError::StaleCache);
+        }
+    }
+
+    u8* vertices = data + header.verticesOffset;
+    u8* faces = data + header.facesOffset;
+    u8* submeshes = data + header.submeshesOffset;
+    u8* names = data + header.namesOffset;
+    const FileWriteSpan blocks[BLOCKS_COUNT] = {
+        { vertices, addr_size(header.verticesCount) * vertexSize },
+        { faces, addr_size(header.facesCount) * sizeof(Model3D::Face) },
+        { submeshes, addr_size(header.submeshesCount) * sizeof(Model3D::Submesh) },
+        { names, addr_size(header.namesSize) },
+    };
+
+    if (computeChecksum(header, blocks) != header.checksum) {
+        return fail(ModelCacheError::ChecksumMismatch);
+    }
+
+    model.actx = nullptr;
+    model.layout = layout;
+    if (layout == VertexLayout::Interleaved) {
+        model.vertices.ptr = reinterpret_cast<Model3D::Vertex*>(vertices);
+        model.vertices.length = addr_size(header.verticesCount);
+    }
+    else {
+        model.positions.ptr = reinterpret_cast<core::vec4f*>(vertices);
+        model.positions.length = addr_size(header.verticesCount);
+    }
+    model.faces.ptr = reinterpret_cast<Model3D::Face*>(faces);
+    model.faces.length = addr_size(header.facesCount);
+    model.submeshes.ptr = reinterpret_cast<Model3D::Submesh*>(submeshes);
+    model.submeshes.length = addr_size(header.submeshesCount);
+    model.submeshNames.ptr = reinterpret_cast<char*>(names);
+    model.submeshNames.length = addr_size(header.namesSize);
+
+    // The submeshes are read straight from the mapping, so their ranges are checked like the rest of the layout.
+    for (addr_size i = 0; i < model.submeshes.len(); i++) {
+        const Model3D::Submesh& s = model.submeshes[i];
+        bool submeshIsValid =
+            s.firstFace >= 0 && s.facesCount >= 0 && u64(s.firstFace) + u64(s.facesCount) <= header.facesCount &&
+            s.nameOffset >= 0 && s.nameLength >= 0 && u64(s.nameOffset) + u64(s.nameLength) <= header.namesSize;
+        if (!submeshIsValid) {
+            return fail(ModelCacheError::InvalidFileFormat);
+        }
+    }
+
+    // The checksum only catches accidental damage, and a file that still matches it can come from a different writer.
+    // Renderers index the vertices with the faces unchecked, so every index is checked here. Negative indices wrap
+    // to large unsigned values.
+    for (addr_size i = 0; i < model.faces.len(); i++) {
+        const Model3D::Face& f = model.faces[i];
+        if (u64(u32(f[0])) >= header.verticesCount ||
+            u64(u32(f[1])) >= header.verticesCount ||
+            u64(u32(f[2])) >= header.verticesCount) {
+            return fail(ModelCacheError::InvalidFileFormat);
+        }
+    }
+
+    return model;
+}
+
+namespace {
+
+u64 computeChecksum(const ModelCacheHeader& header, const FileWriteSpan (&blocks)[BLOCKS_COUNT]) {
+    // The checksum field itself is hashed as zero.
+    ModelCacheHeader h = header;
+    h.checksum = 0;
+    u64 ret = hashBytes(&h, sizeof(h), 0);
+    for (const FileWriteSpan& block : blocks) {
+        ret = hashBytes(block.data, block.size, ret);
+    }
+    return ret;
+}
+
+constexpr u64 HASH_PRIME_1 = 0x9E3779B185EBCA87;
+constexpr u64 HASH_PRIME_2 = 0xC2B2AE3D27D4EB4F;
+constexpr u64 HASH_PRIME_3 = 0x165667B19E3779F9;
+
+constexpr u64 rotl(u64 x, i32 r) { return (x << r) | (x >> (64 - r)); }
+constexpr u64 hashRound(u64 acc, u64 input) { return rotl(acc + input * HASH_PRIME_2, 31) * HASH_PRIME_1; }
+
+u64 loadU64(const u8* p) {
+    u64 ret;
+    core::memcopy(reinterpret_cast<u8*>(&ret), p, sizeof(ret));
+    return ret;
+}
+
+u64 hashBytes(const void* data, addr_size len, u64 seed) {
+    // xxHash64 style: four independent lanes over 32 byte stripes, so the loop runs at memory speed.
+    const u8* p = reinterpret_cast<const u8*>(data);
+    const u8* end = p + len;
+    u64 h;
+
+    if (len >= 32) {
+        u64 lanes[4] = { seed + HASH_PRIME_1 + HASH_PRIME_2, seed + HASH_PRIME_2, seed, seed - HASH_PRIME_1 };
+        for (; end - p >= 32; p += 32) {
+            lanes[0] = hashRound(lanes[0], loadU64(p));
+            lanes[1] = hashRound(lanes[1], loadU64(p + 8));
+            lanes[2] = hashRound(lanes[2], loadU64(p + 16));
+            lanes[3] = hashRound(lanes[3], loadU64(p + 24));
+        }
+        h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    }
+    else {
+        h = seed + HASH_PRIME_3;
+    }
+
+    h += u64(len);
+    for (; end - p >= 8; p += 8) {
+        h ^= hashRound(0, loadU64(p));
+        h = rotl(h, 27) * HASH_PRIME_1 + HASH_PRIME_3;
+    }
+    for (; p < end; p++) {
+        h ^= u64(*p) * HASH_PRIME_3;
+        h = rotl(h, 11) * HASH_PRIME_1;
+    }
+
+    h ^= h >> 33;
+    h *= HASH_PRIME_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace
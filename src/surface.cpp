@@ -1,7 +1,155 @@
 #include "surface.h"
+#include "simd_utils.h"
+
+namespace {
+
+template <i32 BPP> void reverseRowScalar(u8* row, i32 left, i32 right);
+void reverseRow_4(u8* row, i32 width);
+void reverseRow_3(u8* row, i32 width);
+#if SIMD_DISPATCH_ENABLED
+SIMD_TARGET_SSSE3 i32 reverseRowBlocks_3_SSSE3(u8* row, i32 width);
+#endif
+void reverseRow_2(u8* row, i32 width);
+
+} // namespace
 
 void Surface::free() {
-    if (isOwner() && data) {
-        actx->free(data, addr_size(size()), sizeof(u8));
+    if (isOwner() && adoptedMemory.data()) {
+        actx->free(adoptedMemory.data(), adoptedMemory.len(), sizeof(u8));
+    }
+    else if (isOwner() && data) {
+        actx->free(memoryBegin(), addr_size(size()), sizeof(u8));
+    }
+}
+
+void reversePixels(u8* row, i32 width, i32 bpp) {
+    switch (bpp) {
+        case 4: reverseRow_4(row, width); break;
+        case 3: reverseRow_3(row, width); break;
+        case 2: reverseRow_2(row, width); break;
+        default:
+            Assert(false, "invalid bytes-per-pixel");
+            break;
+    }
+}
+
+void flipSurfaceHorizontally(Surface& surface) {
+    Assert(surface.data != nullptr, "surface data is null");
+
+    for (i32 y = 0; y < surface.height; y++) {
+        reversePixels(surface.row(y), surface.width, surface.bpp());
+    }
+
+    surface.origin = originFlippedHorizontally(surface.origin);
+}
+
+namespace {
+
+template <i32 BPP>
+void reverseRowScalar(u8* row, i32 left, i32 right) {
+    // Swaps pixels in [left, right) end to end.
+    while (right - left > 1) {
+        u8* a = row + left * BPP;
+        u8* b = row + (right - 1) * BPP;
+        for (i32 i = 0; i < BPP; i++) {
+            core::swap(a[i], b[i]);
+        }
+        left++;
+        right--;
+    }
+}
+
+void reverseRow_4(u8* row, i32 width) {
+    i32 left = 0;
+    i32 right = width;
+
+#if SIMD_SSE2_ENABLED
+    // Swap 4 pixel blocks from both ends, reversing the pixel order inside each block.
+    while (right - left >= 8) {
+        u8* a = row + left * 4;
+        u8* b = row + (right - 4) * 4;
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+        va = _mm_shuffle_epi32(va, _MM_SHUFFLE(0, 1, 2, 3));
+        vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a), vb);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b), va);
+        left += 4;
+        right -= 4;
+    }
+#endif
+
+    reverseRowScalar<4>(row, left, right);
+}
+
+void reverseRow_2(u8* row, i32 width) {
+    i32 left = 0;
+    i32 right = width;
+
+#if SIMD_SSE2_ENABLED
+    auto reverse8x16 = [](__m128i v) -> __m128i {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    };
+
+    while (right - left >= 16) {
+        u8* a = row + left * 2;
+        u8* b = row + (right - 8) * 2;
+        __m128i va = reverse8x16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+        __m128i vb = reverse8x16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a), vb);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b), va);
+        left += 8;
+        right -= 8;
     }
+#endif
+
+    reverseRowScalar<2>(row, left, right);
 }
+
+void reverseRow_3(u8* row, i32 width) {
+    i32 left = 0;
+    i32 right = width;
+
+#if SIMD_DISPATCH_ENABLED
+    if (simdHasSsse3()) {
+        i32 done = reverseRowBlocks_3_SSSE3(row, width);
+        left += done;
+        right -= done;
+    }
+#endif
+
+    reverseRowScalar<3>(row, left, right);
+}
+
+#if SIMD_DISPATCH_ENABLED
+// Swaps blocks of 5 pixels (15 bytes) from both ends and returns how many pixels were swapped at each end. The blocks go
+// through a stack buffer so the 16 byte loads never read past the row.
+SIMD_TARGET_SSSE3 i32 reverseRowBlocks_3_SSSE3(u8* row, i32 width) {
+    i32 left = 0;
+    i32 right = width;
+
+    const __m128i reverse5x24 = _mm_setr_epi8(12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2, -1);
+    while (right - left >= 10) {
+        u8* a = row + left * 3;
+        u8* b = row + (right - 5) * 3;
+        alignas(16) u8 tmpA[16];
+        alignas(16) u8 tmpB[16];
+        core::memcopy(tmpA, a, 15);
+        core::memcopy(tmpB, b, 15);
+        __m128i va = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(tmpA)), reverse5x24);
+        __m128i vb = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(tmpB)), reverse5x24);
+        _mm_store_si128(reinterpret_cast<__m128i*>(tmpA), va);
+        _mm_store_si128(reinterpret_cast<__m128i*>(tmpB), vb);
+        core::memcopy(a, tmpB, 15);
+        core::memcopy(b, tmpA, 15);
+        left += 5;
+        right -= 5;
+    }
+
+    return left;
+}
+#endif
+
+} // namespace
@@ -0,0 +1,334 @@
+#include "surface_compare.h"
+#include "simd_utils.h"
+
+#include <cmath>
+
+namespace {
+
+struct RowStats {
+    i64 mismatchedPixels;
+    u64 sumSquares;
+    i32 maxDelta;
+    i32 firstX;
+    i32 lastX;
+};
+
+constexpr bool isVerticallyFlipped(Origin a, Origin b);
+constexpr bool isHorizontallyFlipped(Origin a, Origin b);
+constexpr i32 channelsCompared(PixelFormat pixelFormat);
+
+bool rowsEqual(const u8* a, const u8* b, i32 width, PixelFormat pixelFormat);
+void rowStats_4(const u8* a, const u8* b, i32 width, u32 pixelMask, RowStats& stats);
+void rowStats_3(const u8* a, const u8* b, i32 width, RowStats& stats);
+void expandRow_1555(const u8* src, u8* dst, i32 width, bool hasAlpha);
+
+} // namespace
+
+const char* errorToCstr(SurfaceCompareError err) {
+    switch (err) {
+        case SurfaceCompareError::SizeMismatch:        return "Surface sizes differ";
+        case SurfaceCompareError::PixelFormatMismatch: return "Surface pixel formats differ";
+        case SurfaceCompareError::UnsupportedOrigin:   return "Unsupported surface origin";
+
+        case SurfaceCompareError::Undefined: [[fallthrough]];
+        case SurfaceCompareError::SENTINEL:  [[fallthrough]];
+        default:                             return "unknown";
+    }
+}
+
+core::expected<SurfaceDiff, SurfaceCompareError> compareSurfaces(
+    const Surface& a,
+    const Surface& b,
+    CompareMode mode,
+    core::AllocatorContext& actx
+) {
+    Assert(a.data != nullptr && b.data != nullptr, "surface data is null");
+
+    if (a.width != b.width || a.height != b.height) {
+        return core::unexpected(SurfaceCompareError::SizeMismatch);
+    }
+    if (a.pixelFormat != b.pixelFormat) {
+        return core::unexpected(SurfaceCompareError::PixelFormatMismatch);
+    }
+
+    bool flipX = false;
+    Surface bView = b.view();
+    if (a.origin != b.origin) {
+        auto isCorner = [](Origin o) {
+            return o == Origin::BottomLeft || o == Origin::BottomRight || o == Origin::TopLeft || o == Origin::TopRight;
+        };
+        if (!isCorner(a.origin) || !isCorner(b.origin)) {
+            return core::unexpected(SurfaceCompareError::UnsupportedOrigin);
+        }
+
+        if (isVerticallyFlipped(a.origin, b.origin)) {
+            bView = bView.flippedVertically();
+        }
+        flipX = isHorizontallyFlipped(a.origin, b.origin);
+    }
+
+    const PixelFormat pixelFormat = a.pixelFormat;
+    const i32 width = a.width;
+    const i32 bpp = a.bpp();
+    const bool is16Bit = bpp == 2;
+
+    // Scratch rows: the mirrored row of b and the 16 bit rows expanded to BGRA8888.
+    core::Memory<u8> scratch;
+    u8* reversedRow = nullptr;
+    u8* expandedA = nullptr;
+    u8* expandedB = nullptr;
+    {
+        addr_size rawRowSize = flipX ? addr_size(width * bpp) : 0;
+        addr_size expandedRowSize = (is16Bit && mode == CompareMode::Full) ? addr_size(width * 4) : 0;
+        addr_size scratchSize = rawRowSize + 2 * expandedRowSize;
+        if (scratchSize > 0) {
+            scratch = core::memoryZeroAllocate<u8>(scratchSize, actx);
+            if (rawRowSize > 0) reversedRow = scratch.data();
+            if (expandedRowSize > 0) {
+                expandedA = scratch.data() + rawRowSize;
+                expandedB = expandedA + expandedRowSize;
+            }
+        }
+    }
+    defer {
+        if (scratch.data()) core::memoryFree(std::move(scratch), actx);
+    };
+
+    SurfaceDiff diff;
+    u64 sumSquares = 0;
+
+    for (i32 y = 0; y < a.height; y++) {
+        const u8* rowA = a.row(y);
+        const u8* rowB = bView.row(y);
+
+        if (flipX) {
+            core::memcopy(reversedRow, rowB, addr_size(width * bpp));
+            reversePixels(reversedRow, width, bpp);
+            rowB = reversedRow;
+        }
+
+        if (rowsEqual(rowA, rowB, width, pixelFormat)) {
+            continue;
+        }
+
+        diff.equal = false;
+        if (mode == CompareMode::ExactOnly) {
+            return diff;
+        }
+
+        RowStats stats = {};
+        stats.firstX = -1;
+        switch (pixelFormat) {
+            case PixelFormat::BGRA8888: rowStats_4(rowA, rowB, width, 0xFFFFFFFF, stats); break;
+            case PixelFormat::BGRX8888: rowStats_4(rowA, rowB, width, 0x00FFFFFF, stats); break;
+            case PixelFormat::BGR888:   rowStats_3(rowA, rowB, width, stats);             break;
+
+            case PixelFormat::BGRA5551: [[fallthrough]];
+            case PixelFormat::BGR555: {
+                bool hasAlpha = pixelFormat == PixelFormat::BGRA5551;
+                expandRow_1555(rowA, expandedA, width, hasAlpha);
+                expandRow_1555(rowB, expandedB, width, hasAlpha);
+                rowStats_4(expandedA, expandedB, width, 0xFFFFFFFF, stats);
+                break;
+            }
+
+            case PixelFormat::Unknown:  [[fallthrough]];
+            case PixelFormat::SENTINEL: [[fallthrough]];
+            default:
+                Assert(false, "invalid pixel format");
+                break;
+        }
+
+        if (stats.mismatchedPixels > 0) {
+            if (diff.maxY < 0) {
+                diff.minX = stats.firstX;
+                diff.maxX = stats.lastX;
+                diff.minY = y;
+            }
+            diff.minX = core::core_min(diff.minX, stats.firstX);
+            diff.maxX = core::core_max(diff.maxX, stats.lastX);
+            diff.maxY = y;
+        }
+
+        diff.mismatchedPixels += stats.mismatchedPixels;
+        diff.maxChannelDelta = core::core_max(diff.maxChannelDelta, stats.maxDelta);
+        sumSquares += stats.sumSquares;
+    }
+
+    if (diff.equal) {
+        diff.psnr = f64(INFINITY);
+    }
+    else {
+        f64 samples = f64(a.width) * f64(a.height) * f64(channelsCompared(pixelFormat));
+        f64 mse = f64(sumSquares) / samples;
+        diff.psnr = 10.0 * std::log10((255.0 * 255.0) / mse);
+    }
+
+    return diff;
+}
+
+namespace {
+
+constexpr bool isVerticallyFlipped(Origin a, Origin b) {
+    auto isTop = [](Origin o) { return o == Origin::TopLeft || o == Origin::TopRight; };
+    return isTop(a) != isTop(b);
+}
+
+constexpr bool isHorizontallyFlipped(Origin a, Origin b) {
+    auto isRight = [](Origin o) { return o == Origin::BottomRight || o == Origin::TopRight; };
+    return isRight(a) != isRight(b);
+}
+
+constexpr i32 channelsCompared(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case PixelFormat::BGRA8888: return 4;
+        case PixelFormat::BGRX8888: return 3;
+        case PixelFormat::BGRA5551: return 4;
+        case PixelFormat::BGR555:   return 3;
+        case PixelFormat::BGR888:   return 3;
+
+        case PixelFormat::Unknown: [[fallthrough]];
+        case PixelFormat::SENTINEL: [[fallthrough]];
+        default:
+            Assert(false, "invalid pixel format");
+            return 1;
+    }
+}
+
+bool rowsEqual(const u8* a, const u8* b, i32 width, PixelFormat pixelFormat) {
+    // Byte mask of the bits that take part in the comparison, repeating every 4 bytes.
+    u32 mask = 0xFFFFFFFF;
+    if (pixelFormat == PixelFormat::BGRX8888) mask = 0x00FFFFFF;
+    if (pixelFormat == PixelFormat::BGR555)   mask = 0x7FFF7FFF;
+
+    const i32 n = width * pixelFormatBytesPerPixel(pixelFormat);
+    i32 i = 0;
+
+#if SIMD_SSE2_ENABLED
+    // 64 bytes per iteration; the OR of the XORs is zero only when every compared bit matches.
+    const __m128i vmask = _mm_set1_epi32(i32(mask));
+    for (; i + 64 <= n; i += 64) {
+        __m128i x0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        __m128i x1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16)));
+        __m128i x2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 32)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 32)));
+        __m128i x3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 48)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 48)));
+        __m128i any = _mm_and_si128(_mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3)), vmask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        x = _mm_and_si128(x, vmask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+
+    // i is a multiple of 4 here, so the mask lines up with the pixel bytes.
+    for (; i < n; i++) {
+        u8 byteMask = u8(mask >> ((i % 4) * 8));
+        if ((a[i] ^ b[i]) & byteMask) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void rowStats_4(const u8* a, const u8* b, i32 width, u32 pixelMask, RowStats& stats) {
+    i32 x = 0;
+
+    auto markMismatch = [&stats](i32 px) {
+        if (stats.firstX < 0) stats.firstX = px;
+        stats.lastX = px;
+        stats.mismatchedPixels++;
+    };
+
+#if SIMD_SSE2_ENABLED
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vmask = _mm_set1_epi32(i32(pixelMask));
+    __m128i vmax = zero;
+    __m128i vsq = zero; // 4 x u32; a row of up to 65535 pixels can not overflow it.
+
+    for (; x + 4 <= width; x += 4) {
+        __m128i va = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x * 4)), vmask);
+        __m128i vb = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x * 4)), vmask);
+
+        i32 eqMask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(va, vb)));
+        if (eqMask == 0xF) continue;
+
+        for (i32 lane = 0; lane < 4; lane++) {
+            if (!(eqMask & (1 << lane))) markMismatch(x + lane);
+        }
+
+        __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        vmax = _mm_max_epu8(vmax, d);
+        __m128i lo = _mm_unpacklo_epi8(d, zero);
+        __m128i hi = _mm_unpackhi_epi8(d, zero);
+        vsq = _mm_add_epi32(vsq, _mm_madd_epi16(lo, lo));
+        vsq = _mm_add_epi32(vsq, _mm_madd_epi16(hi, hi));
+    }
+
+    alignas(16) u8 maxBytes[16];
+    alignas(16) u32 sqLanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(maxBytes), vmax);
+    _mm_store_si128(reinterpret_cast<__m128i*>(sqLanes), vsq);
+    for (u8 m : maxBytes) stats.maxDelta = core::core_max(stats.maxDelta, i32(m));
+    for (u32 sq : sqLanes) stats.sumSquares += sq;
+#endif
+
+    for (; x < width; x++) {
+        bool mismatch = false;
+        for (i32 c = 0; c < 4; c++) {
+            if (!((pixelMask >> (c * 8)) & 0xFF)) continue;
+            i32 d = core::absGeneric(i32(a[x * 4 + c]) - i32(b[x * 4 + c]));
+            if (d != 0) {
+                mismatch = true;
+                stats.maxDelta = core::core_max(stats.maxDelta, d);
+                stats.sumSquares += u64(d * d);
+            }
+        }
+        if (mismatch) markMismatch(x);
+    }
+}
+
+void rowStats_3(const u8* a, const u8* b, i32 width, RowStats& stats) {
+    for (i32 x = 0; x < width; x++) {
+        bool mismatch = false;
+        for (i32 c = 0; c < 3; c++) {
+            i32 d = core::absGeneric(i32(a[x * 3 + c]) - i32(b[x * 3 + c]));
+            if (d != 0) {
+                mismatch = true;
+                stats.maxDelta = core::core_max(stats.maxDelta, d);
+                stats.sumSquares += u64(d * d);
+            }
+        }
+        if (mismatch) {
+            if (stats.firstX < 0) stats.firstX = x;
+            stats.lastX = x;
+            stats.mismatchedPixels++;
+        }
+    }
+}
+
+void expandRow_1555(const u8* src, u8* dst, i32 width, bool hasAlpha) {
+    for (i32 x = 0; x < width; x++) {
+        u32 v = u32(src[x * 2] | (src[x * 2 + 1] << 8));
+        u32 b = v & 0x1F;
+        u32 g = (v >> 5) & 0x1F;
+        u32 r = (v >> 10) & 0x1F;
+        dst[x * 4 + 0] = u8((b << 3) | (b >> 2));
+        dst[x * 4 + 1] = u8((g << 3) | (g >> 2));
+        dst[x * 4 + 2] = u8((r << 3) | (r >> 2));
+        dst[x * 4 + 3] = hasAlpha && (v >> 15) ? u8(255) : u8(0);
+    }
+}
+
+} // namespace
@@ -0,0 +1,207 @@
+#include "surface_pool.h"
+#include "surface_renderer.h"
+
+namespace {
+
+void freeEntry(SurfacePool& pool, SurfacePool::Entry& e);
+bool evictLeastRecentlyUsed(SurfacePool& pool);
+
+} // namespace
+
+const char* errorToCstr(SurfacePoolError err) {
+    switch (err) {
+        case SurfacePoolError::InvalidArgument:      return "Invalid argument passed";
+        case SurfacePoolError::MemoryCeilingReached: return "Surface pool memory ceiling reached";
+        case SurfacePoolError::NoFreeSlots:          return "Surface pool has no free slots";
+        case SurfacePoolError::NotFromThisPool:      return "Surface was not acquired from this pool";
+        case SurfacePoolError::AllocationFailed:     return "Surface pool failed to allocate a buffer";
+
+        case SurfacePoolError::Undefined: [[fallthrough]];
+        case SurfacePoolError::SENTINEL:  [[fallthrough]];
+        default:                          return "unknown";
+    }
+}
+
+SurfacePool createSurfacePool(const SurfacePoolCreateInfo& info, core::AllocatorContext& actx) {
+    Assert(info.maxSurfaces > 0, "surface pool needs at least one slot");
+
+    SurfacePool pool;
+    pool.actx = &actx;
+    pool.entries = core::memoryZeroAllocate<SurfacePool::Entry>(addr_size(info.maxSurfaces), actx);
+    pool.memoryCeiling = info.memoryCeiling;
+    return pool;
+}
+
+core::expected<Surface, SurfacePoolError> SurfacePool::acquire(i32 width, i32 height, PixelFormat pixelFormat,
+                                                               Origin origin, SurfaceClear clear,
+                                                               const Color* clearColor) {
+    if (width <= 0 || height <= 0 || pixelFormat == PixelFormat::Unknown || pixelFormat == PixelFormat::SENTINEL) {
+        return core::unexpected(SurfacePoolError::InvalidArgument);
+    }
+    if (clear == SurfaceClear::Fill && clearColor == nullptr) {
+        return core::unexpected(SurfacePoolError::InvalidArgument);
+    }
+
+    i32 pitch = width * pixelFormatBytesPerPixel(pixelFormat);
+    addr_size size = addr_size(pitch) * addr_size(height);
+
+    // Look for an idle buffer with the same key.
+    Entry* entry = nullptr;
+    for (addr_size i = 0; i < entries.len(); i++) {
+        Entry& e = entries[i];
+        if (e.memory.data() && !e.leased &&
+            e.width == width && e.height == height && e.pixelFormat == pixelFormat) {
+            entry = &e;
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (size > memoryCeiling) {
+            return core::unexpected(SurfacePoolError::MemoryCeilingReached);
+        }
+
+        // Make room, both in memory and in slots, by evicting idle buffers.
+        while (memoryInUse + size > memoryCeiling) {
+            if (!evictLeastRecentlyUsed(*this)) {
+                return core::unexpected(SurfacePoolError::MemoryCeilingReached);
+            }
+        }
+
+        auto findEmptySlot = [this]() -> Entry* {
+            for (addr_size i = 0; i < entries.len(); i++) {
+                if (!entries[i].memory.data()) return &entries[i];
+            }
+            return nullptr;
+        };
+
+        entry = findEmptySlot();
+        if (!entry) {
+            if (!evictLeastRecentlyUsed(*this)) {
+                return core::unexpected(SurfacePoolError::NoFreeSlots);
+            }
+            entry = findEmptySlot();
+        }
+        Assert(entry != nullptr, "BUG: eviction did not free a slot");
+
+        core::Memory<u8> memory = core::memoryZeroAllocate<u8>(size, *actx);
+        if (!memory.data()) {
+            return core::unexpected(SurfacePoolError::AllocationFailed);
+        }
+
+        entry->memory = std::move(memory);
+        entry->pixelFormat = pixelFormat;
+        entry->width = width;
+        entry->height = height;
+        entry->zeroed = true;
+        memoryInUse += size;
+    }
+
+    entry->leased = true;
+    entry->lastUsed = ++tick;
+
+    Surface surface = Surface();
+    surface.actx = nullptr; // the pool owns the memory
+    surface.origin = origin;
+    surface.pixelFormat = pixelFormat;
+    surface.width = width;
+    surface.height = height;
+    surface.pitch = pitch;
+    surface.data = entry->memory.data();
+
+    switch (clear) {
+        case SurfaceClear::None:
+            break;
+        case SurfaceClear::Zero:
+            if (!entry->zeroed) {
+                core::memset(surface.data, u8(0), size);
+            }
+            break;
+        case SurfaceClear::Fill:
+            fillRect(surface, 0, 0, *clearColor, width, height);
+            break;
+    }
+
+    // Once handed out the buffer can be written to, so it must be cleared again next time.
+    entry->zeroed = false;
+
+    return surface;
+}
+
+core::expected<SurfacePoolError> SurfacePool::release(Surface& surface) {
+    for (addr_size i = 0; i < entries.len(); i++) {
+        Entry& e = entries[i];
+        if (e.leased && e.memory.data() == surface.memoryBegin()) {
+            e.leased = false;
+            e.lastUsed = ++tick;
+            surface = Surface();
+            return {};
+        }
+    }
+
+    return core::unexpected(SurfacePoolError::NotFromThisPool);
+}
+
+void SurfacePool::trim() {
+    for (addr_size i = 0; i < entries.len(); i++) {
+        Entry& e = entries[i];
+        if (e.memory.data() && !e.leased) {
+            freeEntry(*this, e);
+        }
+    }
+}
+
+void SurfacePool::free() {
+    if (actx) {
+        for (addr_size i = 0; i < entries.len(); i++) {
+            Entry& e = entries[i];
+            Assert(!e.leased, "surface pool freed while a surface is still leased");
+            if (e.memory.data()) {
+                freeEntry(*this, e);
+            }
+        }
+        core::memoryFree(std::move(entries), *actx);
+    }
+
+    *this = {};
+}
+
+i32 SurfacePool::idleCount() const {
+    i32 count = 0;
+    for (addr_size i = 0; i < entries.len(); i++) {
+        if (entries[i].memory.data() && !entries[i].leased) count++;
+    }
+    return count;
+}
+
+i32 SurfacePool::leasedCount() const {
+    i32 count = 0;
+    for (addr_size i = 0; i < entries.len(); i++) {
+        if (entries[i].leased) count++;
+    }
+    return count;
+}
+
+namespace {
+
+void freeEntry(SurfacePool& pool, SurfacePool::Entry& e) {
+    pool.memoryInUse -= e.memory.len();
+    core::memoryFree(std::move(e.memory), *pool.actx);
+    e = {};
+}
+
+bool evictLeastRecentlyUsed(SurfacePool& pool) {
+    SurfacePool::Entry* victim = nullptr;
+    for (addr_size i = 0; i < pool.entries.len(); i++) {
+        SurfacePool::Entry& e = pool.entries[i];
+        if (e.memory.data() && !e.leased && (!victim || e.lastUsed < victim->lastUsed)) {
+            victim = &e;
+        }
+    }
+
+    if (!victim) return false;
+    freeEntry(pool, *victim);
+    return true;
+}
+
+} // namespace
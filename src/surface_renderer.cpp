@@ -1,11 +1,43 @@
 #include "surface_renderer.h"
 #include "surface.h"
 #include "model.h"
+#include "simd_utils.h"
 
 namespace {
 
 using SetPixelFn = void (*)(u8* data, i32 idx, Color color);
 
+// Per channel constants for the source-over equation, in BGRA order:
+//   out = round((terms - 128 + dst * invAlpha) / 255)
+// For straight alpha terms = src * alpha + 128 (alpha: 255 * alpha + 128), for premultiplied alpha terms = src * 255 +
+// 128. Both fit in 16 bits, which is what the SIMD kernels rely on.
+//
+// The straight alpha form is only right for an opaque destination. Pixels whose alpha is not 255 go through
+// blendStraightOver instead, when dstAlphaMatters is set.
+struct BlendTerms {
+    u16 terms[4];
+    u16 invAlpha;
+    u8 color[4];          // Straight source color in BGRA order.
+    bool dstAlphaMatters; // Straight alpha with a source alpha other than 0 and 255.
+};
+
+using BlendSpanFn = void (*)(u8* row, i32 x, i32 count, const BlendTerms& bt);
+
+constexpr inline BlendTerms makeBlendTerms(Color color, BlendMode mode);
+constexpr inline u8 blendChannel(u16 term, u8 dst, u16 invAlpha);
+constexpr inline void blendStraightOver(const BlendTerms& bt, u8* bgra);
+constexpr inline void blendPixel_BGRA8888(u8* p, const BlendTerms& bt);
+constexpr inline void blendPixel_BGRA5551(u8* p, const BlendTerms& bt);
+
+void blendSpan_BGRA8888(u8* row, i32 x, i32 count, const BlendTerms& bt);
+void blendSpan_BGRA5551(u8* row, i32 x, i32 count, const BlendTerms& bt);
+
+constexpr inline BlendSpanFn pickBlendSpanFunction(PixelFormat pixelFormat);
+
+template <typename PlotFn> void rasterizeLine(const Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, PlotFn&& plot);
+template <typename SpanFn>
+void rasterizeTriangle(i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, i32 rowBegin, i32 rowEnd, SpanFn&& span);
+
 constexpr inline void setPixelTopLeft_BGRA8888(u8* data, i32 idx, Color color);
 constexpr inline void setPixelTopLeft_BGR888(u8* data, i32 idx, Color color);
 constexpr inline void setPixelTopLeft_BGRA5551(u8* data, i32 idx, Color color);
@@ -13,18 +45,19 @@ constexpr inline void setPixelTopLeft_BGR555(u8* data, i32 idx, Color color);
 
 constexpr inline SetPixelFn pickSetPixelFunction(PixelFormat pixelFormat);
 
+constexpr inline Color faceColor(addr_size faceIdx);
+
+inline core::vec2i orthogonalProjection(const core::vec4f& normVec, i32 width, i32 height);
+
 } // namespace
 
 void fillPixel(Surface& surface, i32 x, i32 y, Color color) {
-    i32 idx = y * surface.pitch + x * surface.bpp();
-
     Assert(surface.data != nullptr, "surface data is null");
     Assert(y >= 0 && y < surface.height, "y out of bounds");
     Assert(x >= 0 && x < surface.width, "x out of bounds");
-    Assert(idx + surface.bpp() <= surface.size(), "pixel write past end of surface");
 
     SetPixelFn setPixelFn = pickSetPixelFunction(surface.pixelFormat);
-    setPixelFn(surface.data, idx, color);
+    setPixelFn(surface.row(y), x * surface.bpp(), color);
 }
 
 void fillRect(Surface& surface, i32 x, i32 y, Color color, i32 width, i32 height) {
@@ -36,138 +69,235 @@ void fillRect(Surface& surface, i32 x, i32 y, Color color, i32 width, i32 height
 
     SetPixelFn setPixelFn = pickSetPixelFunction(surface.pixelFormat);
     for (i32 row = y; row < y + height; row++) {
+        u8* rowData = surface.row(row);
         for (i32 col = x; col < x + width; col++) {
-            i32 idx = row * surface.pitch + col * surface.bpp();
-            setPixelFn(surface.data, idx, color);
+            setPixelFn(rowData, col * surface.bpp(), color);
         }
     }
 }
 
 void fillLine(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, Color color) {
-    Assert(surface.data != nullptr, "surface data is null");
-    Assert(ax >= 0 && ay >= 0 && bx >= 0 && by >= 0, "line start/end out of bounds (negative)");
-    Assert(ax < surface.width && bx < surface.width, "line x out of bounds");
-    Assert(ay < surface.height && by < surface.height, "line y out of bounds");
-    Assert(surface.bpp() > 0, "invalid bytes-per-pixel");
-
     SetPixelFn setPixelFn = pickSetPixelFunction(surface.pixelFormat);
+    rasterizeLine(surface, ax, ay, bx, by, [&](i32 x, i32 y) {
+        setPixelFn(surface.row(y), x * surface.bpp(), color);
+    });
+}
 
-    // Bresenham line drawing algorithm using integer calculations.
+void strokeTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color) {
+    fillLine(surface, ax, ay, bx, by, color);
+    fillLine(surface, bx, by, cx, cy, color);
+    fillLine(surface, cx, cy, ax, ay, color);
+}
 
-    bool transpose = core::absGeneric(ax - bx) < core::absGeneric(ay - by);
-    if (transpose) {
-        core::swap(ax, ay);
-        core::swap(bx, by);
-    }
+void fillTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color) {
+    rasterizeTriangle(ax, ay, bx, by, cx, cy, 0, surface.height, [&](i32 y, i32 x0, i32 x1) {
+        for (i32 x = x0; x <= x1; x++) {
+            fillPixel(surface, x, y, color);
+        }
+    });
+}
 
-    bool flipLeftToRight = ax > bx;
-    if (flipLeftToRight) {
-        core::swap(ax, bx);
-        core::swap(ay, by);
-    }
+void blendPixel(Surface& surface, i32 x, i32 y, Color color, BlendMode mode) {
+    Assert(surface.data != nullptr, "surface data is null");
+    Assert(y >= 0 && y < surface.height, "y out of bounds");
+    Assert(x >= 0 && x < surface.width, "x out of bounds");
 
-    i32 y = ay;
-    i32 ierror = 0;
-    for (i32 x = ax; x <= bx; x++) {
-        if (transpose) {
-            i32 idx = x * surface.pitch + y * surface.bpp();
-            setPixelFn(surface.data, idx, color);
-        }
-        else {
-            i32 idx = y * surface.pitch + x * surface.bpp();
-            setPixelFn(surface.data, idx, color);
-        }
+    BlendSpanFn blendSpanFn = pickBlendSpanFunction(surface.pixelFormat);
+    blendSpanFn(surface.row(y), x, 1, makeBlendTerms(color, mode));
+}
 
-        ierror += i32(2 * core::absGeneric(by - ay));
-        if (ierror > bx - ax) {
-            y += by > ay ? 1 : -1;
-            ierror -= 2 * (bx-ax);
-        }
+void blendRect(Surface& surface, i32 x, i32 y, Color color, i32 width, i32 height, BlendMode mode) {
+    Assert(surface.data != nullptr, "surface data is null");
+    Assert(width > 0 && height > 0, "rect has non-positive size");
+    Assert(x >= 0 && y >= 0, "rect origin out of bounds");
+    Assert(y + height <= surface.height, "rect extends past surface height");
+    Assert(x + width  <= surface.width,  "rect extends past surface width");
+
+    BlendSpanFn blendSpanFn = pickBlendSpanFunction(surface.pixelFormat);
+    BlendTerms bt = makeBlendTerms(color, mode);
+    for (i32 row = y; row < y + height; row++) {
+        blendSpanFn(surface.row(row), x, width, bt);
     }
 }
 
-void strokeTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color) {
-    fillLine(surface, ax, ay, bx, by, color);
-    fillLine(surface, bx, by, cx, cy, color);
-    fillLine(surface, cx, cy, ax, ay, color);
+void blendLine(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, Color color, BlendMode mode) {
+    BlendSpanFn blendSpanFn = pickBlendSpanFunction(surface.pixelFormat);
+    BlendTerms bt = makeBlendTerms(color, mode);
+    rasterizeLine(surface, ax, ay, bx, by, [&](i32 x, i32 y) {
+        blendSpanFn(surface.row(y), x, 1, bt);
+    });
 }
 
-void fillTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color) {
-    // Calculate the bounding box for the triangle:
-    i32 minx = core::core_min(core::core_min(ax, bx), cx);
-    i32 miny = core::core_min(core::core_min(ay, by), cy);
-    i32 maxx = core::core_max(core::core_max(ax, bx), cx);
-    i32 maxy = core::core_max(core::core_max(ay, by), cy);
+void blendTriangle(Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, Color color, BlendMode mode) {
+    Assert(surface.data != nullptr, "surface data is null");
 
-    auto calculateTriangleArea = [](i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy) -> f64 {
-        return 0.5 * f64((by-ay)*(bx+ax) + (cy-by)*(cx+bx) + (ay-cy)*(ax+cx));
-    };
+    BlendSpanFn blendSpanFn = pickBlendSpanFunction(surface.pixelFormat);
+    BlendTerms bt = makeBlendTerms(color, mode);
+    rasterizeTriangle(ax, ay, bx, by, cx, cy, 0, surface.height, [&](i32 y, i32 x0, i32 x1) {
+        Assert(y >= 0 && y < surface.height, "y out of bounds");
+        Assert(x0 >= 0 && x1 < surface.width, "x out of bounds");
+        blendSpanFn(surface.row(y), x0, x1 - x0 + 1, bt);
+    });
+}
 
-    f64 totalArea = calculateTriangleArea(ax, ay, bx, by, cx, cy);
+void ProjectedModel::free() {
+    if (actx) {
+        core::memoryFree(std::move(points), *actx);
+        core::memoryFree(std::move(bandFaces), *actx);
+        core::memoryFree(std::move(bandOffsets), *actx);
+    }
 
-    if (totalArea < 1) {
-        // Naive backface culling + discarding triangles that cover less than a pixel
-        return;
+    *this = {};
+}
+
+ProjectedModel projectModel(const Model3D& model, i32 width, i32 height, i32 bandHeight,
+                            core::AllocatorContext& actx) {
+    Assert(width > 0 && height > 0, "invalid surface size");
+    Assert(bandHeight > 0, "invalid band height");
+
+    ProjectedModel ret = {};
+    ret.model = &model;
+    ret.actx = &actx;
+    ret.width = width;
+    ret.height = height;
+    ret.bandHeight = bandHeight;
+
+    ret.points = core::memoryZeroAllocate<core::vec2i>(model.verticesCount(), actx);
+    for (addr_size i = 0; i < model.verticesCount(); i++) {
+        ret.points[i] = orthogonalProjection(model.position(i), width, height);
     }
 
-    // TODO: Parallelize this loop:
-    for (i32 x= minx; x <= maxx; x++) {
-        for (i32 y= miny; y<= maxy; y++) {
-            f64 alpha = calculateTriangleArea(x, y, bx, by, cx, cy) / totalArea;
-            f64 beta  = calculateTriangleArea(x, y, cx, cy, ax, ay) / totalArea;
-            f64 gamma = calculateTriangleArea(x, y, ax, ay, bx, by) / totalArea;
+    i32 bandsCount = (height + bandHeight - 1) / bandHeight;
+    ret.bandOffsets = core::memoryZeroAllocate<i32>(addr_size(bandsCount + 1), actx);
+
+    // Counts the faces of every band in the first pass and stores them in the second, so that bandFaces is allocated
+    // once and the faces of a band stay in face order.
+    auto binFaces = [&](addr_size facesBegin, addr_size facesEnd, auto&& onBand) {
+        for (addr_size i = facesBegin; i < facesEnd; i++) {
+            auto& f = model.faces[i];
+            const core::vec2i& a = ret.points[addr_size(f[0])];
+            const core::vec2i& b = ret.points[addr_size(f[1])];
+            const core::vec2i& c = ret.points[addr_size(f[2])];
+
+            i32 miny = core::core_min(core::core_min(a.y(), b.y()), c.y());
+            i32 maxy = core::core_max(core::core_max(a.y(), b.y()), c.y());
+            if (maxy < 0 || miny >= height) {
+                continue;
+            }
 
-            if (alpha < 0 || beta < 0 || gamma < 0) {
-                // negative barycentric coordinate => the pixel is outside the triangle
+            i32 firstBand = core::core_max(miny, 0) / bandHeight;
+            i32 lastBand = core::core_min(maxy, height - 1) / bandHeight;
+            for (i32 band = firstBand; band <= lastBand; band++) {
+                onBand(band, i32(i));
+            }
+        }
+    };
+    auto binVisibleFaces = [&](auto&& onBand) {
+        if (model.submeshes.len() == 0) {
+            binFaces(0, model.faces.len(), onBand);
+            return;
+        }
+
+        // The projection keeps the order of coordinates, so the projected bounds of a submesh tell whether any of its
+        // faces can be on the surface, without looking at the faces.
+        for (addr_size i = 0; i < model.submeshes.len(); i++) {
+            const Model3D::Submesh& submesh = model.submeshes[i];
+            const core::vec3f& bmin = submesh.boundsMin;
+            const core::vec3f& bmax = submesh.boundsMax;
+            core::vec2i lo = orthogonalProjection(core::v(bmin.x(), bmin.y(), bmin.z(), 1.0f), width, height);
+            core::vec2i hi = orthogonalProjection(core::v(bmax.x(), bmax.y(), bmax.z(), 1.0f), width, height);
+            if (hi.y() < 0 || lo.y() >= height || hi.x() < 0 || lo.x() >= width) {
                 continue;
             }
 
-            fillPixel(surface, x, y, color);
+            addr_size firstFace = addr_size(submesh.firstFace);
+            binFaces(firstFace, firstFace + addr_size(submesh.facesCount), onBand);
         }
+    };
+
+    binVisibleFaces([&](i32 band, i32) { ret.bandOffsets[addr_size(band + 1)]++; });
+    for (i32 band = 0; band < bandsCount; band++) {
+        ret.bandOffsets[addr_size(band + 1)] += ret.bandOffsets[addr_size(band)];
     }
+
+    ret.bandFaces = core::memoryZeroAllocate<i32>(addr_size(ret.bandOffsets[addr_size(bandsCount)]), actx);
+    core::Memory<i32> cursors = core::memoryZeroAllocate<i32>(addr_size(bandsCount), actx);
+    defer { core::memoryFree(std::move(cursors), actx); };
+    core::memcopy(cursors.data(), ret.bandOffsets.data(), addr_size(bandsCount));
+
+    binVisibleFaces([&](i32 band, i32 face) { ret.bandFaces[addr_size(cursors[addr_size(band)]++)] = face; });
+
+    return ret;
 }
 
 void renderModel(Surface& surface, const Model3D& model, bool wireframe) {
-    i32 width = surface.width;
-    i32 height = surface.height;
-
-    auto orthogonalProjection = [](core::vec4f normVec, i32 width, i32 height) -> core::vec2i {
-        i32 ax = i32((normVec.x() + 1.0f) * (f32(width - 1)/2.0f));
-        i32 ay = i32((normVec.y() + 1.0f) * (f32(height - 1)/2.0f));
-        return core::v(ax, ay);
-    };
+    renderModelRows(surface, model, 0, surface.height, wireframe);
+}
 
-    core::rndInit();
+void renderModelRows(Surface& surface, const Model3D& model, i32 rowBegin, i32 rowEnd, bool wireframe) {
+    ProjectedModel projected = projectModel(model, surface.width, surface.height, surface.height);
+    defer { projected.free(); };
+    renderModelRows(surface, projected, rowBegin, rowEnd, wireframe);
+}
 
-    for (addr_size i = 0; i < model.faces.len(); i++) {
-        auto& f = model.faces[i];
+void renderModelRows(Surface& surface, const ProjectedModel& projected, i32 rowBegin, i32 rowEnd, bool wireframe) {
+    Assert(surface.data != nullptr, "surface data is null");
+    Assert(surface.width == projected.width && surface.height == projected.height,
+           "model was projected for a different surface size");
+    Assert(rowBegin >= 0 && rowBegin <= rowEnd && rowEnd <= surface.height, "row range out of bounds");
 
-        core::vec4f& v1 = model.vertices[f[0]];
-        core::vec4f& v2 = model.vertices[f[1]];
-        core::vec4f& v3 = model.vertices[f[2]];
+    if (rowBegin == rowEnd) return;
 
-        core::vec2i a = orthogonalProjection(v1, width, height);
-        core::vec2i b = orthogonalProjection(v2, width, height);
-        core::vec2i c = orthogonalProjection(v3, width, height);
+    const Model3D& model = *projected.model;
+    i32 width = surface.width;
+    i32 bandHeight = projected.bandHeight;
 
-        if (wireframe) {
-            strokeTriangle(surface, a.x(), a.y(), b.x(), b.y(), c.x(), c.y(), RED);
-        }
-        else {
-            Color color;
-            color.rgba.r = u8(core::rndU32() % 255);
-            color.rgba.g = u8(core::rndU32() % 255);
-            color.rgba.b = u8(core::rndU32() % 255);
-            color.rgba.a = 255;
-            fillTriangle(surface, a.x(), a.y(), b.x(), b.y(), c.x(), c.y(), color);
+    SetPixelFn setPixelFn = pickSetPixelFunction(surface.pixelFormat);
+    const i32 bpp = surface.bpp();
+
+    // Every band is drawn clipped to its own rows, so the rows of a range that spans several bands still see their
+    // faces in face order, the same as a full render.
+    for (i32 band = rowBegin / bandHeight; band <= (rowEnd - 1) / bandHeight; band++) {
+        i32 bandBegin = core::core_max(rowBegin, band * bandHeight);
+        i32 bandEnd = core::core_min(rowEnd, (band + 1) * bandHeight);
+        auto inRows = [&](i32 y) { return y >= bandBegin && y < bandEnd; };
+
+        i32 facesBegin = projected.bandOffsets[addr_size(band)];
+        i32 facesEnd = projected.bandOffsets[addr_size(band + 1)];
+        for (i32 k = facesBegin; k < facesEnd; k++) {
+            addr_size i = addr_size(projected.bandFaces[addr_size(k)]);
+            auto& f = model.faces[i];
+
+            const core::vec2i& a = projected.points[addr_size(f[0])];
+            const core::vec2i& b = projected.points[addr_size(f[1])];
+            const core::vec2i& c = projected.points[addr_size(f[2])];
+
+            if (wireframe) {
+                auto plot = [&](i32 x, i32 y) {
+                    if (inRows(y)) setPixelFn(surface.row(y), x * bpp, RED);
+                };
+                rasterizeLine(surface, a.x(), a.y(), b.x(), b.y(), plot);
+                rasterizeLine(surface, b.x(), b.y(), c.x(), c.y(), plot);
+                rasterizeLine(surface, c.x(), c.y(), a.x(), a.y(), plot);
+            }
+            else {
+                Color color = faceColor(i);
+                auto fillSpan = [&](i32 y, i32 x0, i32 x1) {
+                    Assert(x0 >= 0 && x1 < width, "x out of bounds");
+                    u8* row = surface.row(y);
+                    for (i32 x = x0; x <= x1; x++) {
+                        setPixelFn(row, x * bpp, color);
+                    }
+                };
+                rasterizeTriangle(a.x(), a.y(), b.x(), b.y(), c.x(), c.y(), bandBegin, bandEnd, fillSpan);
+            }
         }
     }
 
     if (wireframe) {
-        for (addr_size i = 0; i < model.vertices.len(); i++) {
-            auto& v = model.vertices[i];
-            core::vec2i a = orthogonalProjection(v, width, height);
-            fillPixel(surface, a.x(), a.y(), WHITE);
+        for (addr_size i = 0; i < projected.points.len(); i++) {
+            const core::vec2i& a = projected.points[i];
+            if (a.y() >= rowBegin && a.y() < rowEnd) fillPixel(surface, a.x(), a.y(), WHITE);
         }
     }
 }
@@ -231,4 +361,317 @@ constexpr inline SetPixelFn pickSetPixelFunction(PixelFormat pixelFormat) {
     }
 }
 
+
+constexpr inline BlendTerms makeBlendTerms(Color color, BlendMode mode) {
+    BlendTerms bt = {};
+    u16 a = color.a();
+    bt.invAlpha = u16(255 - a);
+
+    switch (mode) {
+        case BlendMode::SourceOver:
+            bt.terms[0] = u16(color.b() * a + 128);
+            bt.terms[1] = u16(color.g() * a + 128);
+            bt.terms[2] = u16(color.r() * a + 128);
+            bt.dstAlphaMatters = a != 0 && a != 255;
+            break;
+
+        case BlendMode::SourceOverPremultiplied:
+            Assert(color.r() <= a && color.g() <= a && color.b() <= a, "color is not premultiplied");
+            bt.terms[0] = u16(color.b() * 255 + 128);
+            bt.terms[1] = u16(color.g() * 255 + 128);
+            bt.terms[2] = u16(color.r() * 255 + 128);
+            break;
+
+        case BlendMode::SENTINEL: [[fallthrough]];
+        default:
+            Assert(false, "invalid blend mode");
+            break;
+    }
+
+    bt.terms[3] = u16(a * 255 + 128);
+    bt.color[0] = color.b();
+    bt.color[1] = color.g();
+    bt.color[2] = color.r();
+    bt.color[3] = color.a();
+    return bt;
+}
+
+constexpr inline void blendStraightOver(const BlendTerms& bt, u8* bgra) {
+    // outA = a + dA * (255 - a) / 255
+    // out  = (src * a + dst * dA * (255 - a) / 255) / outA
+    u32 a = bt.color[3];
+    u32 dstWeight = (u32(bgra[3]) * bt.invAlpha + 128);
+    dstWeight = (dstWeight + (dstWeight >> 8)) >> 8;
+    u32 outA = a + dstWeight;
+    if (outA == 0) {
+        return;
+    }
+
+    for (i32 c = 0; c < 3; c++) {
+        bgra[c] = u8((u32(bt.color[c]) * a + u32(bgra[c]) * dstWeight + outA / 2) / outA);
+    }
+    bgra[3] = u8(outA);
+}
+
+constexpr inline u8 blendChannel(u16 term, u8 dst, u16 invAlpha) {
+    // Exact round(x / 255) for x in [0, 255*255]. Saturating like the SIMD kernels for malformed premultiplied input.
+    u32 t = core::core_min(u32(term) + u32(dst) * u32(invAlpha), u32(0xFFFF));
+    t = core::core_min(t + (t >> 8), u32(0xFFFF));
+    return u8(t >> 8);
+}
+
+#if SIMD_SSE2_ENABLED
+inline __m128i div255RoundEpu16(__m128i t) {
+    // t already contains the +128 rounding bias.
+    t = _mm_adds_epu16(t, _mm_srli_epi16(t, 8));
+    return _mm_srli_epi16(t, 8);
+}
+#endif
+
+void blendSpan_BGRA8888(u8* row, i32 x, i32 count, const BlendTerms& bt) {
+    u8* dst = row + x * 4;
+    i32 i = 0;
+
+#if SIMD_SSE2_ENABLED
+    // 4 pixels per iteration, widened to two registers of 2 pixels x 4 channels x 16 bits.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i terms = _mm_setr_epi16(
+        i16(bt.terms[0]), i16(bt.terms[1]), i16(bt.terms[2]), i16(bt.terms[3]),
+        i16(bt.terms[0]), i16(bt.terms[1]), i16(bt.terms[2]), i16(bt.terms[3])
+    );
+    const __m128i invAlpha = _mm_set1_epi16(i16(bt.invAlpha));
+    const __m128i alphaMask = _mm_set1_epi32(i32(0xFF000000));
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i* p = reinterpret_cast<__m128i*>(dst + i * 4);
+        __m128i d = _mm_loadu_si128(p);
+        if (bt.dstAlphaMatters &&
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(d, alphaMask), alphaMask)) != 0xFFFF) {
+            for (i32 j = 0; j < 4; j++) {
+                blendPixel_BGRA8888(dst + (i + j) * 4, bt);
+            }
+            continue;
+        }
+        __m128i lo = _mm_unpacklo_epi8(d, zero);
+        __m128i hi = _mm_unpackhi_epi8(d, zero);
+        lo = div255RoundEpu16(_mm_adds_epu16(_mm_mullo_epi16(lo, invAlpha), terms));
+        hi = div255RoundEpu16(_mm_adds_epu16(_mm_mullo_epi16(hi, invAlpha), terms));
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++) {
+        blendPixel_BGRA8888(dst + i * 4, bt);
+    }
+}
+
+constexpr inline void blendPixel_BGRA8888(u8* p, const BlendTerms& bt) {
+    if (bt.dstAlphaMatters && p[3] != 255) {
+        blendStraightOver(bt, p);
+        return;
+    }
+    p[0] = blendChannel(bt.terms[0], p[0], bt.invAlpha);
+    p[1] = blendChannel(bt.terms[1], p[1], bt.invAlpha);
+    p[2] = blendChannel(bt.terms[2], p[2], bt.invAlpha);
+    p[3] = blendChannel(bt.terms[3], p[3], bt.invAlpha);
+}
+
+void blendSpan_BGRA5551(u8* row, i32 x, i32 count, const BlendTerms& bt) {
+    // Channels are expanded to 8 bits (c << 3 | c >> 2, alpha bit -> 0 or 255), blended and truncated back, the same
+    // way setPixelTopLeft_BGRA5551 truncates colors.
+    u8* dst = row + x * 2;
+    i32 i = 0;
+
+#if SIMD_SSE2_ENABLED
+    // 8 pixels per iteration, one 16 bit lane per pixel and one register per channel.
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask8 = _mm_set1_epi16(0xFF);
+    const __m128i invAlpha = _mm_set1_epi16(i16(bt.invAlpha));
+    const __m128i tb = _mm_set1_epi16(i16(bt.terms[0]));
+    const __m128i tg = _mm_set1_epi16(i16(bt.terms[1]));
+    const __m128i tr = _mm_set1_epi16(i16(bt.terms[2]));
+    const __m128i ta = _mm_set1_epi16(i16(bt.terms[3]));
+
+    auto expand5 = [](__m128i c) -> __m128i {
+        return _mm_or_si128(_mm_slli_epi16(c, 3), _mm_srli_epi16(c, 2));
+    };
+    auto blend = [&](__m128i c, __m128i term) -> __m128i {
+        return div255RoundEpu16(_mm_adds_epu16(_mm_mullo_epi16(c, invAlpha), term));
+    };
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i* p = reinterpret_cast<__m128i*>(dst + i * 2);
+        __m128i d = _mm_loadu_si128(p);
+        if (bt.dstAlphaMatters && _mm_movemask_epi8(_mm_srai_epi16(d, 15)) != 0xFFFF) {
+            for (i32 j = 0; j < 8; j++) {
+                blendPixel_BGRA5551(dst + (i + j) * 2, bt);
+            }
+            continue;
+        }
+
+        __m128i b = blend(expand5(_mm_and_si128(d, mask5)), tb);
+        __m128i g = blend(expand5(_mm_and_si128(_mm_srli_epi16(d, 5), mask5)), tg);
+        __m128i r = blend(expand5(_mm_and_si128(_mm_srli_epi16(d, 10), mask5)), tr);
+        __m128i a = blend(_mm_and_si128(_mm_srai_epi16(d, 15), mask8), ta);
+
+        __m128i packed = _mm_srli_epi16(b, 3);
+        packed = _mm_or_si128(packed, _mm_slli_epi16(_mm_srli_epi16(g, 3), 5));
+        packed = _mm_or_si128(packed, _mm_slli_epi16(_mm_srli_epi16(r, 3), 10));
+        packed = _mm_or_si128(packed, _mm_slli_epi16(_mm_srli_epi16(a, 7), 15));
+        _mm_storeu_si128(p, packed);
+    }
+#endif
+
+    for (; i < count; i++) {
+        blendPixel_BGRA5551(dst + i * 2, bt);
+    }
+}
+
+constexpr inline void blendPixel_BGRA5551(u8* p, const BlendTerms& bt) {
+    u16 d = u16(p[0] | (p[1] << 8));
+
+    auto expand5 = [](u16 c) -> u8 { return u8((c << 3) | (c >> 2)); };
+    u8 bgra[4] = {
+        expand5(u16(d & 0x1F)),
+        expand5(u16((d >> 5) & 0x1F)),
+        expand5(u16((d >> 10) & 0x1F)),
+        (d >> 15) ? u8(255) : u8(0),
+    };
+    if (bt.dstAlphaMatters && bgra[3] != 255) {
+        blendStraightOver(bt, bgra);
+    }
+    else {
+        for (i32 c = 0; c < 4; c++) bgra[c] = blendChannel(bt.terms[c], bgra[c], bt.invAlpha);
+    }
+
+    u16 packed = u16((bgra[0] >> 3) | ((bgra[1] >> 3) << 5) | ((bgra[2] >> 3) << 10) | ((bgra[3] >> 7) << 15));
+    p[0] = u8(packed & 0xFF);
+    p[1] = u8(packed >> 8);
+}
+
+constexpr inline BlendSpanFn pickBlendSpanFunction(PixelFormat pixelFormat) {
+    switch (pixelFormat) {
+        case PixelFormat::BGRA8888: return blendSpan_BGRA8888;
+        case PixelFormat::BGRA5551: return blendSpan_BGRA5551;
+
+        case PixelFormat::BGRX8888: [[fallthrough]];
+        case PixelFormat::BGR888:   [[fallthrough]];
+        case PixelFormat::BGR555:   [[fallthrough]];
+        case PixelFormat::Unknown:  [[fallthrough]];
+        case PixelFormat::SENTINEL: [[fallthrough]];
+        default:
+            Assert(false, "blending is not supported for this pixel format");
+            return nullptr;
+    }
+}
+
+template <typename PlotFn>
+void rasterizeLine(const Surface& surface, i32 ax, i32 ay, i32 bx, i32 by, PlotFn&& plot) {
+    Assert(surface.data != nullptr, "surface data is null");
+    Assert(ax >= 0 && ay >= 0 && bx >= 0 && by >= 0, "line start/end out of bounds (negative)");
+    Assert(ax < surface.width && bx < surface.width, "line x out of bounds");
+    Assert(ay < surface.height && by < surface.height, "line y out of bounds");
+    Assert(surface.bpp() > 0, "invalid bytes-per-pixel");
+
+    // Bresenham line drawing algorithm using integer calculations.
+
+    bool transpose = core::absGeneric(ax - bx) < core::absGeneric(ay - by);
+    if (transpose) {
+        core::swap(ax, ay);
+        core::swap(bx, by);
+    }
+
+    bool flipLeftToRight = ax > bx;
+    if (flipLeftToRight) {
+        core::swap(ax, bx);
+        core::swap(ay, by);
+    }
+
+    i32 y = ay;
+    i32 ierror = 0;
+    for (i32 x = ax; x <= bx; x++) {
+        if (transpose) {
+            plot(y, x);
+        }
+        else {
+            plot(x, y);
+        }
+
+        ierror += i32(2 * core::absGeneric(by - ay));
+        if (ierror > bx - ax) {
+            y += by > ay ? 1 : -1;
+            ierror -= 2 * (bx-ax);
+        }
+    }
+}
+
+template <typename SpanFn>
+void rasterizeTriangle(i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy, i32 rowBegin, i32 rowEnd, SpanFn&& span) {
+    // Calculate the bounding box for the triangle, clipped to the rows [rowBegin, rowEnd) so that a band only tests
+    // the pixels it owns:
+    i32 minx = core::core_min(core::core_min(ax, bx), cx);
+    i32 miny = core::core_max(core::core_min(core::core_min(ay, by), cy), rowBegin);
+    i32 maxx = core::core_max(core::core_max(ax, bx), cx);
+    i32 maxy = core::core_min(core::core_max(core::core_max(ay, by), cy), rowEnd - 1);
+
+    auto calculateTriangleArea = [](i32 ax, i32 ay, i32 bx, i32 by, i32 cx, i32 cy) -> f64 {
+        return 0.5 * f64((by-ay)*(bx+ax) + (cy-by)*(cx+bx) + (ay-cy)*(ax+cx));
+    };
+
+    f64 totalArea = calculateTriangleArea(ax, ay, bx, by, cx, cy);
+
+    if (totalArea < 1) {
+        // Naive backface culling + discarding triangles that cover less than a pixel
+        return;
+    }
+
+    // The triangle is convex, so the covered pixels of every row form a single span [spanStart, x - 1].
+    // TODO: Parallelize this loop:
+    for (i32 y = miny; y <= maxy; y++) {
+        i32 spanStart = -1;
+        for (i32 x = minx; x <= maxx + 1; x++) {
+            bool inside = false;
+            if (x <= maxx) {
+                f64 alpha = calculateTriangleArea(x, y, bx, by, cx, cy) / totalArea;
+                f64 beta  = calculateTriangleArea(x, y, cx, cy, ax, ay) / totalArea;
+                f64 gamma = calculateTriangleArea(x, y, ax, ay, bx, by) / totalArea;
+
+                // negative barycentric coordinate => the pixel is outside the triangle
+                inside = alpha >= 0 && beta >= 0 && gamma >= 0;
+            }
+
+            if (inside && spanStart < 0) {
+                spanStart = x;
+            }
+            else if (!inside && spanStart >= 0) {
+                span(y, spanStart, x - 1);
+                spanStart = -1;
+            }
+        }
+    }
+}
+
+inline core::vec2i orthogonalProjection(const core::vec4f& normVec, i32 width, i32 height) {
+    i32 ax = i32((normVec.x() + 1.0f) * (f32(width - 1)/2.0f));
+    i32 ay = i32((normVec.y() + 1.0f) * (f32(height - 1)/2.0f));
+    return core::v(ax, ay);
+}
+
+constexpr inline Color faceColor(addr_size faceIdx) {
+    // Murmur3 finalizer; a stable color per face keeps every row band of a model consistent with the others.
+    u32 h = u32(faceIdx);
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+
+    Color color;
+    color.rgba.r = u8((h >>  0) % 255);
+    color.rgba.g = u8((h >>  8) % 255);
+    color.rgba.b = u8((h >> 16) % 255);
+    color.rgba.a = 255;
+    return color;
+}
+
 } // namespace
@@ -0,0 +1,431 @@
+#include "surface_scale.h"
+#include "simd_utils.h"
+
+namespace {
+
+constexpr i32 CHANNELS = 4;
+
+void downsampleRow_8888(const u8* r0, const u8* r1, u8* dst, i32 srcWidth, i32 dstWidth);
+void downsampleRow_888(const u8* r0, const u8* r1, u8* dst, i32 srcWidth, i32 dstWidth);
+void downsampleRow_1555(const u8* r0, const u8* r1, u8* dst, i32 srcWidth, i32 dstWidth, bool hasAlpha);
+
+// Unpacks a row into CHANNELS floats per pixel in BGRA order. 16 bit formats are kept in their native 5/1 bit channel
+// ranges so averaging and packing back is lossless.
+void unpackRow(const u8* row, PixelFormat pixelFormat, i32 width, f32* out);
+void packRow(const f32* in, PixelFormat pixelFormat, i32 width, u8* row);
+
+// Box filters the whole source block of the destination pixel at (x, y). The last row and column of dst cover 3 source
+// rows or columns when the source size is odd. The arithmetic matches downscaleAreaAverage for that block.
+void foldTailPixel(const Surface& src, Surface& dst, i32 x, i32 y);
+
+} // namespace
+
+void downsample2x2(const Surface& src, Surface& dst) {
+    Assert(src.data != nullptr && dst.data != nullptr, "surface data is null");
+    Assert(src.pixelFormat == dst.pixelFormat, "pixel formats differ");
+    Assert(dst.width == core::core_max(1, src.width / 2), "invalid destination width");
+    Assert(dst.height == core::core_max(1, src.height / 2), "invalid destination height");
+
+    for (i32 y = 0; y < dst.height; y++) {
+        i32 sy0 = core::core_min(2 * y, src.height - 1);
+        i32 sy1 = core::core_min(2 * y + 1, src.height - 1);
+        const u8* r0 = src.row(sy0);
+        const u8* r1 = src.row(sy1);
+        u8* out = dst.row(y);
+
+        switch (src.pixelFormat) {
+            case PixelFormat::BGRA8888: [[fallthrough]];
+            case PixelFormat::BGRX8888: downsampleRow_8888(r0, r1, out, src.width, dst.width);        break;
+            case PixelFormat::BGR888:   downsampleRow_888(r0, r1, out, src.width, dst.width);         break;
+            case PixelFormat::BGRA5551: downsampleRow_1555(r0, r1, out, src.width, dst.width, true);  break;
+            case PixelFormat::BGR555:   downsampleRow_1555(r0, r1, out, src.width, dst.width, false); break;
+
+            case PixelFormat::Unknown:  [[fallthrough]];
+            case PixelFormat::SENTINEL: [[fallthrough]];
+            default:
+                Assert(false, "invalid pixel format");
+                return;
+        }
+    }
+
+    // The row kernels average 2x2 blocks only, so an odd trailing source row or column is folded into the last
+    // destination row or column here.
+    if (src.height > 1 && src.height % 2 != 0) {
+        for (i32 x = 0; x < dst.width; x++) foldTailPixel(src, dst, x, dst.height - 1);
+    }
+    if (src.width > 1 && src.width % 2 != 0) {
+        for (i32 y = 0; y < dst.height; y++) foldTailPixel(src, dst, dst.width - 1, y);
+    }
+}
+
+void downscaleAreaAverage(const Surface& src, Surface& dst, core::AllocatorContext& actx) {
+    Assert(src.data != nullptr && dst.data != nullptr, "surface data is null");
+    Assert(src.pixelFormat == dst.pixelFormat, "pixel formats differ");
+    Assert(dst.width > 0 && dst.height > 0, "invalid destination size");
+    Assert(dst.width <= src.width && dst.height <= src.height, "area average can only downscale");
+
+    const f64 scaleX = f64(src.width) / f64(dst.width);
+    const f64 scaleY = f64(src.height) / f64(dst.height);
+    const f32 norm = f32(1.0 / (scaleX * scaleY));
+
+    addr_size rowLen = addr_size(src.width) * CHANNELS;
+    auto acc = core::memoryZeroAllocate<f32>(rowLen, actx);
+    defer { core::memoryFree(std::move(acc), actx); };
+    auto unpacked = core::memoryZeroAllocate<f32>(rowLen, actx);
+    defer { core::memoryFree(std::move(unpacked), actx); };
+    auto outRow = core::memoryZeroAllocate<f32>(addr_size(dst.width) * CHANNELS, actx);
+    defer { core::memoryFree(std::move(outRow), actx); };
+
+    // Calls fn(srcIdx, weight) for every source pixel overlapping [dstIdx * scale, (dstIdx + 1) * scale).
+    auto forEachCoverage = [](i32 dstIdx, f64 scale, i32 srcLen, auto&& fn) {
+        f64 begin = f64(dstIdx) * scale;
+        f64 end = core::core_min(f64(dstIdx + 1) * scale, f64(srcLen));
+        for (i32 i = i32(begin); f64(i) < end; i++) {
+            f64 w = core::core_min(f64(i + 1), end) - core::core_max(f64(i), begin);
+            if (w > 0) fn(i, f32(w));
+        }
+    };
+
+    for (i32 y = 0; y < dst.height; y++) {
+        // Vertical pass: weighted sum of the covered source rows.
+        core::memset(acc.data(), 0.0f, rowLen);
+        forEachCoverage(y, scaleY, src.height, [&](i32 sy, f32 wy) {
+            unpackRow(src.row(sy), src.pixelFormat, src.width, unpacked.data());
+            f32* a = acc.data();
+            const f32* u = unpacked.data();
+            for (addr_size i = 0; i < rowLen; i++) {
+                a[i] += u[i] * wy;
+            }
+        });
+
+        // Horizontal pass.
+        for (i32 x = 0; x < dst.width; x++) {
+            f32 sum[CHANNELS] = {};
+            forEachCoverage(x, scaleX, src.width, [&](i32 sx, f32 wx) {
+                for (i32 c = 0; c < CHANNELS; c++) {
+                    sum[c] += acc[addr_size(sx * CHANNELS + c)] * wx;
+                }
+            });
+            for (i32 c = 0; c < CHANNELS; c++) {
+                outRow[addr_size(x * CHANNELS + c)] = sum[c] * norm;
+            }
+        }
+
+        packRow(outRow.data(), dst.pixelFormat, dst.width, dst.row(y));
+    }
+}
+
+const Surface& MipChain::levelAtLeast(i32 minWidth, i32 minHeight) const {
+    Assert(count() > 0, "mip chain is empty");
+    i32 best = 0;
+    for (i32 i = 1; i < count(); i++) {
+        if (levels[addr_size(i)].width < minWidth || levels[addr_size(i)].height < minHeight) break;
+        best = i;
+    }
+    return levels[addr_size(best)];
+}
+
+void MipChain::free() {
+    if (actx) {
+        for (addr_size i = 0; i < levels.len(); i++) {
+            levels[i].free();
+        }
+        core::memoryFree(std::move(levels), *actx);
+    }
+
+    *this = {};
+}
+
+MipChain createMipChain(const Surface& base, core::AllocatorContext& actx) {
+    Assert(base.data != nullptr, "surface data is null");
+    Assert(base.width > 0 && base.height > 0, "invalid surface size");
+
+    i32 count = 1;
+    for (i32 w = base.width, h = base.height; w > 1 || h > 1; count++) {
+        w = core::core_max(1, w / 2);
+        h = core::core_max(1, h / 2);
+    }
+
+    MipChain chain;
+    chain.actx = &actx;
+    chain.levels = core::memoryZeroAllocate<Surface>(addr_size(count), actx);
+    chain.levels[0] = base.view();
+
+    for (i32 i = 1; i < count; i++) {
+        const Surface& prev = chain.levels[addr_size(i - 1)];
+
+        Surface level = Surface();
+        level.origin = base.origin;
+        level.pixelFormat = base.pixelFormat;
+        level.width = core::core_max(1, prev.width / 2);
+        level.height = core::core_max(1, prev.height / 2);
+        level.pitch = level.width * level.bpp();
+        level.actx = &actx;
+        level.data = reinterpret_cast<u8*>(actx.alloc(addr_size(level.size()), sizeof(u8)));
+
+        downsample2x2(prev, level);
+        chain.levels[addr_size(i)] = level;
+    }
+
+    return chain;
+}
+
+namespace {
+
+void downsampleRow_8888(const u8* r0, const u8* r1, u8* dst, i32 srcWidth, i32 dstWidth) {
+    i32 x = 0;
+
+#if SIMD_SSE2_ENABLED
+    // 8 source pixels -> 4 destination pixels per iteration. Sums are exact in 16 bit lanes.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(2);
+    for (; x + 4 <= dstWidth && 2 * x + 8 <= srcWidth; x += 4) {
+        const u8* a = r0 + 2 * x * 4;
+        const u8* b = r1 + 2 * x * 4;
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16));
+
+        // Vertical sums, 2 pixels per register: [p0 p1] [p2 p3] [p4 p5] [p6 p7]
+        __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+        // Horizontal sums: [p0+p1 p2+p3] and [p4+p5 p6+p7]
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+        __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, bias), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, bias), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; x < dstWidth; x++) {
+        i32 sx0 = core::core_min(2 * x, srcWidth - 1) * 4;
+        i32 sx1 = core::core_min(2 * x + 1, srcWidth - 1) * 4;
+        for (i32 c = 0; c < 4; c++) {
+            dst[x * 4 + c] = u8((r0[sx0 + c] + r0[sx1 + c] + r1[sx0 + c] + r1[sx1 + c] + 2) >> 2);
+        }
+    }
+}
+
+void downsampleRow_888(const u8* r0, const u8* r1, u8* dst, i32 srcWidth, i32 dstWidth) {
+    i32 x = 0;
+
+#if SIMD_SSE2_ENABLED
+    // 16 source pixels (48 bytes) -> 8 destination pixels (24 bytes) per iteration. The vertical sums are a stream of
+    // 48 16 bit channel values, of which each group of 12 (4 pixels) gives 6 output values. Pixel pairs are 3 lanes
+    // apart, so a 6 byte shift lines up the neighbour.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(2);
+    const __m128i low3 = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+
+    // a holds channel values e0..e7 of a group and b holds e8..e11 in its low lanes. Returns the 6 pair sums in the
+    // low lanes, the other lanes are zero.
+    auto pairSums = [&low3](__m128i a, __m128i b) -> __m128i {
+        __m128i s0 = _mm_add_epi16(a, _mm_srli_si128(a, 6));
+        __m128i t = _mm_or_si128(_mm_srli_si128(a, 12), _mm_slli_si128(b, 4));
+        __m128i s1 = _mm_add_epi16(t, _mm_srli_si128(t, 6));
+        return _mm_or_si128(_mm_and_si128(s0, low3), _mm_slli_si128(_mm_and_si128(s1, low3), 6));
+    };
+
+    for (; x + 8 <= dstWidth && 2 * x + 16 <= srcWidth; x += 8) {
+        const u8* a = r0 + 2 * x * 3;
+        const u8* b = r1 + 2 * x * 3;
+
+        __m128i v[6];
+        for (i32 i = 0; i < 3; i++) {
+            __m128i ra = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * 16));
+            __m128i rb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * 16));
+            v[2 * i + 0] = _mm_add_epi16(_mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+            v[2 * i + 1] = _mm_add_epi16(_mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+        }
+
+        // Groups start at lanes 0, 12, 24 and 36 of the stream.
+        __m128i g0 = pairSums(v[0], v[1]);
+        __m128i g1 = pairSums(_mm_or_si128(_mm_srli_si128(v[1], 8), _mm_slli_si128(v[2], 8)), _mm_srli_si128(v[2], 8));
+        __m128i g2 = pairSums(v[3], v[4]);
+        __m128i g3 = pairSums(_mm_or_si128(_mm_srli_si128(v[4], 8), _mm_slli_si128(v[5], 8)), _mm_srli_si128(v[5], 8));
+
+        // Pack the 4 x 6 sums into 24 contiguous lanes.
+        __m128i o0 = _mm_or_si128(g0, _mm_slli_si128(g1, 12));
+        __m128i o1 = _mm_or_si128(_mm_srli_si128(g1, 4), _mm_slli_si128(g2, 8));
+        __m128i o2 = _mm_or_si128(_mm_srli_si128(g2, 8), _mm_slli_si128(g3, 4));
+
+        o0 = _mm_srli_epi16(_mm_add_epi16(o0, bias), 2);
+        o1 = _mm_srli_epi16(_mm_add_epi16(o1, bias), 2);
+        o2 = _mm_srli_epi16(_mm_add_epi16(o2, bias), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm_packus_epi16(o0, o1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 3 + 16), _mm_packus_epi16(o2, o2));
+    }
+#endif
+
+    for (; x < dstWidth; x++) {
+        i32 sx0 = core::core_min(2 * x, srcWidth - 1) * 3;
+        i32 sx1 = core::core_min(2 * x + 1, srcWidth - 1) * 3;
+        for (i32 c = 0; c < 3; c++) {
+            dst[x * 3 + c] = u8((r0[sx0 + c] + r0[sx1 + c] + r1[sx0 + c] + r1[sx1 + c] + 2) >> 2);
+        }
+    }
+}
+
+void downsampleRow_1555(const u8* r0, const u8* r1, u8* dst, i32 srcWidth, i32 dstWidth, bool hasAlpha) {
+    i32 x = 0;
+
+#if SIMD_SSE2_ENABLED
+    // 8 source pixels -> 4 destination pixels per iteration. Every 32 bit lane holds an even/odd pixel pair, so the
+    // horizontal sum is the low half plus the high half of the lane.
+    const __m128i mask5 = _mm_set1_epi32(0x1F);
+    const __m128i mask1 = _mm_set1_epi32(0x1);
+    const __m128i bias = _mm_set1_epi32(2);
+
+    auto sumChannel = [](__m128i a, __m128i b, i32 shift, __m128i mask) -> __m128i {
+        __m128i s = _mm_and_si128(_mm_srl_epi32(a, _mm_cvtsi32_si128(shift)), mask);
+        s = _mm_add_epi32(s, _mm_and_si128(_mm_srl_epi32(a, _mm_cvtsi32_si128(shift + 16)), mask));
+        s = _mm_add_epi32(s, _mm_and_si128(_mm_srl_epi32(b, _mm_cvtsi32_si128(shift)), mask));
+        s = _mm_add_epi32(s, _mm_and_si128(_mm_srl_epi32(b, _mm_cvtsi32_si128(shift + 16)), mask));
+        return s;
+    };
+
+    for (; x + 4 <= dstWidth && 2 * x + 8 <= srcWidth; x += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 2 * x * 2));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 2 * x * 2));
+
+        __m128i cb = _mm_srli_epi32(_mm_add_epi32(sumChannel(a, b, 0, mask5), bias), 2);
+        __m128i cg = _mm_srli_epi32(_mm_add_epi32(sumChannel(a, b, 5, mask5), bias), 2);
+        __m128i cr = _mm_srli_epi32(_mm_add_epi32(sumChannel(a, b, 10, mask5), bias), 2);
+        __m128i packed = _mm_or_si128(cb, _mm_or_si128(_mm_slli_epi32(cg, 5), _mm_slli_epi32(cr, 10)));
+        if (hasAlpha) {
+            __m128i ca = _mm_srli_epi32(_mm_add_epi32(sumChannel(a, b, 15, mask1), bias), 2);
+            packed = _mm_or_si128(packed, _mm_slli_epi32(ca, 15));
+        }
+
+        // Sign extend so the signed saturating pack keeps bit 15 intact.
+        packed = _mm_srai_epi32(_mm_slli_epi32(packed, 16), 16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 2), _mm_packs_epi32(packed, packed));
+    }
+#endif
+
+    auto load = [](const u8* row, i32 i) -> u32 { return u32(row[i * 2] | (row[i * 2 + 1] << 8)); };
+
+    for (; x < dstWidth; x++) {
+        i32 sx0 = core::core_min(2 * x, srcWidth - 1);
+        i32 sx1 = core::core_min(2 * x + 1, srcWidth - 1);
+        u32 p[4] = { load(r0, sx0), load(r0, sx1), load(r1, sx0), load(r1, sx1) };
+
+        auto avg = [&p](i32 shift, u32 mask) -> u32 {
+            u32 sum = 0;
+            for (u32 v : p) sum += (v >> shift) & mask;
+            return (sum + 2) >> 2;
+        };
+
+        u32 packed = avg(0, 0x1F) | (avg(5, 0x1F) << 5) | (avg(10, 0x1F) << 10);
+        if (hasAlpha) packed |= avg(15, 0x1) << 15;
+        dst[x * 2 + 0] = u8(packed & 0xFF);
+        dst[x * 2 + 1] = u8(packed >> 8);
+    }
+}
+
+void unpackRow(const u8* row, PixelFormat pixelFormat, i32 width, f32* out) {
+    switch (pixelFormat) {
+        case PixelFormat::BGRA8888: [[fallthrough]];
+        case PixelFormat::BGRX8888:
+            for (i32 i = 0; i < width * 4; i++) out[i] = f32(row[i]);
+            break;
+
+        case PixelFormat::BGR888:
+            for (i32 x = 0; x < width; x++) {
+                out[x * 4 + 0] = f32(row[x * 3 + 0]);
+                out[x * 4 + 1] = f32(row[x * 3 + 1]);
+                out[x * 4 + 2] = f32(row[x * 3 + 2]);
+                out[x * 4 + 3] = 0.0f;
+            }
+            break;
+
+        case PixelFormat::BGRA5551: [[fallthrough]];
+        case PixelFormat::BGR555:
+            for (i32 x = 0; x < width; x++) {
+                u32 v = u32(row[x * 2] | (row[x * 2 + 1] << 8));
+                out[x * 4 + 0] = f32(v & 0x1F);
+                out[x * 4 + 1] = f32((v >> 5) & 0x1F);
+                out[x * 4 + 2] = f32((v >> 10) & 0x1F);
+                out[x * 4 + 3] = f32(v >> 15);
+            }
+            break;
+
+        case PixelFormat::Unknown:  [[fallthrough]];
+        case PixelFormat::SENTINEL: [[fallthrough]];
+        default:
+            Assert(false, "invalid pixel format");
+            break;
+    }
+}
+
+void packRow(const f32* in, PixelFormat pixelFormat, i32 width, u8* row) {
+    auto round = [](f32 v, u32 maxValue) -> u32 {
+        u32 r = u32(v + 0.5f);
+        return core::core_min(r, maxValue);
+    };
+
+    switch (pixelFormat) {
+        case PixelFormat::BGRA8888: [[fallthrough]];
+        case PixelFormat::BGRX8888:
+            for (i32 i = 0; i < width * 4; i++) row[i] = u8(round(in[i], 255));
+            break;
+
+        case PixelFormat::BGR888:
+            for (i32 x = 0; x < width; x++) {
+                row[x * 3 + 0] = u8(round(in[x * 4 + 0], 255));
+                row[x * 3 + 1] = u8(round(in[x * 4 + 1], 255));
+                row[x * 3 + 2] = u8(round(in[x * 4 + 2], 255));
+            }
+            break;
+
+        case PixelFormat::BGRA5551: [[fallthrough]];
+        case PixelFormat::BGR555:
+            for (i32 x = 0; x < width; x++) {
+                u32 packed = round(in[x * 4 + 0], 0x1F) |
+                             (round(in[x * 4 + 1], 0x1F) << 5) |
+                             (round(in[x * 4 + 2], 0x1F) << 10);
+                if (pixelFormat == PixelFormat::BGRA5551) {
+                    packed |= round(in[x * 4 + 3], 1) << 15;
+                }
+                row[x * 2 + 0] = u8(packed & 0xFF);
+                row[x * 2 + 1] = u8(packed >> 8);
+            }
+            break;
+
+        case PixelFormat::Unknown:  [[fallthrough]];
+        case PixelFormat::SENTINEL: [[fallthrough]];
+        default:
+            Assert(false, "invalid pixel format");
+            break;
+    }
+}
+
+void foldTailPixel(const Surface& src, Surface& dst, i32 x, i32 y) {
+    const i32 x0 = 2 * x;
+    const i32 y0 = 2 * y;
+    const i32 x1 = x == dst.width - 1 ? src.width : core::core_min(x0 + 2, src.width);
+    const i32 y1 = y == dst.height - 1 ? src.height : core::core_min(y0 + 2, src.height);
+    const i32 w = x1 - x0;
+    Assert(w > 0 && w <= 3 && y1 - y0 > 0 && y1 - y0 <= 3, "invalid source block");
+
+    f32 unpacked[3 * CHANNELS];
+    f32 sum[CHANNELS] = {};
+    for (i32 sy = y0; sy < y1; sy++) {
+        unpackRow(src.row(sy) + x0 * src.bpp(), src.pixelFormat, w, unpacked);
+        for (i32 i = 0; i < w * CHANNELS; i++) {
+            sum[i % CHANNELS] += unpacked[i];
+        }
+    }
+
+    const f32 norm = f32(1.0 / f64(w * (y1 - y0)));
+    for (f32& v : sum) v *= norm;
+    packRow(sum, dst.pixelFormat, 1, dst.row(y) + x * dst.bpp());
+}
+
+} // namespace
@@ -0,0 +1,239 @@
+#include "tga_batch.h"
+#include "log_utils.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace TGA
+{
+
+namespace {
+
+constexpr i32 MAX_WORKERS = 64;
+
+struct ByteBudget {
+    std::mutex mtx;
+    std::condition_variable released;
+    addr_size limit = 0;
+    addr_size inFlight = 0;
+    addr_size peak = 0;
+
+    void acquire(addr_size n);
+    void release(addr_size n);
+};
+
+struct BatchState {
+    const char* const* paths = nullptr;
+    i32 pathsCount = 0;
+    const BatchLoadInfo* info = nullptr;
+    core::AllocatorContext* actx = nullptr;
+
+    std::atomic<i32> nextIdx = 0;
+    ByteBudget budget;
+
+    std::mutex callbackMtx;
+    BatchLoadStats stats;
+};
+
+void workerMain(BatchState& state);
+BatchLoadResult loadOne(BatchState& state, i32 idx);
+bool hasTgaExtension(const char* name, addr_size nameLen);
+
+} // namespace
+
+core::expected<BatchLoadStats, TGAError> loadFilesBatch(const char* const* paths, i32 pathsCount,
+                                                        const BatchLoadInfo& info, core::AllocatorContext& actx) {
+    if (info.callback == nullptr || info.inFlightByteBudget == 0 || info.workerCount < 0 || pathsCount < 0) {
+        logErr("Invalid batch load info");
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+    if (pathsCount > 0 && paths == nullptr) {
+        logErr("paths is null");
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+
+    BatchState state;
+    state.paths = paths;
+    state.pathsCount = pathsCount;
+    state.info = &info;
+    state.actx = &actx;
+    state.budget.limit = info.inFlightByteBudget;
+
+    i32 workerCount = info.workerCount;
+    if (workerCount == 0) {
+        workerCount = core::core_max(i32(std::thread::hardware_concurrency()), 1);
+    }
+    workerCount = core::core_min(core::core_min(workerCount, pathsCount), MAX_WORKERS);
+
+    // The calling thread is one of the workers.
+    std::thread workers[MAX_WORKERS];
+    for (i32 i = 1; i < workerCount; i++) {
+        workers[i] = std::thread([&state]() { workerMain(state); });
+    }
+    if (workerCount > 0) {
+        workerMain(state);
+    }
+    for (i32 i = 1; i < workerCount; i++) {
+        workers[i].join();
+    }
+
+    state.stats.peakInFlightBytes = state.budget.peak;
+    return state.stats;
+}
+
+core::expected<BatchLoadStats, TGAError> loadDirectoryBatch(const char* dirPath, const BatchLoadInfo& info,
+                                                            core::AllocatorContext& actx) {
+    // Two walks: the first sizes a single allocation for all the paths, the second fills it.
+    struct Listing {
+        const char* dirPath;
+        addr_size dirPathLen;
+        i32 count;
+        addr_size charsNeeded;
+
+        char* chars;
+        addr_size charsUsed;
+        const char** paths;
+        i32 filled;
+    };
+
+    Listing listing = {};
+    listing.dirPath = dirPath;
+    listing.dirPathLen = core::cstrLen(dirPath);
+
+    auto countWalk = [](const core::DirEntry& de, addr_size, void* userData) -> bool {
+        Listing& l = *reinterpret_cast<Listing*>(userData);
+        if (de.type != core::FileType::Regular) return true;
+        addr_size nameLen = core::cstrLen(de.name);
+        if (!hasTgaExtension(de.name, nameLen)) return true;
+        l.count++;
+        l.charsNeeded += l.dirPathLen + 1 + nameLen + 1;
+        return true;
+    };
+    if (auto res = core::dirWalk(dirPath, countWalk, &listing); res.hasErr()) {
+        logErr_PltErrorCode(res.err());
+        return core::unexpected(TGAError::FailedToOpenFile);
+    }
+
+    if (listing.count == 0) {
+        return loadFilesBatch(nullptr, 0, info, actx);
+    }
+
+    addr_size pathsBytes = addr_size(listing.count) * sizeof(const char*);
+    listing.chars = reinterpret_cast<char*>(actx.alloc(listing.charsNeeded, sizeof(char)));
+    listing.paths = reinterpret_cast<const char**>(actx.alloc(pathsBytes, sizeof(u8)));
+    defer {
+        actx.free(listing.chars, listing.charsNeeded, sizeof(char));
+        actx.free(listing.paths, pathsBytes, sizeof(u8));
+    };
+
+    auto fillWalk = [](const core::DirEntry& de, addr_size, void* userData) -> bool {
+        Listing& l = *reinterpret_cast<Listing*>(userData);
+        if (de.type != core::FileType::Regular) return true;
+        addr_size nameLen = core::cstrLen(de.name);
+        if (!hasTgaExtension(de.name, nameLen)) return true;
+
+        addr_size pathLen = l.dirPathLen + 1 + nameLen + 1;
+        if (l.filled == l.count || l.charsUsed + pathLen > l.charsNeeded) {
+            return false; // The directory grew between the walks.
+        }
+
+        char* path = l.chars + l.charsUsed;
+        core::memcopy(path, l.dirPath, l.dirPathLen);
+        path[l.dirPathLen] = '/';
+        core::memcopy(path + l.dirPathLen + 1, de.name, nameLen);
+        path[pathLen - 1] = '\0';
+
+        l.paths[l.filled++] = path;
+        l.charsUsed += pathLen;
+        return true;
+    };
+    if (auto res = core::dirWalk(dirPath, fillWalk, &listing); res.hasErr()) {
+        logErr_PltErrorCode(res.err());
+        return core::unexpected(TGAError::FailedToOpenFile);
+    }
+
+    return loadFilesBatch(listing.paths, listing.filled, info, actx);
+}
+
+namespace {
+
+void ByteBudget::acquire(addr_size n) {
+    std::unique_lock lock(mtx);
+    // Something that does not fit the budget at all still goes through, once it has the budget to itself.
+    released.wait(lock, [&]() { return inFlight == 0 || inFlight + n <= limit; });
+    inFlight += n;
+    peak = core::core_max(peak, inFlight);
+}
+
+void ByteBudget::release(addr_size n) {
+    {
+        std::lock_guard lock(mtx);
+        inFlight -= n;
+    }
+    released.notify_all();
+}
+
+void workerMain(BatchState& state) {
+    for (;;) {
+        i32 idx = state.nextIdx.fetch_add(1, std::memory_order_relaxed);
+        if (idx >= state.pathsCount) {
+            return;
+        }
+
+        BatchLoadResult result = loadOne(state, idx);
+
+        std::lock_guard lock(state.callbackMtx);
+        if (result.err == TGAError::Undefined) state.stats.loaded++;
+        else                                   state.stats.failed++;
+        state.info->callback(result, state.info->userData);
+    }
+}
+
+BatchLoadResult loadOne(BatchState& state, i32 idx) {
+    BatchLoadResult result;
+    result.path = state.paths[idx];
+    result.index = idx;
+
+    auto loadRes = loadFileMapped(result.path);
+    if (loadRes.hasErr()) {
+        result.err = loadRes.err();
+        return result;
+    }
+
+    TGAImage tgaImage = std::move(loadRes.value());
+    defer { tgaImage.free(); };
+
+    // Mapping is lazy, so the budget is charged here, before any page is touched: the whole file plus an upper bound
+    // of the decoded pixels.
+    const Header* header = nullptr;
+    if (auto res = tgaImage.header(header); res.hasErr()) {
+        result.err = res.err();
+        return result;
+    }
+    addr_size cost = tgaImage.memory.len() + addr_size(header->width()) * addr_size(header->height()) * 4;
+
+    state.budget.acquire(cost);
+    defer { state.budget.release(cost); };
+
+    auto surfaceRes = createSurfaceFromTgaImage(tgaImage, *state.actx);
+    if (surfaceRes.hasErr()) {
+        result.err = surfaceRes.err();
+        return result;
+    }
+
+    result.surface = std::move(surfaceRes.value());
+    return result;
+}
+
+bool hasTgaExtension(const char* name, addr_size nameLen) {
+    if (nameLen < 4) return false;
+    const char* ext = name + nameLen - 4;
+    auto lower = [](char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; };
+    return ext[0] == '.' && lower(ext[1]) == 't' && lower(ext[2]) == 'g' && lower(ext[3]) == 'a';
+}
+
+} // namespace
+
+} // namespace TGA
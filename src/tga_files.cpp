@@ -1,6 +1,13 @@
 #include "tga_files.h"
 #include "log_utils.h"
 #include "surface.h"
+#include "surface_pool.h"
+#include "surface_scale.h"
+#include "simd_utils.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #define TGA_IS_ERR_FATAL(x) if (x.hasErr() && isFatalError(x.err())) return core::unexpected(x.err());
 
@@ -13,12 +20,77 @@ constexpr auto TRUE_VISION_SIGNATURE = "TRUEVISION-XFILE."_sv;
 
 constexpr bool isFatalError(TGAError err);
 
+constexpr i32 bytesForBits(i32 bits);
 constexpr bool hasSignature(const char signature[18]);
 constexpr core::expected<addr_off, TGAError> parseFooterOffset(u8* begin, u8* end);
 
 PixelFormat pickPixelFormatForTrueColorImage(i32 bytesPerPixel, i32 alphaChannelSize);
+PixelFormat pickPixelFormatForImage(const Header& header);
+Origin originFromDescriptor(i32 originBits);
+bool imageFitsInFile(const Header& header, addr_size fileSize);
+
+core::expected<TGAError> parseImageLayout(TGAImage& tgaImage);
+core::expected<TGAError> decodeImageRows(const TGAImage& tgaImage, i32 rowBegin, Surface& rows, core::AllocatorContext& scratchActx);
+core::expected<TGAError> decodeRle(const u8* src, addr_size srcLen, u8* dst, addr_size dstLen, i32 bpp, bool clipLastPacket = false);
+core::expected<TGAError> decodeRleFrom(const u8* src, addr_size srcLen, addr_size skipPixels, u8* dst, addr_size dstLen, i32 bpp);
+void expandIndices(const u8* indices, i32 indexBytes, addr_size count, const u32* lut, i32 usedEntries, i32 outBpp, u8* out);
+#if SIMD_DISPATCH_ENABLED
+SIMD_TARGET_SSSE3 addr_size expandSmallPaletteIndices_SSSE3(const u8* indices, addr_size count, const u32* lut, i32 usedEntries, u8* out);
+SIMD_TARGET_AVX2 addr_size gatherIndices_AVX2(const u8* indices, addr_size begin, addr_size count, const u32* lut, u8* out);
+#endif
+void expandGray(const u8* src, i32 srcBpp, addr_size count, u8* out);
+
+// Scratch space for run-length encoding rows before they are written.
+struct RowWriteBuffer {
+    u8* data = nullptr;
+    addr_size size = 0;
+    addr_size rowMaxSize = 0;
+
+    void free(core::AllocatorContext& actx);
+};
 
 core::expected<TGAError> createTrueColorFile(const CreateFileFromSurfaceParams& params);
+core::expected<TGAError> makeTrueColorHeader(i32 imageType, i32 width, i32 height, PixelFormat pixelFormat, Origin origin,
+                                             Header& out);
+Footer makeFooter();
+core::expected<TGAError> openOutputFile(const char* path, WriteOnlyFile& out);
+
+// Batches spans of output for gathered writes. A span that starts where the previous one ends is merged into it, so a
+// contiguous surface goes out as a single span. Spans have to stay valid until the next flush.
+struct GatheredWriter {
+    static constexpr i32 MAX_SPANS = 64;
+
+    WriteOnlyFile* file = nullptr;
+    FileWriteSpan spans[MAX_SPANS];
+    i32 spansCount = 0;
+    addr_size bytesPushed = 0; // File offset of the next byte pushed, when the writer started at the beginning.
+
+    core::expected<TGAError> push(const void* data, addr_size size);
+    core::expected<TGAError> flush();
+};
+
+RowWriteBuffer createRowWriteBuffer(i32 width, i32 bpp, core::AllocatorContext& actx);
+// Raw rows are pushed straight from the surface, whatever its pitch. Run-length encoded rows go through the buffer,
+// which is flushed before it is reused and before returning. When rowOffsets is set, it receives the file offset of every
+// row.
+core::expected<TGAError> writeImageRows(GatheredWriter& out, const Surface& rows, bool runLengthEncode,
+                                        RowWriteBuffer& buffer, TGALong* rowOffsets = nullptr);
+
+// Trailing data of a TGA 2.0 file: postage stamp, scan line table and the extension area pointing at them. Everything
+// is owned here so that it stays valid until the gathered writer is flushed.
+struct ExtensionWriteData {
+    ExtensionArea area;
+    Surface postageStamp;
+    u8 postageStampSize[2];
+    core::Memory<TGALong> scanLineTable;
+
+    void free(core::AllocatorContext& actx);
+};
+core::expected<TGAError> pushExtensionArea(GatheredWriter& out, const Surface& surface, i32 postageStampSize,
+                                           ExtensionWriteData& data, core::AllocatorContext& actx);
+
+constexpr addr_size rleRowMaxSize(i32 width, i32 bpp);
+addr_size encodeRleRow(const u8* row, i32 width, i32 bpp, u8* out);
 
 } // namespace
 
@@ -35,6 +107,7 @@ const char* errorToCstr(TGAError err) {
         case TGAError::InvalidArgument:       return "Invalid argument passed";
         case TGAError::UnsupportedImageType:  return "Unsupported image type";
         case TGAError::FailedToCreateSurface: return "Failed to create surface";
+        case TGAError::MissingExtensionData:  return "Missing extension data";
 
         case TGAError::Undefined: [[fallthrough]];
         case TGAError::SENTINEL: [[fallthrough]];
@@ -43,7 +116,11 @@ const char* errorToCstr(TGAError err) {
 }
 
 void TGAImage::free() {
-    if (memory.data()) {
+    if (mapping.isMapped()) {
+        mapping.free();
+        memory = {};
+    }
+    else if (memory.data()) {
         actx->free(memory.data(), memory.len(), sizeof(u8));
         memory = {};
     }
@@ -76,6 +153,52 @@ core::expected<TGAError> TGAImage::footer(const Footer*& out) const {
     return {};
 }
 
+core::expected<TGAError> TGAImage::extensionArea(const ExtensionArea*& out) const {
+    if (extAreaOff <= 0) {
+        return core::unexpected(TGAError::MissingExtensionData);
+    }
+
+    addr_size off = addr_size(extAreaOff);
+    if (off + EXTENSION_AREA_SIZE > memory.len()) {
+        logErr("Extension area extends past the end of the file");
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    const ExtensionArea* ext = reinterpret_cast<const ExtensionArea*>(memory.data() + off);
+    if (ext->extensionSize < EXTENSION_AREA_SIZE) {
+        logErr("Unexpected extension area size: {}", i32(ext->extensionSize));
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    out = ext;
+    return {};
+}
+
+core::expected<TGAError> TGAImage::scanLineOffset(i32 row, addr_off& out) const {
+    const ExtensionArea* ext = nullptr;
+    if (auto res = extensionArea(ext); res.hasErr()) return res;
+    if (ext->scanLineOffset == 0) {
+        return core::unexpected(TGAError::MissingExtensionData);
+    }
+
+    const Header* h = nullptr;
+    if (auto res = header(h); res.hasErr()) return res;
+    if (row < 0 || row >= h->height()) {
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+
+    addr_size off = addr_size(ext->scanLineOffset);
+    if (off + addr_size(h->height()) * sizeof(TGALong) > memory.len()) {
+        logErr("Scan line table extends past the end of the file");
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    // The table has no alignment guarantees.
+    const u8* entry = memory.data() + off + addr_size(row) * sizeof(TGALong);
+    out = addr_off(u32(entry[0]) | (u32(entry[1]) << 8) | (u32(entry[2]) << 16) | (u32(entry[3]) << 24));
+    return {};
+}
+
 FileType TGAImage::fileType() const {
     return footerOff != -1 ? FileType::New : FileType::Original;
 }
@@ -129,131 +252,277 @@ core::expected<TGAImage, TGAError> loadFile(const char* path, core::AllocatorCon
         }
     }
 
-    // Parse the footer
-    auto footerOffsetRes = parseFooterOffset(memory.data(), memory.end());
-    TGA_IS_ERR_FATAL(footerOffsetRes);
-    tgaImage.footerOff = footerOffsetRes.hasValue() ? footerOffsetRes.value() : -1;
+    if (auto res = parseImageLayout(tgaImage); res.hasErr()) {
+        tgaImage.free();
+        return core::unexpected(res.err());
+    }
 
-    if (tgaImage.footerOff > 0) {
-        const Footer* f = nullptr;
-        auto footerRes = tgaImage.footer(f);
-        TGA_IS_ERR_FATAL(footerRes);
-        tgaImage.developerAreaOff = f->developerDirectoryOffset;
-        tgaImage.extAreaOff = f->extensionAreaOffset;
+    return tgaImage;
+}
+
+core::expected<TGAImage, TGAError> loadFileMapped(const char* path) {
+    TGAImage tgaImage;
+
+    auto mapRes = mapFile(path, MappingAccessHint::Normal);
+    if (mapRes.hasErr()) {
+        logErr("Failed to map file: \"{}\"; reason: {}", path, errorToCstr(mapRes.err()));
+        switch (mapRes.err()) {
+            case FileMappingError::FailedToOpenFile: return core::unexpected(TGAError::FailedToOpenFile);
+            case FileMappingError::FailedToStatFile: return core::unexpected(TGAError::FailedToStatFile);
+            case FileMappingError::EmptyFile:        return core::unexpected(TGAError::InvalidFileFormat);
+            default:                                 return core::unexpected(TGAError::FailedToReadFile);
+        }
     }
 
-    // Parse the header
-    const Header* h = nullptr;
-    if (auto res = tgaImage.header(h); res.hasErr()) {
+    tgaImage.mapping = std::move(mapRes.value());
+    tgaImage.memory = tgaImage.mapping.memory;
+
+    if (auto res = parseImageLayout(tgaImage); res.hasErr()) {
+        tgaImage.free();
         return core::unexpected(res.err());
     }
 
-    // Parse the image/color map data area
-    {
-        addr_off curr = tgaImage.imageColorMapDataAreaOff;
+    return tgaImage;
+}
 
-        if (h->idLength > 0) {
-            tgaImage.imageIdOff = curr;
-            curr += h->idLength;
-        }
-        else {
-            tgaImage.imageIdOff = -1;
-        }
+core::expected<ProbeInfo, TGAError> probeFile(const char* path) {
+    auto openRes = openReadOnlyFile(path);
+    if (openRes.hasErr()) {
+        logErr("Failed to open file: \"{}\"; reason: {}", path, errorToCstr(openRes.err()));
+        return core::unexpected(openRes.err() == FileMappingError::FailedToStatFile ? TGAError::FailedToStatFile
+                                                                                      : TGAError::FailedToOpenFile);
+    }
+    ReadOnlyFile file = openRes.value();
+    defer { file.free(); };
 
-        if (h->colorMapType == 1) {
-            tgaImage.colorMapDataOff = curr;
-            [[maybe_unused]] i32 firstEntryIdx = h->colorMapFirstEntryIdx();
-            i32 colorMapCount = h->colorMapLength();
-            i32 colorMapEntrySize = h->colorMapEntrySize();
-            curr += colorMapCount * colorMapEntrySize;
+    if (file.size < sizeof(Header)) {
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    Header header;
+    if (auto res = readFileAt(file, 0, &header, sizeof(Header)); res.hasErr()) {
+        return core::unexpected(TGAError::FailedToReadFile);
+    }
+
+    ProbeInfo info;
+    info.fileSize = file.size;
+    info.fileType = FileType::Original;
+    if (file.size >= sizeof(Header) + sizeof(Footer)) {
+        Footer footer;
+        if (auto res = readFileAt(file, file.size - sizeof(Footer), &footer, sizeof(Footer)); res.hasErr()) {
+            return core::unexpected(TGAError::FailedToReadFile);
         }
-        else {
-            tgaImage.colorMapDataOff = -1;
+        if (hasSignature(footer.signature)) {
+            info.fileType = FileType::New;
         }
-
-        tgaImage.imageDataOff = curr;
     }
 
-    if (!tgaImage.isValid()) {
+    info.pixelFormat = pickPixelFormatForImage(header);
+    if (info.pixelFormat == PixelFormat::Unknown) {
+        return core::unexpected(TGAError::UnsupportedImageType);
+    }
+    if (!imageFitsInFile(header, file.size)) {
         return core::unexpected(TGAError::InvalidFileFormat);
     }
 
-    return tgaImage;
+    info.imageType = header.imageType;
+    info.width = header.width();
+    info.height = header.height();
+    info.origin = originFromDescriptor(header.origin());
+    return info;
 }
 
 core::expected<Surface, TGAError> createSurfaceFromTgaImage(const TGA::TGAImage& tgaImage, core::AllocatorContext& actx) {
-    using namespace TGA;
+    auto descRes = describeSurfaceForTgaImage(tgaImage);
+    if (descRes.hasErr()) return core::unexpected(descRes.err());
 
-    if (!tgaImage.isValid()) {
-        logErr("Tga file is invalid");
+    Surface surface = descRes.value();
+    u8* data = reinterpret_cast<u8*>(actx.alloc(addr_size(surface.size()), sizeof(u8)));
+    surface.actx = &actx;
+    surface.data = data;
+
+    if (auto res = decodeImageRows(tgaImage, 0, surface, actx); res.hasErr()) {
+        surface.free();
         return core::unexpected(TGAError::FailedToCreateSurface);
     }
 
-    const Header* header;
-    if (auto res = tgaImage.header(header); res.hasErr()) {
-        logErr("Failed to parse header");
+    return surface;
+}
+
+core::expected<Surface, TGAError> createSurfaceFromTgaImage(const TGA::TGAImage& tgaImage, SurfacePool& pool) {
+    auto descRes = describeSurfaceForTgaImage(tgaImage);
+    if (descRes.hasErr()) return core::unexpected(descRes.err());
+
+    const Surface& desc = descRes.value();
+    auto acquireRes = pool.acquire(desc.width, desc.height, desc.pixelFormat, desc.origin);
+    if (acquireRes.hasErr()) {
+        logErr("Failed to acquire a surface from the pool; reason: {}", errorToCstr(acquireRes.err()));
         return core::unexpected(TGAError::FailedToCreateSurface);
     }
 
-    i32 height = header->height();
-    i32 width = header->width();
-    i32 pixelDepthInBits = header->pixelDepth();
-    i32 bytesPerPixel = i32(f32(pixelDepthInBits) / f32(core::BYTE_SIZE) + 0.5f);
-    i32 pitch = bytesPerPixel * width;
-    i32 alphaChannelSize = header->alphaBits();
+    Surface surface = acquireRes.value();
+    Assert(surface.pitch == desc.pitch, "BUG: pool surface has a different layout");
 
-    addr_size imageSize = addr_size(pitch) * addr_size(height);
-    if (imageSize == 0) {
-        logErr("Image size is 0");
+    if (auto res = decodeImageRows(tgaImage, 0, surface, DEF_ALLOC); res.hasErr()) {
+        [[maybe_unused]] auto releaseRes = pool.release(surface);
         return core::unexpected(TGAError::FailedToCreateSurface);
     }
 
-    u8* data = reinterpret_cast<u8*>(actx.alloc(imageSize, sizeof(u8)));
+    return surface;
+}
 
-    PixelFormat pixelFormat = PixelFormat::Unknown;
+core::expected<Surface, TGAError> createSurfaceByAdoptingTgaImage(TGA::TGAImage&& tgaImage, core::AllocatorContext& actx) {
+    auto descRes = describeSurfaceForTgaImage(tgaImage);
+    if (descRes.hasErr()) return core::unexpected(descRes.err());
+
+    const Header* header = nullptr;
+    if (auto res = tgaImage.header(header); res.hasErr()) return core::unexpected(res.err());
+
+    // Only uncompressed true color pixels are stored the way the surface wants them, and only a buffer that came from
+    // an allocator can be handed over. Everything else is decoded into a new buffer.
+    bool canAdopt = header->imageType == 2 && !tgaImage.mapping.isMapped() && tgaImage.actx != nullptr;
+    if (!canAdopt) {
+        auto surfaceRes = createSurfaceFromTgaImage(tgaImage, actx);
+        if (surfaceRes.hasErr()) return core::unexpected(surfaceRes.err());
+        tgaImage.free();
+        return surfaceRes;
+    }
 
-    switch (header->imageType) {
-        case 2:
-            // True Color Image
-            pixelFormat = pickPixelFormatForTrueColorImage(bytesPerPixel, alphaChannelSize);
-            break;
+    Surface surface = descRes.value();
+    surface.actx = tgaImage.actx;
+    surface.data = &tgaImage.memory[addr_size(tgaImage.imageDataOff)];
+    surface.adoptedMemory = tgaImage.memory;
+
+    tgaImage.memory = {};
+    tgaImage.free();
+    return surface;
+}
 
-        // TODO2: [Support] Do I care for any other image type?
-        // TODO2: [Support] Decode if run-length encoded (RLE).
+core::expected<Surface, TGAError> createSurfaceViewFromTgaImage(const TGA::TGAImage& tgaImage) {
+    auto descRes = describeSurfaceForTgaImage(tgaImage);
+    if (descRes.hasErr()) return core::unexpected(descRes.err());
 
-        default:
-            logErr("Unsupported tga image type: {}", i32(header->imageType));
-            return core::unexpected(TGAError::FailedToCreateSurface);
+    const Header* header = nullptr;
+    if (auto res = tgaImage.header(header); res.hasErr()) return core::unexpected(res.err());
+    if (header->imageType != 2) {
+        logErr("Only uncompressed images can be viewed; image type: {}", i32(header->imageType));
+        return core::unexpected(TGAError::UnsupportedImageType);
     }
 
+    Surface surface = descRes.value();
+    surface.actx = nullptr;
+    surface.data = const_cast<u8*>(&tgaImage.memory[addr_size(tgaImage.imageDataOff)]);
+    return surface;
+}
+
+core::expected<Surface, TGAError> describeSurfaceForTgaImage(const TGA::TGAImage& tgaImage) {
+    if (!tgaImage.isValid()) {
+        logErr("Tga file is invalid");
+        return core::unexpected(TGAError::FailedToCreateSurface);
+    }
+
+    const Header* header;
+    if (auto res = tgaImage.header(header); res.hasErr()) {
+        logErr("Failed to parse header");
+        return core::unexpected(TGAError::FailedToCreateSurface);
+    }
+
+    PixelFormat pixelFormat = pickPixelFormatForImage(*header);
     if (pixelFormat == PixelFormat::Unknown) {
         logErr("pixel format unknown");
         return core::unexpected(TGAError::FailedToCreateSurface);
     }
 
-    addr_size imageDataOff = addr_size(tgaImage.imageDataOff);
-    core::memcopy(data, &tgaImage.memory[imageDataOff], imageSize);
-
-    Origin origin = Origin::Undefined;
-    switch (header->origin()) {
-        case 0b00: origin = Origin::BottomLeft;  break;
-        case 0b01: origin = Origin::BottomRight; break;
-        case 0b10: origin = Origin::TopLeft;     break;
-        case 0b11: origin = Origin::TopRight;    break;
-        default:   origin = Origin::Undefined;   break;
+    if (!imageFitsInFile(*header, tgaImage.memory.len())) {
+        return core::unexpected(TGAError::FailedToCreateSurface);
     }
 
+    i32 width = header->width();
+    i32 height = header->height();
+
     Surface surface = Surface();
-    surface.actx = &actx;
-    surface.origin = origin;
+    surface.origin = originFromDescriptor(header->origin());
     surface.pixelFormat = pixelFormat;
     surface.width = width;
     surface.height = height;
-    surface.pitch = pitch;
-    surface.data = data;
+    surface.pitch = pixelFormatBytesPerPixel(pixelFormat) * width;
     return surface;
 }
 
+core::expected<TGAError> decodeTgaImageRows(const TGA::TGAImage& tgaImage, i32 rowBegin, Surface& rows,
+                                            core::AllocatorContext& scratchActx) {
+    auto descRes = describeSurfaceForTgaImage(tgaImage);
+    if (descRes.hasErr()) return core::unexpected(descRes.err());
+
+    const Surface& desc = descRes.value();
+    bool fits = rows.data != nullptr && rows.isContiguous() &&
+                rows.width == desc.width && rows.pixelFormat == desc.pixelFormat &&
+                rowBegin >= 0 && rows.height >= 0 && rowBegin + rows.height <= desc.height;
+    if (!fits) {
+        logErr("Rows [{}, {}) don't fit the image", rowBegin, rowBegin + rows.height);
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+
+    return decodeImageRows(tgaImage, rowBegin, rows, scratchActx);
+}
+
+core::expected<Surface, TGAError> createPostageStampFromTgaImage(const TGA::TGAImage& tgaImage, core::AllocatorContext& actx) {
+    auto descRes = describeSurfaceForTgaImage(tgaImage);
+    if (descRes.hasErr()) return core::unexpected(descRes.err());
+
+    const ExtensionArea* ext = nullptr;
+    if (auto res = tgaImage.extensionArea(ext); res.hasErr()) return core::unexpected(res.err());
+    if (ext->postageStampOffset == 0) {
+        return core::unexpected(TGAError::MissingExtensionData);
+    }
+
+    const Header* header = nullptr;
+    if (auto res = tgaImage.header(header); res.hasErr()) return core::unexpected(res.err());
+
+    // The stamp is stored like the image but uncompressed, so for color-mapped images it would be indices.
+    i32 imageType = header->imageType;
+    bool isGray = imageType == 3 || imageType == 11;
+    if (imageType != 2 && imageType != 10 && !isGray) {
+        logErr("Postage stamps are not supported for image type: {}", imageType);
+        return core::unexpected(TGAError::UnsupportedImageType);
+    }
+
+    addr_size off = addr_size(ext->postageStampOffset);
+    if (off + 2 > tgaImage.memory.len()) {
+        logErr("Postage stamp extends past the end of the file");
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    Surface stamp = descRes.value();
+    stamp.width = tgaImage.memory[off];
+    stamp.height = tgaImage.memory[off + 1];
+    stamp.pitch = stamp.bpp() * stamp.width;
+    if (stamp.width == 0 || stamp.height == 0) {
+        logErr("Empty postage stamp");
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    const i32 storedBpp = bytesForBits(header->pixelDepth());
+    const addr_size pixelCount = addr_size(stamp.width) * addr_size(stamp.height);
+    if (off + 2 + pixelCount * addr_size(storedBpp) > tgaImage.memory.len()) {
+        logErr("Postage stamp extends past the end of the file");
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    stamp.actx = &actx;
+    stamp.data = reinterpret_cast<u8*>(actx.alloc(addr_size(stamp.size()), sizeof(u8)));
+
+    const u8* src = &tgaImage.memory[off + 2];
+    if (isGray) {
+        expandGray(src, storedBpp, pixelCount, stamp.data);
+    }
+    else {
+        core::memcopy(stamp.data, src, addr_size(stamp.size()));
+    }
+
+    return stamp;
+}
+
 core::expected<TGAError> createFileFromSurface(const CreateFileFromSurfaceParams& params) {
     if (params.surface.size() == 0) {
         logErr("Surface size is 0");
@@ -266,12 +535,18 @@ core::expected<TGAError> createFileFromSurface(const CreateFileFromSurfaceParams
         return core::unexpected(TGAError::InvalidArgument);
     }
 
+    bool wantsExtensionArea = params.writeScanLineTable || params.postageStampSize > 0;
+    if (wantsExtensionArea && params.fileType != FileType::New) {
+        logErr("Only new (TGA 2.0) files have an extension area");
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+
     switch (params.imageType) {
-        case 2:
+        case 2:  [[fallthrough]];
+        case 10:
             return createTrueColorFile(params);
 
         // TODO2: [Support] Do I cae for any other image type?
-        // TODO2: [Support] Run-length encoding (RLE).
 
         default:
             logErr("Unsupported image type = {}", params.imageType);
@@ -281,6 +556,217 @@ core::expected<TGAError> createFileFromSurface(const CreateFileFromSurfaceParams
     return {};
 }
 
+struct StreamWriter::State {
+    core::AllocatorContext* actx = nullptr;
+
+    WriteOnlyFile file;
+    GatheredWriter out;
+    Surface surface;
+    bool runLengthEncode = false;
+    FileType fileType = FileType::Unknown;
+    RowWriteBuffer buffer;
+
+    // Only touched by the submitting thread.
+    i32 nextRow = 0;
+
+    // Ring buffer of bands waiting to be written, guarded by mtx. A band leaves the queue once it is on disk, so the
+    // one being written counts against the queue depth as well.
+    std::mutex mtx;
+    std::condition_variable bandQueued;
+    std::condition_variable bandWritten;
+    Surface* queue = nullptr;
+    i32 queueCapacity = 0;
+    i32 queueHead = 0;
+    i32 queueCount = 0;
+    bool closing = false;
+    TGAError firstError = TGAError::Undefined;
+
+    std::thread ioThread;
+
+    void ioThreadMain();
+};
+
+core::expected<StreamWriter, TGAError> createStreamWriter(const StreamWriterCreateInfo& info, core::AllocatorContext& actx) {
+    const Surface& surface = info.surface;
+
+    if (info.path == nullptr || surface.data == nullptr || surface.size() == 0) {
+        logErr("Invalid stream writer surface or path");
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+    if (info.imageType != 2 && info.imageType != 10) {
+        logErr("Unsupported image type = {}", info.imageType);
+        return core::unexpected(TGAError::UnsupportedImageType);
+    }
+    if (info.fileType != FileType::New && info.fileType != FileType::Original) {
+        logErr("Invalid file type = {}", info.fileType);
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+    if (info.maxQueuedBands < 1) {
+        logErr("maxQueuedBands must be at least 1");
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+
+    Header header = {};
+    if (auto res = makeTrueColorHeader(info.imageType, surface.width, surface.height, surface.pixelFormat, surface.origin, header);
+        res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    WriteOnlyFile file;
+    if (auto res = openOutputFile(info.path, file); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    {
+        GatheredWriter out = { .file = &file };
+        auto res = out.push(&header, sizeof(Header));
+        if (!res.hasErr()) res = out.flush();
+        if (res.hasErr()) {
+            file.free();
+            return core::unexpected(res.err());
+        }
+    }
+
+    auto* state = reinterpret_cast<StreamWriter::State*>(actx.alloc(1, sizeof(StreamWriter::State)));
+    new (state) StreamWriter::State();
+    state->actx = &actx;
+    state->file = file;
+    state->out.file = &state->file;
+    state->surface = surface.view();
+    state->runLengthEncode = info.imageType == 10;
+    state->fileType = info.fileType;
+    if (state->runLengthEncode) {
+        state->buffer = createRowWriteBuffer(surface.width, surface.bpp(), actx);
+    }
+    state->queueCapacity = info.maxQueuedBands;
+    state->queue = reinterpret_cast<Surface*>(actx.alloc(addr_size(info.maxQueuedBands), sizeof(Surface)));
+    state->ioThread = std::thread([state]() { state->ioThreadMain(); });
+
+    StreamWriter writer;
+    writer.state = state;
+    return writer;
+}
+
+core::expected<TGAError> StreamWriter::submitRows(i32 rowBegin, i32 rowCount) {
+    Assert(state != nullptr, "stream writer is not initialized");
+
+    if (rowBegin != state->nextRow || rowCount <= 0 || rowBegin + rowCount > state->surface.height) {
+        logErr("Rows must be submitted in order; expected row {}, got [{}, {})", state->nextRow, rowBegin, rowBegin + rowCount);
+        return core::unexpected(TGAError::InvalidArgument);
+    }
+
+    Surface band = state->surface.view();
+    band.data = state->surface.row(rowBegin);
+    band.height = rowCount;
+
+    {
+        std::unique_lock lock(state->mtx);
+        state->bandWritten.wait(lock, [this]() {
+            return state->queueCount < state->queueCapacity || state->firstError != TGAError::Undefined;
+        });
+        if (state->firstError != TGAError::Undefined) {
+            return core::unexpected(state->firstError);
+        }
+
+        i32 tail = (state->queueHead + state->queueCount) % state->queueCapacity;
+        state->queue[tail] = band;
+        state->queueCount++;
+    }
+    state->bandQueued.notify_one();
+
+    state->nextRow += rowCount;
+    return {};
+}
+
+core::expected<TGAError> StreamWriter::finish() {
+    Assert(state != nullptr, "stream writer is not initialized");
+
+    {
+        std::lock_guard lock(state->mtx);
+        state->closing = true;
+    }
+    state->bandQueued.notify_one();
+    state->ioThread.join();
+
+    TGAError err = state->firstError;
+    if (err == TGAError::Undefined && state->nextRow != state->surface.height) {
+        logErr("Stream writer finished after {} of {} rows", state->nextRow, state->surface.height);
+        err = TGAError::ApplicationBug;
+    }
+    if (err == TGAError::Undefined) {
+        // Every band is on disk once the I/O thread is joined, only the footer is left.
+        Footer footer = makeFooter();
+        core::expected<TGAError> res = {};
+        if (state->fileType == FileType::New) res = state->out.push(&footer, sizeof(Footer));
+        if (!res.hasErr()) res = state->out.flush();
+        if (res.hasErr()) err = res.err();
+    }
+
+    free();
+
+    if (err != TGAError::Undefined) {
+        return core::unexpected(err);
+    }
+    return {};
+}
+
+void StreamWriter::free() {
+    if (state == nullptr) return;
+
+    if (state->ioThread.joinable()) {
+        // Abandoned without finish(); let the I/O thread drain what was already queued.
+        {
+            std::lock_guard lock(state->mtx);
+            state->closing = true;
+        }
+        state->bandQueued.notify_one();
+        state->ioThread.join();
+    }
+
+    core::AllocatorContext* actx = state->actx;
+    state->file.free();
+    state->buffer.free(*actx);
+    actx->free(state->queue, addr_size(state->queueCapacity), sizeof(Surface));
+    state->~State();
+    actx->free(state, 1, sizeof(StreamWriter::State));
+    state = nullptr;
+}
+
+void StreamWriter::State::ioThreadMain() {
+    for (;;) {
+        Surface band;
+        bool failed;
+        {
+            std::unique_lock lock(mtx);
+            bandQueued.wait(lock, [this]() { return queueCount > 0 || closing; });
+            if (queueCount == 0) {
+                return;
+            }
+            band = queue[queueHead];
+            failed = firstError != TGAError::Undefined;
+        }
+
+        // After a failure the remaining bands are dropped, but still dequeued so the submitter never blocks forever.
+        core::expected<TGAError> res = {};
+        // Raw rows of a contiguous surface merge into the span of the previous band, so without a flush here nothing
+        // would reach the file before finish().
+        if (!failed) {
+            res = writeImageRows(out, band, runLengthEncode, buffer);
+            if (!res.hasErr()) res = out.flush();
+        }
+
+        {
+            std::lock_guard lock(mtx);
+            if (res.hasErr() && firstError == TGAError::Undefined) {
+                firstError = res.err();
+            }
+            queueHead = (queueHead + 1) % queueCapacity;
+            queueCount--;
+        }
+        bandWritten.notify_one();
+    }
+}
+
 namespace
 {
 
@@ -298,6 +784,7 @@ constexpr bool isFatalError(TGAError err) {
         case TGAError::InvalidArgument:       return true;
         case TGAError::UnsupportedImageType:  return true;
         case TGAError::FailedToCreateSurface: return true;
+        case TGAError::MissingExtensionData:  return false;
 
         case TGAError::Undefined: [[fallthrough]];
         case TGAError::SENTINEL: [[fallthrough]];
@@ -305,6 +792,10 @@ constexpr bool isFatalError(TGAError err) {
     }
 }
 
+constexpr i32 bytesForBits(i32 bits) {
+    return (bits + core::BYTE_SIZE - 1) / core::BYTE_SIZE;
+}
+
 constexpr bool hasSignature(const char signature[18]) {
     return core::memcmp(signature, 17, TRUE_VISION_SIGNATURE.data(), TRUE_VISION_SIGNATURE.len()) == 0;
 }
@@ -368,37 +859,584 @@ error:
     return PixelFormat::Unknown;
 }
 
-core::expected<TGAError> createTrueColorFile(const CreateFileFromSurfaceParams& params) {
-    auto openRes = core::fileOpen(params.path,
-        core::OpenMode::Read | core::OpenMode::Write | core::OpenMode::Truncate | core::OpenMode::Create);
-    if (openRes.hasErr()) {
-        logErr_PltErrorCode(openRes.err());
-        return core::unexpected(TGAError::FailedToOpenFile);
+PixelFormat pickPixelFormatForImage(const Header& header) {
+    i32 pixelDepthInBits = header.pixelDepth();
+    i32 bytesPerPixel = bytesForBits(pixelDepthInBits);
+    i32 alphaChannelSize = header.alphaBits();
+
+    switch (header.imageType) {
+        case 2:  [[fallthrough]];
+        case 10:
+            // True Color Image, raw or run-length encoded
+            return pickPixelFormatForTrueColorImage(bytesPerPixel, alphaChannelSize);
+
+        case 1: [[fallthrough]];
+        case 9:
+            // Color-mapped Image, raw or run-length encoded. Pixels are indices into the color map and decode to the
+            // format of its entries.
+            if (header.colorMapType != 1) {
+                logErr("Color-mapped image without a color map");
+                return PixelFormat::Unknown;
+            }
+            if (bytesPerPixel != 1 && bytesPerPixel != 2) {
+                logErr("Unsupported color map index size: {} bits", pixelDepthInBits);
+                return PixelFormat::Unknown;
+            }
+            return pickPixelFormatForTrueColorImage(bytesForBits(header.colorMapEntrySize()), alphaChannelSize);
+
+        case 3:  [[fallthrough]];
+        case 11:
+            // Black and white Image, raw or run-length encoded: 8 bit gray, optionally followed by 8 bits of alpha.
+            if (bytesPerPixel == 1 && alphaChannelSize == 0) return PixelFormat::BGRX8888;
+            if (bytesPerPixel == 2 && alphaChannelSize == 8) return PixelFormat::BGRA8888;
+            logErr("Unsupported black and white pixel: {} bits, {} alpha bits", pixelDepthInBits, alphaChannelSize);
+            return PixelFormat::Unknown;
+
+        default:
+            logErr("Unsupported tga image type: {}", i32(header.imageType));
+            return PixelFormat::Unknown;
+    }
+}
+
+bool imageFitsInFile(const Header& header, addr_size fileSize) {
+    // Size of the image data as stored, which for color-mapped and black-and-white images is less than the decoded size.
+    addr_size imageSize = addr_size(bytesForBits(header.pixelDepth())) * addr_size(header.width()) * addr_size(header.height());
+    if (imageSize == 0) {
+        logErr("Image size is 0");
+        return false;
     }
 
-    core::FileDesc file = std::move(openRes.value());
+    addr_size colorMapDataOff = sizeof(Header) + addr_size(header.idLength);
+    addr_size colorMapSize = 0;
+    if (header.colorMapType == 1) {
+        colorMapSize = addr_size(header.colorMapLength()) * addr_size(bytesForBits(header.colorMapEntrySize()));
+    }
+    if (colorMapDataOff + colorMapSize > fileSize) {
+        logErr("Color map extends past the end of the file");
+        return false;
+    }
+
+    // The size of run-length encoded data is not known up front; the decoder checks every packet instead.
+    bool isRunLengthEncoded = header.imageType >= 9;
+    addr_size imageDataOff = colorMapDataOff + colorMapSize;
+    if (!isRunLengthEncoded && imageDataOff + imageSize > fileSize) {
+        logErr("Image data extends past the end of the file");
+        return false;
+    }
+
+    return true;
+}
+
+Origin originFromDescriptor(i32 originBits) {
+    switch (originBits) {
+        case 0b00: return Origin::BottomLeft;
+        case 0b01: return Origin::BottomRight;
+        case 0b10: return Origin::TopLeft;
+        case 0b11: return Origin::TopRight;
+        default:   return Origin::Undefined;
+    }
+}
+
+core::expected<TGAError> parseImageLayout(TGAImage& tgaImage) {
+    auto& memory = tgaImage.memory;
+
+    // Parse the footer
+    auto footerOffsetRes = parseFooterOffset(memory.data(), memory.end());
+    TGA_IS_ERR_FATAL(footerOffsetRes);
+    tgaImage.footerOff = footerOffsetRes.hasValue() ? footerOffsetRes.value() : -1;
+
+    if (tgaImage.footerOff > 0) {
+        const Footer* f = nullptr;
+        auto footerRes = tgaImage.footer(f);
+        TGA_IS_ERR_FATAL(footerRes);
+        tgaImage.developerAreaOff = f->developerDirectoryOffset;
+        tgaImage.extAreaOff = f->extensionAreaOffset;
+    }
+
+    // Parse the header
+    const Header* h = nullptr;
+    if (auto res = tgaImage.header(h); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    // Parse the image/color map data area
+    {
+        addr_off curr = tgaImage.imageColorMapDataAreaOff;
+
+        if (h->idLength > 0) {
+            tgaImage.imageIdOff = curr;
+            curr += h->idLength;
+        }
+        else {
+            tgaImage.imageIdOff = -1;
+        }
+
+        if (h->colorMapType == 1) {
+            tgaImage.colorMapDataOff = curr;
+            [[maybe_unused]] i32 firstEntryIdx = h->colorMapFirstEntryIdx();
+            i32 colorMapCount = h->colorMapLength();
+            i32 colorMapEntryBytes = bytesForBits(h->colorMapEntrySize());
+            curr += colorMapCount * colorMapEntryBytes;
+        }
+        else {
+            tgaImage.colorMapDataOff = -1;
+        }
+
+        tgaImage.imageDataOff = curr;
+    }
+
+    if (!tgaImage.isValid()) {
+        return core::unexpected(TGAError::InvalidFileFormat);
+    }
+
+    return {};
+}
+
+core::expected<TGAError> decodeImageRows(const TGAImage& tgaImage, i32 rowBegin, Surface& surface, core::AllocatorContext& scratchActx) {
+    Assert(surface.isContiguous(), "BUG: image data is decoded into a contiguous surface");
+
+    const Header* header = nullptr;
+    if (auto res = tgaImage.header(header); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    const i32 imageType = header->imageType;
+    const bool isRunLengthEncoded = imageType >= 9;
+    const i32 storedBpp = bytesForBits(header->pixelDepth());
+    const addr_size pixelCount = addr_size(surface.width) * addr_size(surface.height);
+    const addr_size firstPixel = addr_size(rowBegin) * addr_size(surface.width);
+
+    addr_size imageDataOff = addr_size(tgaImage.imageDataOff);
+    const u8* src = &tgaImage.memory[imageDataOff];
+    addr_size srcLen = tgaImage.memory.len() - imageDataOff;
+    if (tgaImage.footerOff > tgaImage.imageDataOff) {
+        // Don't let packets run into the footer.
+        srcLen = core::core_min(srcLen, addr_size(tgaImage.footerOff) - imageDataOff);
+    }
+
+    // Raw rows are found by offset. Run-length encoded rows are found through the scan line table if there is a usable
+    // one, otherwise by skipping the packets of the rows before them.
+    addr_size skipPixels = 0;
+    if (!isRunLengthEncoded) {
+        src += firstPixel * addr_size(storedBpp);
+    }
+    else if (rowBegin > 0) {
+        addr_off tableOff = -1;
+        bool hasTable = !tgaImage.scanLineOffset(rowBegin, tableOff).hasErr() &&
+                        addr_size(tableOff) >= imageDataOff && addr_size(tableOff) - imageDataOff < srcLen;
+        if (hasTable) {
+            addr_size rowOff = addr_size(tableOff) - imageDataOff;
+            src += rowOff;
+            srcLen -= rowOff;
+        }
+        else {
+            skipPixels = firstPixel;
+        }
+    }
+
+    // Packets may cross scan lines, so only a decode that ends with the image can insist on the last packet ending there.
+    const bool endsWithImage = rowBegin + surface.height == header->height();
+    auto decodeRleRows = [&](u8* dst, addr_size dstLen) -> core::expected<TGAError> {
+        auto res = (skipPixels == 0 && endsWithImage) ? decodeRle(src, srcLen, dst, dstLen, storedBpp)
+                                                      : decodeRleFrom(src, srcLen, skipPixels, dst, dstLen, storedBpp);
+        if (res.hasErr()) {
+            logErr("Malformed run-length encoded image data");
+        }
+        return res;
+    };
+
+    if (imageType == 2 || imageType == 10) {
+        if (!isRunLengthEncoded) {
+            core::memcopy(surface.data, src, addr_size(surface.size()));
+            return {};
+        }
+
+        return decodeRleRows(surface.data, addr_size(surface.size()));
+    }
+
+    // Color-mapped and black-and-white pixels are first brought to their stored (index or gray) form and then expanded
+    // into the surface.
+    const u8* stored = src;
+    core::Memory<u8> storedScratch;
+    defer {
+        if (storedScratch.data()) core::memoryFree(std::move(storedScratch), scratchActx);
+    };
+    if (isRunLengthEncoded) {
+        storedScratch = core::memoryZeroAllocate<u8>(pixelCount * addr_size(storedBpp), scratchActx);
+        if (auto res = decodeRleRows(storedScratch.data(), storedScratch.len()); res.hasErr()) {
+            return res;
+        }
+        stored = storedScratch.data();
+    }
+
+    if (imageType == 3 || imageType == 11) {
+        expandGray(stored, storedBpp, pixelCount, surface.data);
+        return {};
+    }
+
+    // Pre-convert the color map to surface pixels, indexed directly by the stored index. Indices outside of the color map
+    // decode to zero.
+    const i32 entryBytes = bytesForBits(header->colorMapEntrySize());
+    const i32 lutLen = storedBpp == 1 ? 256 : 65536;
+    const i32 firstEntry = header->colorMapFirstEntryIdx();
+    const i32 usedEntries = core::core_min(lutLen, firstEntry + header->colorMapLength());
+
+    core::Memory<u32> lut = core::memoryZeroAllocate<u32>(addr_size(lutLen), scratchActx);
+    defer { core::memoryFree(std::move(lut), scratchActx); };
+    {
+        const u8* entry = &tgaImage.memory[addr_size(tgaImage.colorMapDataOff)];
+        for (i32 i = firstEntry; i < usedEntries; i++, entry += entryBytes) {
+            u32 v = 0;
+            for (i32 b = 0; b < entryBytes; b++) {
+                v |= u32(entry[b]) << (b * core::BYTE_SIZE);
+            }
+            lut[addr_size(i)] = v;
+        }
+    }
+
+    expandIndices(stored, storedBpp, pixelCount, lut.data(), usedEntries, surface.bpp(), surface.data);
+    return {};
+}
+
+void expandIndices(const u8* indices, i32 indexBytes, addr_size count, const u32* lut, i32 usedEntries, i32 outBpp, u8* out) {
+    addr_size i = 0;
+
+#if SIMD_DISPATCH_ENABLED
+    if (indexBytes == 1 && outBpp == 4) {
+        if (usedEntries <= 16 && simdHasSsse3()) {
+            i = expandSmallPaletteIndices_SSSE3(indices, count, lut, usedEntries, out);
+        }
+        if (simdHasAvx2()) {
+            i = gatherIndices_AVX2(indices, i, count, lut, out);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        u32 idx = indexBytes == 1 ? u32(indices[i]) : u32(indices[2*i]) | (u32(indices[2*i + 1]) << 8);
+        u32 v = lut[idx];
+        u8* dst = out + i * addr_size(outBpp);
+        for (i32 b = 0; b < outBpp; b++) {
+            dst[b] = u8(v >> (b * core::BYTE_SIZE));
+        }
+    }
+}
+
+#if SIMD_DISPATCH_ENABLED
+// Small palette: the whole color map fits in four 16 byte registers, one per channel, and every index is a byte shuffle
+// into each of them. Returns how many indices were expanded.
+SIMD_TARGET_SSSE3 addr_size expandSmallPaletteIndices_SSSE3(const u8* indices, addr_size count, const u32* lut, i32 usedEntries, u8* out) {
+    alignas(16) u8 planes[4][16] = {};
+    for (i32 e = 0; e < usedEntries; e++) {
+        planes[0][e] = u8(lut[e]);
+        planes[1][e] = u8(lut[e] >> 8);
+        planes[2][e] = u8(lut[e] >> 16);
+        planes[3][e] = u8(lut[e] >> 24);
+    }
+    const __m128i p0 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[0]));
+    const __m128i p1 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[1]));
+    const __m128i p2 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[2]));
+    const __m128i p3 = _mm_load_si128(reinterpret_cast<const __m128i*>(planes[3]));
+    const __m128i highNibble = _mm_set1_epi8(i8(0xF0));
+    const __m128i zero = _mm_setzero_si128();
+
+    addr_size i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + i));
+        // Indices past the palette get the high bit set, which makes the shuffle produce zero.
+        __m128i inRange = _mm_cmpeq_epi8(_mm_and_si128(idx, highNibble), zero);
+        idx = _mm_or_si128(idx, _mm_andnot_si128(inRange, _mm_set1_epi8(i8(0x80))));
+
+        __m128i c0 = _mm_shuffle_epi8(p0, idx);
+        __m128i c1 = _mm_shuffle_epi8(p1, idx);
+        __m128i c2 = _mm_shuffle_epi8(p2, idx);
+        __m128i c3 = _mm_shuffle_epi8(p3, idx);
+
+        __m128i c01lo = _mm_unpacklo_epi8(c0, c1);
+        __m128i c01hi = _mm_unpackhi_epi8(c0, c1);
+        __m128i c23lo = _mm_unpacklo_epi8(c2, c3);
+        __m128i c23hi = _mm_unpackhi_epi8(c2, c3);
+
+        u8* dst = out + i * 4;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst +  0), _mm_unpacklo_epi16(c01lo, c23lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(c01lo, c23lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_unpacklo_epi16(c01hi, c23hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_unpackhi_epi16(c01hi, c23hi));
+    }
+
+    return i;
+}
+
+// 8 bit indices never leave the 256 entry table, so gathering needs no range check. Expands the indices from begin on
+// and returns where it stopped.
+SIMD_TARGET_AVX2 addr_size gatherIndices_AVX2(const u8* indices, addr_size begin, addr_size count, const u32* lut, u8* out) {
+    addr_size i = begin;
+    for (; i + 8 <= count; i += 8) {
+        __m128i idx8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i));
+        __m256i idx32 = _mm256_cvtepu8_epi32(idx8);
+        __m256i px = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), idx32, 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 4), px);
+    }
+
+    return i;
+}
+#endif
+
+void expandGray(const u8* src, i32 srcBpp, addr_size count, u8* out) {
+    addr_size i = 0;
+
+    if (srcBpp == 1) {
+        // gray -> BGRX8888 with X = 0xFF
+#if SIMD_SSE2_ENABLED
+        const __m128i opaque = _mm_set1_epi32(i32(0xFF000000));
+        for (; i + 16 <= count; i += 16) {
+            __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i gglo = _mm_unpacklo_epi8(g, g);
+            __m128i gghi = _mm_unpackhi_epi8(g, g);
+
+            u8* dst = out + i * 4;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst +  0), _mm_or_si128(_mm_unpacklo_epi16(gglo, gglo), opaque));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_or_si128(_mm_unpackhi_epi16(gglo, gglo), opaque));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 32), _mm_or_si128(_mm_unpacklo_epi16(gghi, gghi), opaque));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 48), _mm_or_si128(_mm_unpackhi_epi16(gghi, gghi), opaque));
+        }
+#endif
+        for (; i < count; i++) {
+            u8* dst = out + i * 4;
+            dst[0] = dst[1] = dst[2] = src[i];
+            dst[3] = 0xFF;
+        }
+        return;
+    }
+
+    // (gray, alpha) -> BGRA8888
+#if SIMD_SSE2_ENABLED
+    for (; i + 8 <= count; i += 8) {
+        __m128i ga = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        __m128i g = _mm_and_si128(ga, _mm_set1_epi16(0x00FF));
+        __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+
+        u8* dst = out + i * 4;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst +  0), _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(gg, ga));
+    }
+#endif
+    for (; i < count; i++) {
+        u8* dst = out + i * 4;
+        dst[0] = dst[1] = dst[2] = src[2*i];
+        dst[3] = src[2*i + 1];
+    }
+}
+
+core::expected<TGAError> decodeRle(const u8* src, addr_size srcLen, u8* dst, addr_size dstLen, i32 bpp, bool clipLastPacket) {
+    Assert(bpp >= 1 && bpp <= 4, "BUG: unsupported pixel size");
+
+    // A run is at most 128 pixels, so expanding it is a handful of 16 byte stores of a repeating pattern. 48 bytes is a
+    // multiple of every pixel size and of the store width, so walking the pattern in 16 byte steps never breaks a pixel.
+    constexpr addr_size PATTERN_PERIOD = 48;
+    alignas(16) u8 pattern[PATTERN_PERIOD + 16];
+
+    addr_size pixelSize = addr_size(bpp);
+    addr_size in = 0;
+    addr_size out = 0;
+
+    while (out < dstLen) {
+        if (in >= srcLen) {
+            return core::unexpected(TGAError::InvalidFileFormat);
+        }
+
+        u8 packetHeader = src[in++];
+        addr_size count = addr_size(packetHeader & 0x7F) + 1;
+        addr_size bytes = count * pixelSize;
+
+        // Packets may cross scan lines, but never the end of the image. When decoding a band, the last packet is
+        // allowed to continue into the next band.
+        addr_size packetBytes = bytes;
+        if (bytes > dstLen - out) {
+            if (!clipLastPacket) {
+                return core::unexpected(TGAError::InvalidFileFormat);
+            }
+            bytes = dstLen - out;
+        }
+
+        if (packetHeader & 0x80) {
+            // Run-length packet: one pixel value repeated count times.
+            if (pixelSize > srcLen - in) {
+                return core::unexpected(TGAError::InvalidFileFormat);
+            }
+
+            const u8* pixel = &src[in];
+            in += pixelSize;
+
+            if (count == 1) {
+                core::memcopy(&dst[out], pixel, pixelSize);
+                out += pixelSize;
+                continue;
+            }
+
+            for (addr_size i = 0; i < sizeof(pattern); i++) {
+                pattern[i] = pixel[i % pixelSize];
+            }
+
+            u8* curr = &dst[out];
+            addr_size written = 0;
+            addr_size patternOff = 0;
+            while (written + 16 <= bytes) {
+#if SIMD_SSE2_ENABLED
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(curr + written),
+                                 _mm_load_si128(reinterpret_cast<const __m128i*>(pattern + patternOff)));
+#else
+                core::memcopy(curr + written, pattern + patternOff, 16);
+#endif
+                written += 16;
+                patternOff += 16;
+                if (patternOff == PATTERN_PERIOD) patternOff = 0;
+            }
+            if (written < bytes) {
+                core::memcopy(curr + written, pattern + patternOff, bytes - written);
+            }
+
+            out += bytes;
+        }
+        else {
+            // Raw packet: count pixel values stored as is.
+            if (packetBytes > srcLen - in) {
+                return core::unexpected(TGAError::InvalidFileFormat);
+            }
+
+            core::memcopy(&dst[out], &src[in], bytes);
+            in += packetBytes;
+            out += bytes;
+        }
+    }
+
+    return {};
+}
+
+core::expected<TGAError> decodeRleFrom(const u8* src, addr_size srcLen, addr_size skipPixels, u8* dst, addr_size dstLen, i32 bpp) {
+    addr_size pixelSize = addr_size(bpp);
+    addr_size in = 0;
+
+    // Walk the packets before the first wanted pixel without decoding them. The packet holding it may start earlier.
+    while (skipPixels > 0) {
+        if (in >= srcLen) {
+            return core::unexpected(TGAError::InvalidFileFormat);
+        }
+
+        u8 packetHeader = src[in];
+        addr_size count = addr_size(packetHeader & 0x7F) + 1;
+        bool isRun = packetHeader & 0x80;
+        addr_size packetBytes = isRun ? pixelSize : count * pixelSize;
+        if (packetBytes > srcLen - in - 1) {
+            return core::unexpected(TGAError::InvalidFileFormat);
+        }
+
+        if (count <= skipPixels) {
+            skipPixels -= count;
+            in += 1 + packetBytes;
+            continue;
+        }
+
+        // Emit the tail of the straddling packet, then continue with whole packets.
+        addr_size tail = core::core_min(count - skipPixels, dstLen / pixelSize);
+        const u8* pixels = &src[in + 1];
+        for (addr_size i = 0; i < tail; i++) {
+            const u8* pixel = isRun ? pixels : pixels + (skipPixels + i) * pixelSize;
+            core::memcopy(dst + i * pixelSize, pixel, pixelSize);
+        }
+
+        dst += tail * pixelSize;
+        dstLen -= tail * pixelSize;
+        in += 1 + packetBytes;
+        skipPixels = 0;
+    }
+
+    if (dstLen == 0) {
+        return {};
+    }
+    return decodeRle(src + in, srcLen - in, dst, dstLen, bpp, true);
+}
+
+core::expected<TGAError> createTrueColorFile(const CreateFileFromSurfaceParams& params) {
+    const Surface& surface = params.surface;
 
     Header header = {};
+    if (auto res = makeTrueColorHeader(params.imageType, surface.width, surface.height, surface.pixelFormat, surface.origin, header);
+        res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    WriteOnlyFile file;
+    if (auto res = openOutputFile(params.path, file); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+    defer { file.free(); };
+
+    auto& actx = DEF_ALLOC;
+    RowWriteBuffer buffer = {};
+    if (params.imageType == 10) {
+        buffer = createRowWriteBuffer(surface.width, surface.bpp(), actx);
+    }
+    defer { buffer.free(actx); };
+
+    // Header, rows and footer are gathered into as few writes as possible; a small contiguous image is written with a
+    // single call.
+    GatheredWriter out = { .file = &file };
+    if (auto res = out.push(&header, sizeof(Header)); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+    ExtensionWriteData ext = {};
+    defer { ext.free(actx); };
+    if (params.writeScanLineTable) {
+        ext.scanLineTable = core::memoryZeroAllocate<TGALong>(addr_size(surface.height), actx);
+    }
+
+    if (auto res = writeImageRows(out, surface, params.imageType == 10, buffer, ext.scanLineTable.data()); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    Footer footer = makeFooter();
+    if (params.fileType == FileType::New) {
+        if (params.writeScanLineTable || params.postageStampSize > 0) {
+            if (auto res = pushExtensionArea(out, surface, params.postageStampSize, ext, actx); res.hasErr()) {
+                return core::unexpected(res.err());
+            }
+            footer.extensionAreaOffset = TGALong(out.bytesPushed - EXTENSION_AREA_SIZE);
+        }
+        if (auto res = out.push(&footer, sizeof(Footer)); res.hasErr()) {
+            return core::unexpected(res.err());
+        }
+    }
+    if (auto res = out.flush(); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    return {};
+}
+
+core::expected<TGAError> makeTrueColorHeader(i32 imageType, i32 width, i32 height, PixelFormat pixelFormat, Origin origin,
+                                             Header& out) {
+    out = {};
 
-    header.imageType = TGAByte(params.imageType);
-    header.setWidth(u16(params.surface.width));
-    header.setHeight(u16(params.surface.height));
-    header.setPixelDepth(u8(pixelFormatBytesPerPixel(params.surface.pixelFormat) * core::BYTE_SIZE));
-    header.setAlphaBits(u8(pixelFormatAlphaBits(params.surface.pixelFormat)));
+    out.imageType = TGAByte(imageType);
+    out.setWidth(u16(width));
+    out.setHeight(u16(height));
+    out.setPixelDepth(u8(pixelFormatBytesPerPixel(pixelFormat) * core::BYTE_SIZE));
+    out.setAlphaBits(u8(pixelFormatAlphaBits(pixelFormat)));
 
     // Set image origin
-    switch (params.surface.origin) {
+    switch (origin) {
         case Origin::BottomLeft:
-            header.setOrigin(0b00);
+            out.setOrigin(0b00);
             break;
         case Origin::BottomRight:
-            header.setOrigin(0b01);
+            out.setOrigin(0b01);
             break;
         case Origin::TopLeft:
-            header.setOrigin(0b10);
+            out.setOrigin(0b10);
             break;
         case Origin::TopRight:
-            header.setOrigin(0b11);
+            out.setOrigin(0b11);
             break;
 
         case Origin::Undefined: [[fallthrough]];
@@ -408,29 +1446,331 @@ core::expected<TGAError> createTrueColorFile(const CreateFileFromSurfaceParams&
             return core::unexpected(TGAError::InvalidArgument);
     }
 
-    // Write the header
-    if (auto res = core::fileWrite(file, &header, sizeof(Header)); res.hasErr() || res.value() != sizeof(Header)) {
-        logErr_PltErrorCode(res.err());
-        return core::unexpected(TGAError::FailedToWriteFile);
+    return {};
+}
+
+Footer makeFooter() {
+    Footer footer = {};
+    core::memcopy(footer.signature, TRUE_VISION_SIGNATURE.data(), TRUE_VISION_SIGNATURE.len());
+    return footer;
+}
+
+core::expected<TGAError> openOutputFile(const char* path, WriteOnlyFile& out) {
+    auto res = createWriteOnlyFile(path);
+    if (res.hasErr()) {
+        logErr("Failed to open file: \"{}\"; reason: {}", path, errorToCstr(res.err()));
+        return core::unexpected(TGAError::FailedToOpenFile);
+    }
+    out = res.value();
+    return {};
+}
+
+core::expected<TGAError> GatheredWriter::push(const void* data, addr_size size) {
+    bytesPushed += size;
+
+    if (spansCount > 0) {
+        FileWriteSpan& last = spans[spansCount - 1];
+        if (reinterpret_cast<const u8*>(last.data) + last.size == data) {
+            last.size += size;
+            return {};
+        }
     }
 
-    // Write the content
-    if (auto res = core::fileWrite(file, params.surface.data, addr_size(params.surface.size())); res.hasErr() || res.value() != addr_size(params.surface.size())) {
-        logErr_PltErrorCode(res.err());
+    if (spansCount == MAX_SPANS) {
+        if (auto res = flush(); res.hasErr()) return res;
+    }
+
+    spans[spansCount++] = { data, size };
+    return {};
+}
+
+core::expected<TGAError> GatheredWriter::flush() {
+    if (spansCount == 0) return {};
+
+    auto res = writeFileGathered(*file, spans, spansCount);
+    spansCount = 0;
+    if (res.hasErr()) {
+        logErr("Failed to write file; reason: {}", errorToCstr(res.err()));
         return core::unexpected(TGAError::FailedToWriteFile);
     }
+    return {};
+}
 
-    // Write the footer if file type is new
-    if (params.fileType == FileType::New) {
-        Footer footer = {};
-        core::memcopy(footer.signature, TRUE_VISION_SIGNATURE.data(), TRUE_VISION_SIGNATURE.len());
-        if (auto res = core::fileWrite(file, &footer, sizeof(Footer)); res.hasErr() || res.value() != sizeof(Footer)) {
-            logErr_PltErrorCode(res.err());
-            return core::unexpected(TGAError::FailedToWriteFile);
+RowWriteBuffer createRowWriteBuffer(i32 width, i32 bpp, core::AllocatorContext& actx) {
+    constexpr addr_size RLE_WRITE_BUFFER_SIZE = 256 * core::CORE_KILOBYTE;
+
+    RowWriteBuffer ret;
+    ret.rowMaxSize = rleRowMaxSize(width, bpp);
+    ret.size = core::core_max(RLE_WRITE_BUFFER_SIZE, ret.rowMaxSize);
+    ret.data = reinterpret_cast<u8*>(actx.alloc(ret.size, sizeof(u8)));
+    return ret;
+}
+
+void RowWriteBuffer::free(core::AllocatorContext& actx) {
+    if (data) {
+        actx.free(data, size, sizeof(u8));
+        data = nullptr;
+    }
+}
+
+core::expected<TGAError> writeImageRows(GatheredWriter& out, const Surface& rows, bool runLengthEncode,
+                                        RowWriteBuffer& buffer, TGALong* rowOffsets) {
+    if (!runLengthEncode) {
+        // The file stores rows starting from the origin, which is row 0 of the surface. Contiguous rows merge into one
+        // span; padded rows, negative pitches and sub-surfaces cost one span per row, but never a copy.
+        addr_size rowSize = addr_size(rows.width * rows.bpp());
+        for (i32 y = 0; y < rows.height; y++) {
+            if (rowOffsets) rowOffsets[y] = TGALong(out.bytesPushed);
+            if (auto res = out.push(rows.row(y), rowSize); res.hasErr()) {
+                return res;
+            }
         }
+        return {};
     }
 
-    return {};
+    // Packets never cross scan lines (as the 2.0 spec recommends), so rows are encoded one at a time into the buffer,
+    // which is flushed whenever the next row might not fit.
+    Assert(buffer.data != nullptr && buffer.rowMaxSize == rleRowMaxSize(rows.width, rows.bpp()),
+           "BUG: write buffer was created for a different row size");
+
+    addr_size used = 0;
+    for (i32 y = 0; y < rows.height; y++) {
+        if (used + buffer.rowMaxSize > buffer.size) {
+            if (auto res = out.flush(); res.hasErr()) {
+                return res;
+            }
+            used = 0;
+        }
+
+        addr_size encodedSize = encodeRleRow(rows.row(y), rows.width, rows.bpp(), buffer.data + used);
+        if (rowOffsets) rowOffsets[y] = TGALong(out.bytesPushed);
+        if (auto res = out.push(buffer.data + used, encodedSize); res.hasErr()) {
+            return res;
+        }
+        used += encodedSize;
+    }
+
+    return out.flush();
+}
+
+void ExtensionWriteData::free(core::AllocatorContext& actx) {
+    postageStamp.free();
+    postageStamp = {};
+    if (scanLineTable.data()) {
+        core::memoryFree(std::move(scanLineTable), actx);
+    }
+}
+
+core::expected<TGAError> pushExtensionArea(GatheredWriter& out, const Surface& surface, i32 postageStampSize,
+                                           ExtensionWriteData& data, core::AllocatorContext& actx) {
+    ExtensionArea& area = data.area;
+    area = {};
+    area.extensionSize = TGAShort(EXTENSION_AREA_SIZE);
+    bool hasAlpha = surface.pixelFormat == PixelFormat::BGRA8888 || surface.pixelFormat == PixelFormat::BGRA5551;
+    area.attributesType = hasAlpha ? 3 : 0;
+
+    if (postageStampSize > 0) {
+        // Keep the aspect ratio; the longest side gets postageStampSize pixels, unless the image is smaller than that.
+        i32 maxSide = core::core_min(postageStampSize, MAX_POSTAGE_STAMP_SIZE);
+        i32 longest = core::core_max(surface.width, surface.height);
+        i32 w = surface.width;
+        i32 h = surface.height;
+        if (longest > maxSide) {
+            w = core::core_max(1, i32(i64(surface.width) * maxSide / longest));
+            h = core::core_max(1, i32(i64(surface.height) * maxSide / longest));
+        }
+
+        Surface& stamp = data.postageStamp;
+        stamp = surface.view();
+        stamp.width = w;
+        stamp.height = h;
+        stamp.pitch = w * surface.bpp();
+        stamp.actx = &actx;
+        stamp.data = reinterpret_cast<u8*>(actx.alloc(addr_size(stamp.size()), sizeof(u8)));
+        downscaleAreaAverage(surface, stamp, actx);
+
+        area.postageStampOffset = TGALong(out.bytesPushed);
+        data.postageStampSize[0] = u8(w);
+        data.postageStampSize[1] = u8(h);
+        if (auto res = out.push(data.postageStampSize, sizeof(data.postageStampSize)); res.hasErr()) return res;
+        if (auto res = out.push(stamp.data, addr_size(stamp.size())); res.hasErr()) return res;
+    }
+
+    if (data.scanLineTable.data()) {
+        // Offsets are 32 bits wide; a file that does not fit can't have a table.
+        if (out.bytesPushed > addr_size(0xFFFFFFFF)) {
+            logErr("File is too large for a scan line table");
+            return core::unexpected(TGAError::InvalidArgument);
+        }
+
+        area.scanLineOffset = TGALong(out.bytesPushed);
+        if (auto res = out.push(data.scanLineTable.data(), data.scanLineTable.len() * sizeof(TGALong)); res.hasErr()) {
+            return res;
+        }
+    }
+
+    return out.push(&area, sizeof(ExtensionArea));
+}
+
+// Worst case is a row without any repeats: one header byte per 128 raw pixels.
+constexpr addr_size rleRowMaxSize(i32 width, i32 bpp) {
+    return addr_size(width) * addr_size(bpp) + addr_size((width + 127) / 128);
+}
+
+template <i32 BPP>
+inline bool pixelsEqual(const u8* a, const u8* b) {
+    for (i32 i = 0; i < BPP; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+#if SIMD_SSE2_ENABLED
+// Lane-wise pixel equality as a byte mask: every byte of a pixel is set in the result, or none is.
+template <i32 BPP>
+inline u32 equalPixelsMask(__m128i a, __m128i b) {
+    if constexpr (BPP == 4) return u32(_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)));
+    else                    return u32(_mm_movemask_epi8(_mm_cmpeq_epi16(a, b)));
+}
+
+// 3 byte pixels straddle the lanes, so 16 of them (48 bytes, three registers) are compared byte by byte. Bit 3 * i of
+// the result is set when pixel i is equal in a and b, every other bit is clear.
+constexpr u64 PIXEL_BITS_888 = 0x249249249249;
+
+inline u64 equalPixelBits_888(const u8* a, const u8* b) {
+    u64 bytes = 0;
+    for (i32 i = 0; i < 3; i++) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * 16));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * 16));
+        bytes |= u64(u32(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)))) << (i * 16);
+    }
+    return bytes & (bytes >> 1) & (bytes >> 2) & PIXEL_BITS_888;
+}
+#endif
+
+// Number of pixels in [start, end) equal to the pixel at start.
+template <i32 BPP>
+i32 rleRunLength(const u8* row, i32 start, i32 end) {
+    const u8* pixel = row + start * BPP;
+    i32 x = start + 1;
+
+#if SIMD_SSE2_ENABLED
+    if constexpr (BPP == 4 || BPP == 2) {
+        constexpr i32 LANES = 16 / BPP;
+
+        __m128i ref;
+        if constexpr (BPP == 4) {
+            u32 v = u32(pixel[0]) | (u32(pixel[1]) << 8) | (u32(pixel[2]) << 16) | (u32(pixel[3]) << 24);
+            ref = _mm_set1_epi32(i32(v));
+        }
+        else {
+            u16 v = u16(pixel[0] | (pixel[1] << 8));
+            ref = _mm_set1_epi16(i16(v));
+        }
+
+        for (; x + LANES <= end; x += LANES) {
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * BPP));
+            u32 mask = equalPixelsMask<BPP>(px, ref);
+            if (mask != 0xFFFF) {
+                return x + simdLowestSetBit(~mask & 0xFFFF) / BPP - start;
+            }
+        }
+    }
+    else if constexpr (BPP == 3) {
+        // The reference is the start pixel repeated over 48 bytes, which lines up with every block of 16 pixels.
+        alignas(16) u8 ref[48];
+        for (i32 i = 0; i < 48; i += 3) {
+            ref[i + 0] = pixel[0];
+            ref[i + 1] = pixel[1];
+            ref[i + 2] = pixel[2];
+        }
+
+        for (; x + 16 <= end; x += 16) {
+            u64 equal = equalPixelBits_888(row + x * 3, ref);
+            if (equal != PIXEL_BITS_888) {
+                return x + simdLowestSetBit64(~equal & PIXEL_BITS_888) / 3 - start;
+            }
+        }
+    }
+#endif
+
+    for (; x < end && pixelsEqual<BPP>(row + x * BPP, pixel); x++) {}
+    return x - start;
+}
+
+// First x in [start, end) whose pixel repeats in x + 1, or end if there is none. Pixels past the row are never read.
+template <i32 BPP>
+i32 rleFindRepeat(const u8* row, i32 start, i32 end, i32 width) {
+    i32 x = start;
+
+#if SIMD_SSE2_ENABLED
+    if constexpr (BPP == 4 || BPP == 2) {
+        constexpr i32 LANES = 16 / BPP;
+        for (; x + LANES <= end && x + LANES < width; x += LANES) {
+            __m128i curr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * BPP));
+            __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (x + 1) * BPP));
+            u32 mask = equalPixelsMask<BPP>(curr, next);
+            if (mask != 0) {
+                return x + simdLowestSetBit(mask) / BPP;
+            }
+        }
+    }
+    else if constexpr (BPP == 3) {
+        // The row compared with itself shifted by one pixel.
+        for (; x + 16 <= end && x + 16 < width; x += 16) {
+            u64 equal = equalPixelBits_888(row + x * 3, row + (x + 1) * 3);
+            if (equal != 0) {
+                return x + simdLowestSetBit64(equal) / 3;
+            }
+        }
+    }
+#endif
+
+    for (; x < end; x++) {
+        if (x + 1 < width && pixelsEqual<BPP>(row + x * BPP, row + (x + 1) * BPP)) return x;
+    }
+    return end;
+}
+
+template <i32 BPP>
+addr_size encodeRleRow(const u8* row, i32 width, u8* out) {
+    constexpr i32 MAX_PACKET_PIXELS = 128;
+
+    u8* curr = out;
+    i32 x = 0;
+    while (x < width) {
+        i32 limit = core::core_min(width, x + MAX_PACKET_PIXELS);
+
+        i32 run = rleRunLength<BPP>(row, x, limit);
+        if (run >= 2) {
+            *curr++ = u8(0x80 | (run - 1));
+            core::memcopy(curr, row + x * BPP, BPP);
+            curr += BPP;
+            x += run;
+            continue;
+        }
+
+        // Collect raw pixels up to the start of the next run.
+        i32 rawEnd = rleFindRepeat<BPP>(row, x + 1, limit, width);
+        i32 count = rawEnd - x;
+        *curr++ = u8(count - 1);
+        core::memcopy(curr, row + x * BPP, addr_size(count * BPP));
+        curr += count * BPP;
+        x = rawEnd;
+    }
+
+    return addr_size(curr - out);
+}
+
+addr_size encodeRleRow(const u8* row, i32 width, i32 bpp, u8* out) {
+    switch (bpp) {
+        case 4: return encodeRleRow<4>(row, width, out);
+        case 3: return encodeRleRow<3>(row, width, out);
+        case 2: return encodeRleRow<2>(row, width, out);
+        default:
+            Assert(false, "unsupported bytes per pixel");
+            return 0;
+    }
 }
 
 } // namespace
@@ -1,32 +1,165 @@
 #include "wavefront_files.h"
+#include "wavefront_numbers.h"
+#include "file_mapping.h"
 #include "log_utils.h"
 #include "model.h"
+#include "model_cache.h"
+#include "simd_utils.h"
 
-// TODO: [WAVEFRONT] This code expects spaces if a wavefront file with tabs for delimiters is ever passed it will fail.
+#include <thread>
 
-#define WAVEFRONT_CONV_ERR_CHECK(x) \
-    if (x.hasErr()) { \
-        logErr_ConvErrorCode(x.err()); \
-        return core::unexpected(Wavefront::WavefrontError::InvalidFileFormat); \
+namespace Wavefront {
+
+namespace {
+
+constexpr addr_size CLASSIFY_BLOCK_SIZE = 32;
+
+struct ByteClasses {
+    u32 newline; // '\n'
+    u32 space;   // ' ' and '\t' through '\r', so newlines as well.
+    u32 slash;   // '/'
+};
+[[nodiscard]] ByteClasses classifyBlock(const char* data, addr_size len);
+[[nodiscard]] addr_size findNewline(const char* data, addr_size len);
+
+constexpr i32 MAX_LINE_TOKENS = 8;
+constexpr i32 MAX_TOKEN_SLASHES = 2;
+
+struct LineTokens {
+    core::StrView tokens[MAX_LINE_TOKENS];
+    i32 slashes[MAX_LINE_TOKENS][MAX_TOKEN_SLASHES]; // Offsets from the start of the token.
+    i32 slashesCount[MAX_LINE_TOKENS];               // Only the first MAX_TOKEN_SLASHES offsets are kept.
+    i32 count;                                       // Only the first MAX_LINE_TOKENS tokens are kept.
+};
+[[nodiscard]] addr_size tokenizeLine(const char* data, addr_size len, LineTokens& out);
+
+enum struct Statement : u8 {
+    None,
+    Vertex,
+    TextureCoord,
+    Normal,
+    Face,
+    Group,
+};
+[[nodiscard]] constexpr Statement statementAt(const char* line, addr_size len);
+[[nodiscard]] core::StrView groupNameOf(const char* line, addr_size lineLen);
+
+struct StatementCounts {
+    i32 vertices;
+    i32 textureCoords;
+    i32 normals;
+    i32 faces;
+    i32 groups;
+    i32 groupNameBytes;
+
+    void add(const StatementCounts& other) {
+        vertices += other.vertices;
+        textureCoords += other.textureCoords;
+        normals += other.normals;
+        faces += other.faces;
+        groups += other.groups;
+        groupNameBytes += other.groupNameBytes;
     }
+};
+[[nodiscard]] StatementCounts countStatements(core::StrView contents);
 
-#define WAVEFRONT_PLT_ERR_CHECK(x, errType) \
-    if (x.hasErr()) { \
-        logErr_PltErrorCode(x.err()); \
-        return core::unexpected(errType); \
+// Where a parser writes one kind of statement. cap comes from the counting pre-pass.
+template <typename T>
+struct ParseSlice {
+    T* data;
+    i32 cap;
+    i32 count;
+
+    void push(const T& v) {
+        Assert(count < cap, "BUG: the statement count pre-pass missed a statement");
+        data[count++] = v;
     }
+};
 
-namespace Wavefront {
+// parseStatements hands every parsed statement to a target, which is either a ParseTarget or a CallbackTarget.
+struct ParseTarget {
+    ParseSlice<core::vec4f> vertices;
+    ParseSlice<core::vec3f> textureCoords;
+    ParseSlice<core::vec3f> normals;
+    ParseSlice<WavefrontObj::Face> faces;
+    ParseSlice<WavefrontObj::Group> groups;
+    ParseSlice<char> groupNames;
+    i32 facesBase;      // Index of faces.data[0] in the whole object.
+    i32 groupNamesBase; // Index of groupNames.data[0] in the whole object.
 
-namespace {
+    void onVertex(const core::vec4f& v) { vertices.push(v); }
+    void onTextureCoord(const core::vec3f& vt) { textureCoords.push(vt); }
+    void onNormal(const core::vec3f& vn) { normals.push(vn); }
+    void onFace(const WavefrontObj::Face& f) { faces.push(f); }
+    void onGroup(core::StrView name) {
+        WavefrontObj::Group g;
+        g.firstFace = facesBase + faces.count;
+        g.nameOffset = groupNamesBase + groupNames.count;
+        g.nameLength = i32(name.len());
+        groups.push(g);
+        for (addr_size i = 0; i < name.len(); i++) {
+            groupNames.push(name.data()[i]);
+        }
+    }
+};
+void allocateStorage(WavefrontObj& obj, const StatementCounts& counts, core::AllocatorContext& actx);
+[[nodiscard]] ParseTarget sliceStorage(WavefrontObj& obj, const StatementCounts& offsets, const StatementCounts& counts);
+void setCounts(WavefrontObj& obj, const StatementCounts& counts);
+
+struct CallbackTarget {
+    const StreamingCallbacks* callbacks;
+
+    void onVertex(const core::vec4f& v) { call(callbacks->vertex, v); }
+    void onTextureCoord(const core::vec3f& vt) { call(callbacks->textureCoord, vt); }
+    void onNormal(const core::vec3f& vn) { call(callbacks->normal, vn); }
+    void onFace(const WavefrontObj::Face& f) { call(callbacks->face, f); }
+    void onGroup(core::StrView name) { call(callbacks->group, name); }
+
+    template <typename TCallback, typename T>
+    void call(TCallback callback, const T& arg) {
+        if (callback) callback(arg, callbacks->userData);
+    }
+};
+
+template <typename TTarget>
+[[nodiscard]] core::expected<WavefrontError> parseStatements(core::StrView contents, TTarget& target);
 
-template <i32 N>
-[[nodiscard]] core::StrView nextToken(core::StrView line, const char (&delims)[N], core::StrView& token);
-[[nodiscard]] core::StrView skipToken(core::StrView line, char delim);
-[[nodiscard]] i32 countTokens(core::StrView currLine, char delim);
+[[nodiscard]] core::expected<MappedFile, WavefrontError> mapInputFile(const char* path);
 
-[[nodiscard]] core::expected<core::vec4f, WavefrontError> parseVertexLine(core::StrView currLine);
-[[nodiscard]] core::expected<WavefrontObj::Face, WavefrontError> parseFaces(core::StrView currLine);
+// Reads the file front to back into a buffer of chunkSize bytes and calls fn with every run of whole lines that is in
+// the buffer. The unfinished line at the end of a chunk is moved to the front of the buffer and completed by the next
+// read; a line longer than the whole buffer grows the buffer.
+template <typename TFn>
+[[nodiscard]] core::expected<WavefrontError> streamLines(const char* path, addr_size chunkSize,
+                                                         core::AllocatorContext& actx, TFn&& fn);
+
+// Zero based indices of one face corner, -1 for the parts the corner does not have.
+struct VertexKey {
+    i32 v;
+    i32 vt;
+    i32 vn;
+
+    constexpr bool operator==(const VertexKey& other) const = default;
+};
+[[nodiscard]] VertexKey cornerKey(const WavefrontObj& obj, const WavefrontObj::Face& face, i32 corner);
+[[nodiscard]] constexpr u32 hashVertexKey(const VertexKey& key);
+
+// When consumed is set it is obj, and its arrays are freed as soon as they have been read.
+[[nodiscard]] Model3D convertToModel(const WavefrontObj& obj, WavefrontObj* consumed, core::AllocatorContext& modelActx,
+                                     VertexLayout layout);
+template <typename TKeyFn>
+void fillInterleavedVertices(Model3D& model, const WavefrontObj& obj, i32 verticesCount, TKeyFn&& vertexKey);
+template <typename TKeyFn>
+void fillVertexStreams(Model3D& model, const WavefrontObj& obj, i32 verticesCount, TKeyFn&& vertexKey);
+void buildSubmeshes(Model3D& model, const WavefrontObj& obj);
+
+constexpr i32 MAX_WORKERS = 64;
+
+[[nodiscard]] core::expected<core::vec4f, WavefrontError> parseVertexLine(const LineTokens& line);
+[[nodiscard]] core::expected<core::vec3f, WavefrontError> parseTextureCoordLine(const LineTokens& line);
+[[nodiscard]] core::expected<core::vec3f, WavefrontError> parseNormalLine(const LineTokens& line);
+[[nodiscard]] core::expected<WavefrontError> parseFloatTokens(const LineTokens& line, i32 count, f32* out);
+[[nodiscard]] core::expected<WavefrontObj::Face, WavefrontError> parseFaces(const LineTokens& line);
 
 } // namespace
 
@@ -45,7 +178,11 @@ const char* errorToCstr(WavefrontError err) {
 void WavefrontObj::free() {
     if (actx) {
         core::memoryFree(std::move(vertices), *actx);
+        core::memoryFree(std::move(textureCoords), *actx);
+        core::memoryFree(std::move(normals), *actx);
         core::memoryFree(std::move(faces), *actx);
+        core::memoryFree(std::move(groups), *actx);
+        core::memoryFree(std::move(groupNames), *actx);
     }
 
     *this = {};
@@ -60,199 +197,920 @@ core::expected<WavefrontObj, WavefrontError> loadFile(
         return core::unexpected(WavefrontError::UnsupportedVersion);
     }
 
-    core::FileStat fileStat;
-    auto statRes = core::fileStat(path, fileStat);
-    WAVEFRONT_PLT_ERR_CHECK(statRes, WavefrontError::FailedToStatFile);
+    auto mapRes = mapInputFile(path);
+    if (mapRes.hasErr()) return core::unexpected(mapRes.err());
+    MappedFile mapping = std::move(mapRes.value());
+    defer { mapping.free(); };
 
-    addr_size fsize = fileStat.size;
-    auto fileMemoryRaw = core::memoryZeroAllocate<u8>(fsize, actx);
-    defer { core::memoryFree(std::move(fileMemoryRaw), actx); };
-
-    auto readEntireRes = core::fileReadEntire(path, fileMemoryRaw);
-    WAVEFRONT_PLT_ERR_CHECK(readEntireRes, WavefrontError::FailedToReadFile);
+    core::StrView contents = core::sv(mapping.memory);
 
     WavefrontObj obj = {};
     obj.actx = &actx;
 
-    core::StrView rest = core::sv(fileMemoryRaw);
-    core::StrView currLine;
+    // Counting the statements first is a lot cheaper than parsing them, and lets the storage be allocated once, at its
+    // final size, instead of growing (and copying) while parsing.
+    StatementCounts counts = countStatements(contents);
+    allocateStorage(obj, counts, actx);
+
+    ParseTarget target = sliceStorage(obj, {}, counts);
+    if (auto res = parseStatements(contents, target); res.hasErr()) {
+        obj.free();
+        return core::unexpected(res.err());
+    }
+
+    setCounts(obj, counts);
+    return obj;
+}
+
+core::expected<WavefrontObj, WavefrontError> loadFileParallel(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const ParallelLoadInfo& info,
+    core::AllocatorContext& actx
+) {
+    if (fileVersion != WavefrontVersion::VERSION_3_0) {
+        return core::unexpected(WavefrontError::UnsupportedVersion);
+    }
+
+    auto mapRes = mapInputFile(path);
+    if (mapRes.hasErr()) return core::unexpected(mapRes.err());
+    MappedFile mapping = std::move(mapRes.value());
+    defer { mapping.free(); };
 
-    while (!rest.empty()) {
-        rest = core::cut(rest, '\n', currLine, true);
+    core::StrView contents = core::sv(mapping.memory);
+    const char* data = contents.data();
+    addr_size len = contents.len();
 
-        if(currLine.empty()) continue;
+    i32 workerCount = info.workerCount;
+    if (workerCount <= 0) {
+        workerCount = core::core_max(i32(std::thread::hardware_concurrency()), 1);
+    }
+    addr_size minChunkSize = core::core_max(info.minChunkSize, addr_size(1));
+    i32 chunksCount = i32(core::core_min(core::core_max(len / minChunkSize, addr_size(1)), addr_size(MAX_WORKERS)));
+    chunksCount = core::core_min(chunksCount, workerCount);
 
-        if (core::startsWith(currLine, "v ")) {
-            // vertex
-            auto res = parseVertexLine(currLine);
-            if (res.hasErr()) return core::unexpected(res.err());
+    // Chunks start right after a newline, so every line belongs to exactly one chunk.
+    addr_size chunkBegin[MAX_WORKERS + 1];
+    chunkBegin[0] = 0;
+    for (i32 i = 1; i < chunksCount; i++) {
+        addr_size pos = core::core_max(len / addr_size(chunksCount) * addr_size(i), chunkBegin[i - 1]);
+        while (pos < len && data[pos - 1] != '\n') pos++;
+        chunkBegin[i] = pos;
+    }
+    chunkBegin[chunksCount] = len;
+
+    auto chunk = [&](i32 i) {
+        return core::sv(data + chunkBegin[i], chunkBegin[i + 1] - chunkBegin[i]);
+    };
 
-            obj.vertices = core::memorySet(obj.vertices, addr_size(obj.verticesCount), std::move(res.value()), *obj.actx);
-            obj.verticesCount++;
+    // The calling thread handles chunk 0.
+    auto runOnWorkers = [&](auto&& fn) {
+        std::thread workers[MAX_WORKERS];
+        for (i32 i = 1; i < chunksCount; i++) {
+            workers[i] = std::thread([&fn, i]() { fn(i); });
         }
-        else if (core::startsWith(currLine, "f ")) {
-            // faces
-            auto res = parseFaces(currLine);
-            if (res.hasErr()) return core::unexpected(res.err());
+        fn(0);
+        for (i32 i = 1; i < chunksCount; i++) {
+            workers[i].join();
+        }
+    };
+
+    StatementCounts counts[MAX_WORKERS];
+    runOnWorkers([&](i32 i) { counts[i] = countStatements(chunk(i)); });
+
+    // Exclusive prefix sum: every chunk starts writing where the chunks before it stop.
+    StatementCounts offsets[MAX_WORKERS];
+    StatementCounts total = {};
+    for (i32 i = 0; i < chunksCount; i++) {
+        offsets[i] = total;
+        total.add(counts[i]);
+    }
 
-            WavefrontObj::Face face = std::move(res.value());
-            obj.faces = core::memorySet(obj.faces, addr_size(obj.facesCount), std::move(face), *obj.actx);
-            obj.facesCount++;
+    WavefrontObj obj = {};
+    obj.actx = &actx;
+    allocateStorage(obj, total, actx);
+
+    ParseTarget targets[MAX_WORKERS];
+    for (i32 i = 0; i < chunksCount; i++) {
+        targets[i] = sliceStorage(obj, offsets[i], counts[i]);
+    }
+
+    WavefrontError errs[MAX_WORKERS];
+    runOnWorkers([&](i32 i) {
+        auto res = parseStatements(chunk(i), targets[i]);
+        errs[i] = res.hasErr() ? res.err() : WavefrontError::Undefined;
+    });
+
+    // Report the error that the serial loader would have hit first.
+    for (i32 i = 0; i < chunksCount; i++) {
+        if (errs[i] != WavefrontError::Undefined) {
+            obj.free();
+            return core::unexpected(errs[i]);
         }
     }
 
+    setCounts(obj, total);
     return obj;
 }
 
-Model3D createModelFromWavefrontObj(const WavefrontObj& obj, core::AllocatorContext& modelActx) {
-    Model3D model;
-    model.actx = &modelActx;
+core::expected<WavefrontError> streamFile(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const StreamingCallbacks& callbacks,
+    const StreamingLoadInfo& info,
+    core::AllocatorContext& actx
+) {
+    if (fileVersion != WavefrontVersion::VERSION_3_0) {
+        return core::unexpected(WavefrontError::UnsupportedVersion);
+    }
 
-    model.vertices = core::memoryZeroAllocate<core::vec4f>(addr_size(obj.verticesCount), modelActx);
-    for (i32 i = 0; i < obj.verticesCount; i++) {
-        model.vertices[i] = obj.vertices[i];
+    CallbackTarget target = { &callbacks };
+    return streamLines(path, info.chunkSize, actx, [&](core::StrView lines) {
+        return parseStatements(lines, target);
+    });
+}
+
+core::expected<WavefrontObj, WavefrontError> loadFileStreaming(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const StreamingLoadInfo& info,
+    core::AllocatorContext& actx
+) {
+    if (fileVersion != WavefrontVersion::VERSION_3_0) {
+        return core::unexpected(WavefrontError::UnsupportedVersion);
     }
-    Assert(i32(model.vertices.len()) == obj.verticesCount);
 
-    model.faces = core::memoryZeroAllocate<Model3D::Face>(addr_size(obj.facesCount), modelActx);
-    for (i32 i = 0; i < obj.facesCount; i++) {
-        bool faceHasVertexIndices =
-            obj.faces[i].isSet(0, 0) &&
-            obj.faces[i].isSet(0, 1) &&
-            obj.faces[i].isSet(0, 2);
+    // Same count-then-parse scheme as loadFile, only every pass streams the file instead of walking a mapping of it.
+    StatementCounts counts = {};
+    auto countRes = streamLines(path, info.chunkSize, actx, [&](core::StrView lines) -> core::expected<WavefrontError> {
+        counts.add(countStatements(lines));
+        return {};
+    });
+    if (countRes.hasErr()) return core::unexpected(countRes.err());
 
-        Assert(faceHasVertexIndices, "wavefront face is missing vertex indices, which are required by the standard");
+    WavefrontObj obj = {};
+    obj.actx = &actx;
+    allocateStorage(obj, counts, actx);
 
-        auto& v = obj.faces[i].v();
-        model.faces[i][0] = v[0] - 1;
-        model.faces[i][1] = v[1] - 1;
-        model.faces[i][2] = v[2] - 1;
+    ParseTarget target = sliceStorage(obj, {}, counts);
+    auto parseRes = streamLines(path, info.chunkSize, actx, [&](core::StrView lines) {
+        return parseStatements(lines, target);
+    });
+    if (parseRes.hasErr()) {
+        obj.free();
+        return core::unexpected(parseRes.err());
     }
-    Assert(i32(model.faces.len()) == obj.facesCount);
+
+    setCounts(obj, counts);
+    return obj;
+}
+
+Model3D createModelFromWavefrontObj(const WavefrontObj& obj, core::AllocatorContext& modelActx, VertexLayout layout) {
+    return convertToModel(obj, nullptr, modelActx, layout);
+}
+
+Model3D createModelFromWavefrontObj(WavefrontObj&& obj, core::AllocatorContext& modelActx, VertexLayout layout) {
+    Model3D model = convertToModel(obj, &obj, modelActx, layout);
+    obj.free();
+    return model;
+}
+
+core::expected<Model3D, WavefrontError> loadModelCached(
+    const char* path,
+    WavefrontVersion fileVersion,
+    const char* cacheDirectory,
+    core::AllocatorContext& actx
+) {
+    auto sourceRes = modelCacheSourceFor(path);
+    if (sourceRes.hasErr()) {
+        logErr("Failed to stat file: \"{}\"", path);
+        return core::unexpected(WavefrontError::FailedToStatFile);
+    }
+    const ModelCacheSource& source = sourceRes.value();
+
+    // <cacheDirectory>/<path hash as 16 hex digits>.m3dcache
+    constexpr char CACHE_EXTENSION[] = ".m3dcache";
+    constexpr i32 HASH_DIGITS = 16;
+    addr_size dirLen = core::cstrLen(cacheDirectory);
+    addr_size cachePathLen = dirLen + 1 + HASH_DIGITS + sizeof(CACHE_EXTENSION);
+    char* cachePath = reinterpret_cast<char*>(actx.alloc(cachePathLen, sizeof(char)));
+    defer { actx.free(cachePath, cachePathLen, sizeof(char)); };
+
+    core::memcopy(cachePath, cacheDirectory, dirLen);
+    cachePath[dirLen] = '/';
+    for (i32 i = 0; i < HASH_DIGITS; i++) {
+        cachePath[dirLen + 1 + addr_size(i)] = "0123456789abcdef"[(source.pathHash >> (60 - 4 * i)) & 0xF];
+    }
+    core::memcopy(cachePath + dirLen + 1 + HASH_DIGITS, CACHE_EXTENSION, sizeof(CACHE_EXTENSION));
+
+    auto cacheRes = loadModelCache(cachePath, &source);
+    if (cacheRes.hasValue()) {
+        return std::move(cacheRes.value());
+    }
+    if (cacheRes.err() != ModelCacheError::FailedToOpenFile) {
+        logInfo("Rebuilding model cache \"{}\" for \"{}\"; reason: {}", cachePath, path, errorToCstr(cacheRes.err()));
+    }
+
+    auto objRes = loadFile(path, fileVersion, actx);
+    if (objRes.hasErr()) {
+        return core::unexpected(objRes.err());
+    }
+    Model3D model = createModelFromWavefrontObj(std::move(objRes.value()), actx);
+
+    // writeModelCache logs its own failures, and without a cache only the next load is slower.
+    [[maybe_unused]] auto writeRes = writeModelCache(model, cachePath, source);
 
     return model;
 }
 
 namespace {
 
-template <i32 N>
-core::StrView nextToken(core::StrView line, const char (&delims)[N], core::StrView& token) {
-    token = {};
-    core::StrView ret = {};
-    for (i32 i = 0; i < N; i++) {
-        core::StrView component = {};
-        core::StrView rest = core::cut(line, delims[i], component);
-        if (!component.empty()) {
-            token = core::trim(component);
-            ret = core::trimWhiteSpaceLeft(rest);
-            break;
+// Separates a statement keyword from its arguments.
+constexpr bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+ByteClasses classifyBlock(const char* data, addr_size len) {
+    ByteClasses ret = {};
+
+    if (len >= CLASSIFY_BLOCK_SIZE) {
+        // '\t' through '\r' are found with a single unsigned compare: c - '\t' <= '\r' - '\t'.
+        // The AVX2 path needs an -mavx2 build (NATIVE_ARCH). This runs once per 32 bytes inside the tokenizer loops,
+        // and a runtime dispatched target function could not be inlined there.
+#if SIMD_AVX2_ENABLED
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        __m256i ctrl = _mm256_sub_epi8(c, _mm256_set1_epi8('\t'));
+        __m256i isCtrlSpace = _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8('\r' - '\t')), ctrl);
+        __m256i isSpace = _mm256_or_si256(isCtrlSpace, _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')));
+        ret.newline = u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))));
+        ret.space = u32(_mm256_movemask_epi8(isSpace));
+        ret.slash = u32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'))));
+        return ret;
+#elif SIMD_SSE2_ENABLED
+        for (i32 half = 0; half < 2; half++) {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + half * 16));
+            __m128i ctrl = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+            __m128i isCtrlSpace = _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), ctrl);
+            __m128i isSpace = _mm_or_si128(isCtrlSpace, _mm_cmpeq_epi8(c, _mm_set1_epi8(' ')));
+            ret.newline |= u32(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')))) << (half * 16);
+            ret.space |= u32(_mm_movemask_epi8(isSpace)) << (half * 16);
+            ret.slash |= u32(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')))) << (half * 16);
         }
+        return ret;
+#endif
+    }
+
+    // Bytes past the end read as newlines, which ends whatever line or token is in progress.
+    for (addr_size i = 0; i < CLASSIFY_BLOCK_SIZE; i++) {
+        u32 bit = u32(1) << i;
+        if (i >= len) {
+            ret.newline |= bit;
+            ret.space |= bit;
+            continue;
+        }
+
+        char c = data[i];
+        if (c == '\n') ret.newline |= bit;
+        if (c == ' ' || (c >= '\t' && c <= '\r')) ret.space |= bit;
+        if (c == '/') ret.slash |= bit;
     }
 
     return ret;
 }
 
-core::StrView skipToken(core::StrView line, char delim) {
-    [[maybe_unused]] core::StrView unused;
-    auto ret = nextToken(line, { delim }, unused);
+addr_size findNewline(const char* data, addr_size len) {
+    for (addr_size base = 0; base < len; base += CLASSIFY_BLOCK_SIZE) {
+        u32 newlines = classifyBlock(data + base, len - base).newline;
+        if (newlines) {
+            return core::core_min(base + addr_size(simdLowestSetBit(newlines)), len);
+        }
+    }
+
+    return len;
+}
+
+addr_size tokenizeLine(const char* data, addr_size len, LineTokens& out) {
+    // Walks the line once, a block at a time. Token starts and ends are the edges of the non-space mask, and they are
+    // visited in order together with the slashes, so every token knows where its slashes are without rescanning it.
+    out.count = 0;
+    addr_size tokenBegin = 0;
+    bool inToken = false;
+
+    for (addr_size base = 0;; base += CLASSIFY_BLOCK_SIZE) {
+        ByteClasses c = classifyBlock(data + base, base < len ? len - base : 0);
+
+        u32 beforeNewline = c.newline ? (c.newline & (0u - c.newline)) - 1 : ~u32(0);
+        u32 word = ~c.space & beforeNewline;
+        u32 prevWord = (word << 1) | u32(inToken);
+        u32 starts = word & ~prevWord;
+        u32 ends = ~word & prevWord;
+        u32 slashes = c.slash & beforeNewline;
+
+        u32 events = starts | ends | slashes;
+        while (events) {
+            i32 b = simdLowestSetBit(events);
+            u32 bit = u32(1) << b;
+            addr_size pos = base + addr_size(b);
+
+            if (ends & bit) {
+                if (out.count < MAX_LINE_TOKENS) {
+                    out.tokens[out.count] = core::sv(data + tokenBegin, pos - tokenBegin);
+                }
+                out.count++;
+            }
+            if (starts & bit) {
+                tokenBegin = pos;
+                if (out.count < MAX_LINE_TOKENS) {
+                    out.slashesCount[out.count] = 0;
+                }
+            }
+            if ((slashes & bit) && out.count < MAX_LINE_TOKENS) {
+                i32 k = out.slashesCount[out.count]++;
+                if (k < MAX_TOKEN_SLASHES) {
+                    out.slashes[out.count][k] = i32(pos - tokenBegin);
+                }
+            }
+
+            events &= events - 1;
+        }
+
+        inToken = (word >> 31) != 0;
+        if (c.newline) {
+            return core::core_min(base + addr_size(simdLowestSetBit(c.newline)), len);
+        }
+    }
+}
+
+constexpr Statement statementAt(const char* line, addr_size len) {
+    // A statement is its keyword followed by a blank, so "v\t1 2 3" is a vertex and "vp 1 2" is not. A group name is
+    // optional, so a lone "g" is a group statement as well.
+    if (len >= 1 && (line[0] == 'g' || line[0] == 'o')) {
+        if (len == 1 || isBlank(line[1]) || line[1] == '\r' || line[1] == '\n') return Statement::Group;
+        return Statement::None;
+    }
+    if (len >= 2 && isBlank(line[1])) {
+        if (line[0] == 'v') return Statement::Vertex;
+        if (line[0] == 'f') return Statement::Face;
+    }
+    else if (len >= 3 && line[0] == 'v' && isBlank(line[2])) {
+        if (line[1] == 't') return Statement::TextureCoord;
+        if (line[1] == 'n') return Statement::Normal;
+    }
+    return Statement::None;
+}
+
+core::StrView groupNameOf(const char* line, addr_size lineLen) {
+    // Everything after the keyword, without the surrounding blanks and the '\r' of a CRLF line ending.
+    addr_size begin = 1;
+    addr_size end = lineLen;
+    while (begin < end && isBlank(line[begin])) begin++;
+    while (end > begin && (isBlank(line[end - 1]) || line[end - 1] == '\r')) end--;
+    return core::sv(line + begin, end - begin);
+}
+
+StatementCounts countStatements(core::StrView contents) {
+    StatementCounts counts = {};
+    const char* data = contents.data();
+    addr_size len = contents.len();
+
+    auto countLine = [&](addr_size i) {
+        if (i >= len) return;
+        switch (statementAt(data + i, len - i)) {
+            case Statement::Vertex:       counts.vertices++;      break;
+            case Statement::TextureCoord: counts.textureCoords++; break;
+            case Statement::Normal:       counts.normals++;       break;
+            case Statement::Face:         counts.faces++;         break;
+            case Statement::Group: {
+                counts.groups++;
+                counts.groupNameBytes += i32(groupNameOf(data + i, findNewline(data + i, len - i)).len());
+                break;
+            }
+            case Statement::None:                                 break;
+        }
+    };
+
+    countLine(0);
+    for (addr_size base = 0; base < len; base += CLASSIFY_BLOCK_SIZE) {
+        u32 newlines = classifyBlock(data + base, len - base).newline;
+        while (newlines) {
+            countLine(base + addr_size(simdLowestSetBit(newlines)) + 1);
+            newlines &= newlines - 1;
+        }
+    }
+
+    return counts;
+}
+
+void allocateStorage(WavefrontObj& obj, const StatementCounts& counts, core::AllocatorContext& actx) {
+    obj.vertices = core::memoryZeroAllocate<core::vec4f>(addr_size(counts.vertices), actx);
+    obj.textureCoords = core::memoryZeroAllocate<core::vec3f>(addr_size(counts.textureCoords), actx);
+    obj.normals = core::memoryZeroAllocate<core::vec3f>(addr_size(counts.normals), actx);
+    obj.faces = core::memoryZeroAllocate<WavefrontObj::Face>(addr_size(counts.faces), actx);
+    obj.groups = core::memoryZeroAllocate<WavefrontObj::Group>(addr_size(counts.groups), actx);
+    obj.groupNames = core::memoryZeroAllocate<char>(addr_size(counts.groupNameBytes), actx);
+}
+
+ParseTarget sliceStorage(WavefrontObj& obj, const StatementCounts& offsets, const StatementCounts& counts) {
+    ParseTarget ret;
+    ret.vertices = { obj.vertices.data() + offsets.vertices, counts.vertices, 0 };
+    ret.textureCoords = { obj.textureCoords.data() + offsets.textureCoords, counts.textureCoords, 0 };
+    ret.normals = { obj.normals.data() + offsets.normals, counts.normals, 0 };
+    ret.faces = { obj.faces.data() + offsets.faces, counts.faces, 0 };
+    ret.groups = { obj.groups.data() + offsets.groups, counts.groups, 0 };
+    ret.groupNames = { obj.groupNames.data() + offsets.groupNameBytes, counts.groupNameBytes, 0 };
+    ret.facesBase = offsets.faces;
+    ret.groupNamesBase = offsets.groupNameBytes;
     return ret;
 }
 
-i32 countTokens(core::StrView currLine, char delim) {
-    i32 count = 0;
-    while (true) {
-        currLine = skipToken(currLine, delim);
-        if (currLine.empty()) break;
-        count++;
+void setCounts(WavefrontObj& obj, const StatementCounts& counts) {
+    obj.verticesCount = counts.vertices;
+    obj.textureCoordsCount = counts.textureCoords;
+    obj.normalsCount = counts.normals;
+    obj.facesCount = counts.faces;
+    obj.groupsCount = counts.groups;
+    obj.groupNamesSize = counts.groupNameBytes;
+}
+
+template <typename TTarget>
+core::expected<WavefrontError> parseStatements(core::StrView contents, TTarget& target) {
+    // Lines are told apart by statementAt, the same way countStatements counted them, so every slice fills up exactly.
+    const char* data = contents.data();
+    addr_size len = contents.len();
+    LineTokens tokens;
+
+    addr_size pos = 0;
+    while (pos < len) {
+        const char* line = data + pos;
+        addr_size rest = len - pos;
+        Statement statement = statementAt(line, rest);
+
+        addr_size lineLen;
+        if (statement == Statement::None) {
+            lineLen = findNewline(line, rest);
+            pos += lineLen + 1;
+            continue;
+        }
+        if (statement == Statement::Group) {
+            // Names are taken whole, they are not split into tokens.
+            lineLen = findNewline(line, rest);
+            target.onGroup(groupNameOf(line, lineLen));
+            pos += lineLen + 1;
+            continue;
+        }
+
+        lineLen = tokenizeLine(line, rest, tokens);
+        switch (statement) {
+            case Statement::Vertex: {
+                auto res = parseVertexLine(tokens);
+                if (res.hasErr()) return core::unexpected(res.err());
+                target.onVertex(res.value());
+                break;
+            }
+            case Statement::TextureCoord: {
+                auto res = parseTextureCoordLine(tokens);
+                if (res.hasErr()) return core::unexpected(res.err());
+                target.onTextureCoord(res.value());
+                break;
+            }
+            case Statement::Normal: {
+                auto res = parseNormalLine(tokens);
+                if (res.hasErr()) return core::unexpected(res.err());
+                target.onNormal(res.value());
+                break;
+            }
+            case Statement::Face: {
+                auto res = parseFaces(tokens);
+                if (res.hasErr()) return core::unexpected(res.err());
+                target.onFace(res.value());
+                break;
+            }
+            case Statement::Group: [[fallthrough]];
+            case Statement::None:
+                break;
+        }
+
+        pos += lineLen + 1;
     }
 
-    return count;
+    return {};
 }
 
-core::expected<core::vec4f, WavefrontError> parseVertexLine(core::StrView currLine) {
-    Assert(currLine[0] == 'v', "BUG: failed a basic sanity check");
+core::expected<MappedFile, WavefrontError> mapInputFile(const char* path) {
+    // The parsers read the file front to back straight from the page cache, so there is no buffer to zero and copy the
+    // file into.
+    auto mapRes = mapFile(path, MappingAccessHint::Sequential);
+    if (mapRes.hasErr()) {
+        if (mapRes.err() == FileMappingError::EmptyFile) {
+            return MappedFile{}; // An empty file is an empty object.
+        }
+
+        logErr("Failed to map file: \"{}\"; reason: {}", path, errorToCstr(mapRes.err()));
+        return core::unexpected(mapRes.err() == FileMappingError::FailedToStatFile ? WavefrontError::FailedToStatFile
+                                                                                     : WavefrontError::FailedToReadFile);
+    }
 
-    core::vec4f vertex;
-    core::StrView component;
+    return std::move(mapRes.value());
+}
 
-#if defined(IS_DEBUG)
-    vertex = core::v(-99.0f, -99.0f, -99.0f, -99.0f);
-#endif
+template <typename TFn>
+core::expected<WavefrontError> streamLines(const char* path, addr_size chunkSize, core::AllocatorContext& actx, TFn&& fn) {
+    auto openRes = openReadOnlyFile(path);
+    if (openRes.hasErr()) {
+        logErr("Failed to open file: \"{}\"; reason: {}", path, errorToCstr(openRes.err()));
+        return core::unexpected(openRes.err() == FileMappingError::FailedToStatFile ? WavefrontError::FailedToStatFile
+                                                                                      : WavefrontError::FailedToReadFile);
+    }
+    ReadOnlyFile file = openRes.value();
+    defer { file.free(); };
 
-    // Skip 'v '
-    currLine = skipToken(currLine, ' ');
+    core::Memory<char> buffer = core::memoryZeroAllocate<char>(core::core_max(chunkSize, addr_size(1)), actx);
+    defer { core::memoryFree(std::move(buffer), actx); };
+
+    addr_size fileOffset = 0;
+    addr_size carried = 0; // Bytes of an unfinished line at the front of the buffer.
+    while (fileOffset < file.size) {
+        if (carried == buffer.len()) {
+            core::Memory<char> grown = core::memoryZeroAllocate<char>(buffer.len() * 2, actx);
+            core::memcopy(grown.data(), buffer.data(), carried);
+            core::memoryFree(std::move(buffer), actx);
+            buffer = std::move(grown);
+        }
 
-    // Parse X component
-    {
-        currLine = nextToken(currLine, { ' ' }, component);
-        auto x = core::cstrToFloat<f32>(component.data(), u32(component.len()));
-        WAVEFRONT_CONV_ERR_CHECK(x);
-        vertex.x() = f32(x.value());
+        addr_size readSize = core::core_min(buffer.len() - carried, file.size - fileOffset);
+        if (auto res = readFileAt(file, fileOffset, buffer.data() + carried, readSize); res.hasErr()) {
+            logErr("Failed to read file: \"{}\"; reason: {}", path, errorToCstr(res.err()));
+            return core::unexpected(WavefrontError::FailedToReadFile);
+        }
+        fileOffset += readSize;
+        addr_size filled = carried + readSize;
+
+        // The last line of the file needs no newline, every other line ends at one.
+        addr_size linesEnd = filled;
+        if (fileOffset < file.size) {
+            while (linesEnd > 0 && buffer[linesEnd - 1] != '\n') linesEnd--;
+        }
+
+        if (linesEnd > 0) {
+            if (auto res = fn(core::sv(buffer.data(), linesEnd)); res.hasErr()) {
+                return core::unexpected(res.err());
+            }
+        }
+
+        // The regions can overlap, so copy front to back.
+        carried = filled - linesEnd;
+        for (addr_size i = 0; i < carried; i++) {
+            buffer[i] = buffer[linesEnd + i];
+        }
     }
 
-    // Parse Y component
-    {
-        currLine = nextToken(currLine, { ' ' }, component);
-        auto y = core::cstrToFloat<f32>(component.data(), u32(component.len()));
-        WAVEFRONT_CONV_ERR_CHECK(y);
-        vertex.y() = f32(y.value());
+    return {};
+}
+
+Model3D convertToModel(const WavefrontObj& obj, WavefrontObj* consumed, core::AllocatorContext& modelActx,
+                       VertexLayout layout) {
+    auto release = [consumed](auto WavefrontObj::* member) {
+        if (consumed && consumed->actx) core::memoryFree(std::move(consumed->*member), *consumed->actx);
+    };
+
+    // An interleaved vertex without a normal and a texture coordinate would be more than half zeros, so files that
+    // have neither get the compact position array.
+    bool positionsOnly = obj.textureCoordsCount == 0 && obj.normalsCount == 0;
+    if (positionsOnly && layout == VertexLayout::Interleaved) {
+        layout = VertexLayout::Positions;
     }
 
-    // Parse Z component
-    {
-        currLine = nextToken(currLine, { ' ', '\n' }, component);
-        auto z = core::cstrToFloat<f32>(component.data(), u32(component.len()));
-        WAVEFRONT_CONV_ERR_CHECK(z);
-        vertex.z() = f32(z.value());
+    Model3D model = {};
+    model.actx = &modelActx;
+    model.layout = layout;
+
+    for (i32 i = 0; i < obj.facesCount; i++) {
+        bool faceHasVertexIndices =
+            obj.faces[i].isSet(0, 0) &&
+            obj.faces[i].isSet(0, 1) &&
+            obj.faces[i].isSet(0, 2);
+
+        Assert(faceHasVertexIndices, "wavefront face is missing vertex indices, which are required by the standard");
     }
 
-    // Parse optional W component
-    if (!currLine.empty()) {
-        currLine = nextToken(currLine, { ' ', '\n' }, component);
-        auto w = core::cstrToFloat<f32>(component.data(), u32(component.len()));
-        WAVEFRONT_CONV_ERR_CHECK(w);
-        vertex.w() = f32(w.value());
+    model.faces = core::memoryZeroAllocate<Model3D::Face>(addr_size(obj.facesCount), modelActx);
+
+    // Positions only: every position is a vertex of its own and there is nothing to deduplicate.
+    i32 verticesCount = 0;
+    core::Memory<VertexKey> uniqueKeys;
+    defer { core::memoryFree(std::move(uniqueKeys), modelActx); };
+
+    if (positionsOnly) {
+        for (i32 i = 0; i < obj.facesCount; i++) {
+            const WavefrontObj::Face::FaceComponent& v = obj.faces[i].data[0];
+            model.faces[i][0] = v[0] - 1;
+            model.faces[i][1] = v[1] - 1;
+            model.faces[i][2] = v[2] - 1;
+        }
+        verticesCount = obj.verticesCount;
     }
+    else {
+        addr_size cornersCount = addr_size(obj.facesCount) * 3;
 
-    return vertex;
+        // Open addressing with linear probing, kept at most half full. A slot holds the index of the unique corner + 1,
+        // so a zeroed table is empty.
+        addr_size tableCap = 16;
+        i32 tableBits = 4;
+        while (tableCap < cornersCount * 2) {
+            tableCap *= 2;
+            tableBits++;
+        }
+        core::Memory<i32> table = core::memoryZeroAllocate<i32>(tableCap, modelActx);
+        defer { core::memoryFree(std::move(table), modelActx); };
+        uniqueKeys = core::memoryZeroAllocate<VertexKey>(cornersCount, modelActx);
+
+        for (i32 i = 0; i < obj.facesCount; i++) {
+            for (i32 j = 0; j < 3; j++) {
+                VertexKey key = cornerKey(obj, obj.faces[i], j);
+
+                addr_size slot = addr_size(hashVertexKey(key) >> (32 - tableBits));
+                while (true) {
+                    i32 entry = table[slot];
+                    if (entry == 0) {
+                        uniqueKeys[addr_size(verticesCount)] = key;
+                        table[slot] = ++verticesCount;
+                        model.faces[i][j] = verticesCount - 1;
+                        break;
+                    }
+                    if (uniqueKeys[addr_size(entry - 1)] == key) {
+                        model.faces[i][j] = entry - 1;
+                        break;
+                    }
+                    slot = (slot + 1) & (tableCap - 1);
+                }
+            }
+        }
+    }
+
+    // The faces are the largest part of the object, and they are not needed anymore.
+    release(&WavefrontObj::faces);
+
+    auto vertexKey = [&](i32 i) -> VertexKey {
+        return positionsOnly ? VertexKey{ i, -1, -1 } : uniqueKeys[addr_size(i)];
+    };
+    switch (layout) {
+        case VertexLayout::Interleaved:
+            fillInterleavedVertices(model, obj, verticesCount, vertexKey);
+            break;
+        case VertexLayout::Separate:
+            fillVertexStreams(model, obj, verticesCount, vertexKey);
+            break;
+        case VertexLayout::Positions:
+            // The positions of a positions only object are its parsed vertices, in order, so a consumed object from
+            // the same allocator hands its array over instead of having it copied.
+            if (positionsOnly && consumed && consumed->actx == &modelActx &&
+                consumed->vertices.len() == addr_size(verticesCount)) {
+                model.positions = std::move(consumed->vertices);
+                consumed->vertices = {};
+                break;
+            }
+            model.positions = core::memoryZeroAllocate<core::vec4f>(addr_size(verticesCount), modelActx);
+            for (i32 i = 0; i < verticesCount; i++) {
+                model.positions[addr_size(i)] = obj.vertices[vertexKey(i).v];
+            }
+            break;
+    }
+
+    buildSubmeshes(model, obj);
+
+    release(&WavefrontObj::vertices);
+    release(&WavefrontObj::textureCoords);
+    release(&WavefrontObj::normals);
+    release(&WavefrontObj::groups);
+    release(&WavefrontObj::groupNames);
+
+    return model;
 }
 
-[[nodiscard]] core::expected<WavefrontObj::Face, WavefrontError> parseFaces(core::StrView currLine) {
-    using WavefrontObj = WavefrontObj;
-    using Face = WavefrontObj::Face;
-    constexpr i32 DIMMENTIONS = WavefrontObj::Face::DIMMENTIONS;
+template <typename TKeyFn>
+void fillInterleavedVertices(Model3D& model, const WavefrontObj& obj, i32 verticesCount, TKeyFn&& vertexKey) {
+    core::AllocatorContext& actx = *model.actx;
+    model.vertices = core::memoryZeroAllocate<Model3D::Vertex>(addr_size(verticesCount), actx);
 
-    Assert(currLine[0] == 'f', "BUG: failed a basic sanity check");
+    for (i32 i = 0; i < verticesCount; i++) {
+        VertexKey key = vertexKey(i);
+        Model3D::Vertex& vertex = model.vertices[addr_size(i)];
 
-    auto parseFaceComponent = [](core::StrView component, Face& face, i32 faceIdx) -> core::expected<WavefrontError> {
-        core::StrView faceComponents[DIMMENTIONS];
-        addr_size faceComponentsCount = 0;
-        bool ok = core::split(component, '/', faceComponents, DIMMENTIONS, faceComponentsCount);
-        if (!ok) {
-            return core::unexpected(WavefrontError::InvalidFileFormat);
+        vertex.position = obj.vertices[key.v];
+        if (key.vn >= 0) {
+            vertex.normal = obj.normals[key.vn];
         }
+        if (key.vt >= 0) {
+            const core::vec3f& tc = obj.textureCoords[key.vt];
+            vertex.textureCoord = core::v(tc.x(), tc.y());
+        }
+    }
+}
 
-        for (addr_size i = 0; i < faceComponentsCount; i++) {
-            auto fcSv = faceComponents[i];
-            if (fcSv.len() > 0) {
-                auto res = core::cstrToInt<i32>(fcSv.data(), u32(fcSv.len()));
-                WAVEFRONT_CONV_ERR_CHECK(res);
-                face.data[i][faceIdx] = res.value();
-                face.set(i32(i), faceIdx);
+template <typename TKeyFn>
+void fillVertexStreams(Model3D& model, const WavefrontObj& obj, i32 verticesCount, TKeyFn&& vertexKey) {
+    core::AllocatorContext& actx = *model.actx;
+    Model3D::VertexStreams& streams = model.streams;
+    addr_size count = addr_size(verticesCount);
+
+    bool everyWIsOne = true;
+    for (i32 i = 0; i < obj.verticesCount; i++) {
+        everyWIsOne &= obj.vertices[i].w() == 1.0f;
+    }
+
+    streams.x = core::memoryZeroAllocate<f32>(count, actx);
+    streams.y = core::memoryZeroAllocate<f32>(count, actx);
+    streams.z = core::memoryZeroAllocate<f32>(count, actx);
+    if (!everyWIsOne) {
+        streams.w = core::memoryZeroAllocate<f32>(count, actx);
+    }
+    if (obj.normalsCount > 0) {
+        streams.normals = core::memoryZeroAllocate<core::vec3f>(count, actx);
+    }
+    if (obj.textureCoordsCount > 0) {
+        streams.textureCoords = core::memoryZeroAllocate<core::vec2f>(count, actx);
+    }
+
+    for (i32 i = 0; i < verticesCount; i++) {
+        VertexKey key = vertexKey(i);
+        addr_size idx = addr_size(i);
+
+        const core::vec4f& position = obj.vertices[key.v];
+        streams.x[idx] = position.x();
+        streams.y[idx] = position.y();
+        streams.z[idx] = position.z();
+        if (!everyWIsOne) {
+            streams.w[idx] = position.w();
+        }
+        if (key.vn >= 0) {
+            streams.normals[idx] = obj.normals[key.vn];
+        }
+        if (key.vt >= 0) {
+            const core::vec3f& tc = obj.textureCoords[key.vt];
+            streams.textureCoords[idx] = core::v(tc.x(), tc.y());
+        }
+    }
+}
+
+void buildSubmeshes(Model3D& model, const WavefrontObj& obj) {
+    core::AllocatorContext& actx = *model.actx;
+
+    // Run 0 holds the faces before the first group, run r > 0 the faces of group r - 1. Runs without faces are dropped.
+    i32 runsCount = obj.groupsCount + 1;
+    auto runBegin = [&](i32 r) { return r == 0 ? 0 : obj.groups[r - 1].firstFace; };
+    auto runEnd = [&](i32 r) { return r < obj.groupsCount ? obj.groups[r].firstFace : obj.facesCount; };
+
+    i32 submeshesCount = 0;
+    for (i32 r = 0; r < runsCount; r++) {
+        if (runEnd(r) > runBegin(r)) submeshesCount++;
+    }
+
+    model.submeshes = core::memoryZeroAllocate<Model3D::Submesh>(addr_size(submeshesCount), actx);
+    model.submeshNames = core::memoryZeroAllocate<char>(addr_size(obj.groupNamesSize), actx);
+    if (obj.groupNamesSize > 0) {
+        core::memcopy(model.submeshNames.data(), obj.groupNames.data(), addr_size(obj.groupNamesSize));
+    }
+
+    i32 k = 0;
+    for (i32 r = 0; r < runsCount; r++) {
+        i32 begin = runBegin(r);
+        i32 end = runEnd(r);
+        if (end <= begin) continue;
+
+        Model3D::Submesh& submesh = model.submeshes[addr_size(k++)];
+        submesh.firstFace = begin;
+        submesh.facesCount = end - begin;
+        if (r > 0) {
+            submesh.nameOffset = obj.groups[r - 1].nameOffset;
+            submesh.nameLength = obj.groups[r - 1].nameLength;
+        }
+
+        core::vec4f first = model.position(addr_size(model.faces[addr_size(begin)][0]));
+        core::vec3f lo = core::v(first.x(), first.y(), first.z());
+        core::vec3f hi = lo;
+        for (i32 i = begin; i < end; i++) {
+            for (i32 j = 0; j < 3; j++) {
+                core::vec4f p = model.position(addr_size(model.faces[addr_size(i)][j]));
+                lo = core::v(core::core_min(lo.x(), p.x()), core::core_min(lo.y(), p.y()), core::core_min(lo.z(), p.z()));
+                hi = core::v(core::core_max(hi.x(), p.x()), core::core_max(hi.y(), p.y()), core::core_max(hi.z(), p.z()));
             }
         }
+        submesh.boundsMin = lo;
+        submesh.boundsMax = hi;
+    }
+}
+
+VertexKey cornerKey(const WavefrontObj& obj, const WavefrontObj::Face& face, i32 corner) {
+    auto index = [&](i32 dimension, i32 count) -> i32 {
+        if (!face.isSet(dimension, corner)) return -1;
+        i32 idx = face.data[dimension][corner] - 1;
+        Assert(idx >= 0 && idx < count, "wavefront face index is out of range");
+        return idx;
+    };
+
+    VertexKey key;
+    key.v = index(0, obj.verticesCount);
+    key.vt = index(1, obj.textureCoordsCount);
+    key.vn = index(2, obj.normalsCount);
+    return key;
+}
+
+constexpr u32 hashVertexKey(const VertexKey& key) {
+    // Multiplicative mixing; the table uses the top bits, which depend on every input bit.
+    u32 h = u32(key.v) * 0x9E3779B1u;
+    h ^= u32(key.vt) * 0x85EBCA77u;
+    h ^= u32(key.vn) * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+core::expected<core::vec4f, WavefrontError> parseVertexLine(const LineTokens& line) {
+    Assert(line.count > 0 && line.tokens[0][0] == 'v', "BUG: failed a basic sanity check");
+
+    core::vec4f vertex;
 
+#if defined(IS_DEBUG)
+    vertex = core::v(-99.0f, -99.0f, -99.0f, -99.0f);
+#endif
+
+    // 'v' followed by x, y, z and an optional w.
+    if (line.count < 4) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    auto parseComponent = [&line](i32 tokenIdx, f32& out) -> core::expected<WavefrontError> {
+        const core::StrView& component = line.tokens[tokenIdx];
+        auto res = parseFloat(component.data(), component.len());
+        if (res.hasErr()) return core::unexpected(res.err());
+        out = res.value();
         return {};
     };
 
-    WavefrontObj::Face face = {};
+    if (auto res = parseComponent(1, vertex.x()); res.hasErr()) return core::unexpected(res.err());
+    if (auto res = parseComponent(2, vertex.y()); res.hasErr()) return core::unexpected(res.err());
+    if (auto res = parseComponent(3, vertex.z()); res.hasErr()) return core::unexpected(res.err());
+    if (line.count > 4) {
+        if (auto res = parseComponent(4, vertex.w()); res.hasErr()) return core::unexpected(res.err());
+    }
+    else {
+        vertex.w() = 1.0f; // The standard's default.
+    }
+
+    return vertex;
+}
+
+core::expected<core::vec3f, WavefrontError> parseTextureCoordLine(const LineTokens& line) {
+    Assert(line.count > 0 && line.tokens[0][0] == 'v' && line.tokens[0][1] == 't', "BUG: failed a basic sanity check");
+
+    // 'vt' followed by u and the optional v and w.
+    if (line.count < 2) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    f32 components[3] = {};
+    if (auto res = parseFloatTokens(line, core::core_min(line.count - 1, 3), components); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    return core::v(components[0], components[1], components[2]);
+}
+
+core::expected<core::vec3f, WavefrontError> parseNormalLine(const LineTokens& line) {
+    Assert(line.count > 0 && line.tokens[0][0] == 'v' && line.tokens[0][1] == 'n', "BUG: failed a basic sanity check");
+
+    // 'vn' followed by x, y and z.
+    if (line.count != 4) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    f32 components[3];
+    if (auto res = parseFloatTokens(line, 3, components); res.hasErr()) {
+        return core::unexpected(res.err());
+    }
+
+    return core::v(components[0], components[1], components[2]);
+}
+
+core::expected<WavefrontError> parseFloatTokens(const LineTokens& line, i32 count, f32* out) {
+    Assert(count < line.count && count <= MAX_LINE_TOKENS - 1, "BUG: not enough tokens");
+
+    for (i32 i = 0; i < count; i++) {
+        const core::StrView& token = line.tokens[i + 1];
+        auto res = parseFloat(token.data(), token.len());
+        if (res.hasErr()) return core::unexpected(res.err());
+        out[i] = res.value();
+    }
 
-    // Skip 'f '
-    currLine = skipToken(currLine, ' ');
+    return {};
+}
 
-    i32 componentsCount = countTokens(currLine, ' ');
+core::expected<WavefrontObj::Face, WavefrontError> parseFaces(const LineTokens& line) {
+    using Face = WavefrontObj::Face;
+    constexpr i32 DIMMENTIONS = WavefrontObj::Face::DIMMENTIONS;
 
-    if (componentsCount != DIMMENTIONS - 1) {
+    Assert(line.count > 0 && line.tokens[0][0] == 'f', "BUG: failed a basic sanity check");
+
+    if (line.count != DIMMENTIONS + 1) {
         logErr(
             "TODO: [WAVEFRONT] Face components with more than {} dimensions are not supported yet; or maybe never will.",
             DIMMENTIONS
@@ -260,40 +1118,28 @@ core::expected<core::vec4f, WavefrontError> parseVertexLine(core::StrView currLi
         return core::unexpected(WavefrontError::InvalidFileFormat);
     }
 
-    // Parse vertex indices
-    {
-        core::StrView component = {};
-        currLine = nextToken(currLine, { ' ' }, component);
-        if (component.empty()) {
-            return core::unexpected(WavefrontError::InvalidFileFormat);
-        }
-        auto res = parseFaceComponent(component, face, 0);
-        if (res.hasErr()) return core::unexpected(res.err());
-        componentsCount--;
-    }
+    Face face = {};
 
-    // Parse vertex texture indices
-    {
-        core::StrView component = {};
-        currLine = nextToken(currLine, { ' ' }, component);
-        if (component.empty()) {
+    // Each token is v, v/vt, v//vn or v/vt/vn. The slashes were found by the tokenizer.
+    for (i32 faceIdx = 0; faceIdx < DIMMENTIONS; faceIdx++) {
+        i32 tokenIdx = faceIdx + 1;
+        const core::StrView& token = line.tokens[tokenIdx];
+        i32 slashesCount = line.slashesCount[tokenIdx];
+        if (slashesCount > DIMMENTIONS - 1) {
             return core::unexpected(WavefrontError::InvalidFileFormat);
         }
-        auto res = parseFaceComponent(component, face, 1);
-        if (res.hasErr()) return core::unexpected(res.err());
-        componentsCount--;
-    }
 
-    // Parse vertex normal indices
-    {
-        core::StrView component = {};
-        currLine = nextToken(currLine, { ' ', '\n' }, component);
-        if (component.empty()) {
-            return core::unexpected(WavefrontError::InvalidFileFormat);
+        i32 begin = 0;
+        for (i32 i = 0; i <= slashesCount; i++) {
+            i32 end = i < slashesCount ? line.slashes[tokenIdx][i] : i32(token.len());
+            if (end > begin) {
+                auto res = parseInt(token.data() + begin, addr_size(end - begin));
+                if (res.hasErr()) return core::unexpected(res.err());
+                face.data[i][faceIdx] = res.value();
+                face.set(i, faceIdx);
+            }
+            begin = end + 1;
         }
-        auto res = parseFaceComponent(component, face, 2);
-        if (res.hasErr()) return core::unexpected(res.err());
-        componentsCount--;
     }
 
     return face;
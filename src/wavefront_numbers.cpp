@@ -0,0 +1,441 @@
+#include "wavefront_numbers.h"
+
+#include <cstdlib>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+#endif
+
+namespace Wavefront {
+
+namespace {
+
+constexpr i32 MAX_MANTISSA_DIGITS = 19; // Any 19 decimal digits fit in a u64.
+constexpr i64 MAX_EXPONENT_DIGITS_VALUE = 100000;
+
+// Float multiplies and divides are exact for mantissas up to 2^24 and powers of ten up to 10^10 (5^10 < 2^24), so a
+// single operation on them is correctly rounded.
+constexpr u64 FAST_PATH_MAX_MANTISSA = u64(1) << 24;
+constexpr i64 FAST_PATH_MAX_EXPONENT = 10;
+constexpr f32 FAST_PATH_POWERS_OF_TEN[FAST_PATH_MAX_EXPONENT + 1] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+// binary32 parameters of Eisel-Lemire. Below 10^-64 even the largest 19 digit mantissa rounds to zero, above 10^38
+// even a single digit is infinity.
+constexpr i32 F32_MANTISSA_BITS = 23;
+constexpr i32 F32_MIN_EXPONENT = -127;
+constexpr i32 F32_INFINITE_POWER = 0xFF;
+constexpr i64 F32_SMALLEST_POWER_OF_TEN = -64;
+constexpr i64 F32_LARGEST_POWER_OF_TEN = 38;
+constexpr i64 F32_MIN_EXPONENT_ROUND_TO_EVEN = -17;
+constexpr i64 F32_MAX_EXPONENT_ROUND_TO_EVEN = 10;
+
+struct U128 {
+    u64 high;
+    u64 low;
+};
+
+// 128 bit approximations of 5^q for q in [F32_SMALLEST_POWER_OF_TEN, F32_LARGEST_POWER_OF_TEN], normalized so the top
+// bit is set. Negative powers are rounded up, positive ones truncated.
+constexpr U128 POWERS_OF_FIVE[] = {
+    { 0xA87FEA27A539E9A5, 0x3F2398D747B36224 }, // 5^-64
+    { 0xD29FE4B18E88640E, 0x8EEC7F0D19A03AAD }, // 5^-63
+    { 0x83A3EEEEF9153E89, 0x1953CF68300424AC }, // 5^-62
+    { 0xA48CEAAAB75A8E2B, 0x5FA8C3423C052DD7 }, // 5^-61
+    { 0xCDB02555653131B6, 0x3792F412CB06794D }, // 5^-60
+    { 0x808E17555F3EBF11, 0xE2BBD88BBEE40BD0 }, // 5^-59
+    { 0xA0B19D2AB70E6ED6, 0x5B6ACEAEAE9D0EC4 }, // 5^-58
+    { 0xC8DE047564D20A8B, 0xF245825A5A445275 }, // 5^-57
+    { 0xFB158592BE068D2E, 0xEED6E2F0F0D56712 }, // 5^-56
+    { 0x9CED737BB6C4183D, 0x55464DD69685606B }, // 5^-55
+    { 0xC428D05AA4751E4C, 0xAA97E14C3C26B886 }, // 5^-54
+    { 0xF53304714D9265DF, 0xD53DD99F4B3066A8 }, // 5^-53
+    { 0x993FE2C6D07B7FAB, 0xE546A8038EFE4029 }, // 5^-52
+    { 0xBF8FDB78849A5F96, 0xDE98520472BDD033 }, // 5^-51
+    { 0xEF73D256A5C0F77C, 0x963E66858F6D4440 }, // 5^-50
+    { 0x95A8637627989AAD, 0xDDE7001379A44AA8 }, // 5^-49
+    { 0xBB127C53B17EC159, 0x5560C018580D5D52 }, // 5^-48
+    { 0xE9D71B689DDE71AF, 0xAAB8F01E6E10B4A6 }, // 5^-47
+    { 0x9226712162AB070D, 0xCAB3961304CA70E8 }, // 5^-46
+    { 0xB6B00D69BB55C8D1, 0x3D607B97C5FD0D22 }, // 5^-45
+    { 0xE45C10C42A2B3B05, 0x8CB89A7DB77C506A }, // 5^-44
+    { 0x8EB98A7A9A5B04E3, 0x77F3608E92ADB242 }, // 5^-43
+    { 0xB267ED1940F1C61C, 0x55F038B237591ED3 }, // 5^-42
+    { 0xDF01E85F912E37A3, 0x6B6C46DEC52F6688 }, // 5^-41
+    { 0x8B61313BBABCE2C6, 0x2323AC4B3B3DA015 }, // 5^-40
+    { 0xAE397D8AA96C1B77, 0xABEC975E0A0D081A }, // 5^-39
+    { 0xD9C7DCED53C72255, 0x96E7BD358C904A21 }, // 5^-38
+    { 0x881CEA14545C7575, 0x7E50D64177DA2E54 }, // 5^-37
+    { 0xAA242499697392D2, 0xDDE50BD1D5D0B9E9 }, // 5^-36
+    { 0xD4AD2DBFC3D07787, 0x955E4EC64B44E864 }, // 5^-35
+    { 0x84EC3C97DA624AB4, 0xBD5AF13BEF0B113E }, // 5^-34
+    { 0xA6274BBDD0FADD61, 0xECB1AD8AEACDD58E }, // 5^-33
+    { 0xCFB11EAD453994BA, 0x67DE18EDA5814AF2 }, // 5^-32
+    { 0x81CEB32C4B43FCF4, 0x80EACF948770CED7 }, // 5^-31
+    { 0xA2425FF75E14FC31, 0xA1258379A94D028D }, // 5^-30
+    { 0xCAD2F7F5359A3B3E, 0x096EE45813A04330 }, // 5^-29
+    { 0xFD87B5F28300CA0D, 0x8BCA9D6E188853FC }, // 5^-28
+    { 0x9E74D1B791E07E48, 0x775EA264CF55347E }, // 5^-27
+    { 0xC612062576589DDA, 0x95364AFE032A819E }, // 5^-26
+    { 0xF79687AED3EEC551, 0x3A83DDBD83F52205 }, // 5^-25
+    { 0x9ABE14CD44753B52, 0xC4926A9672793543 }, // 5^-24
+    { 0xC16D9A0095928A27, 0x75B7053C0F178294 }, // 5^-23
+    { 0xF1C90080BAF72CB1, 0x5324C68B12DD6339 }, // 5^-22
+    { 0x971DA05074DA7BEE, 0xD3F6FC16EBCA5E04 }, // 5^-21
+    { 0xBCE5086492111AEA, 0x88F4BB1CA6BCF585 }, // 5^-20
+    { 0xEC1E4A7DB69561A5, 0x2B31E9E3D06C32E6 }, // 5^-19
+    { 0x9392EE8E921D5D07, 0x3AFF322E62439FD0 }, // 5^-18
+    { 0xB877AA3236A4B449, 0x09BEFEB9FAD487C3 }, // 5^-17
+    { 0xE69594BEC44DE15B, 0x4C2EBE687989A9B4 }, // 5^-16
+    { 0x901D7CF73AB0ACD9, 0x0F9D37014BF60A11 }, // 5^-15
+    { 0xB424DC35095CD80F, 0x538484C19EF38C95 }, // 5^-14
+    { 0xE12E13424BB40E13, 0x2865A5F206B06FBA }, // 5^-13
+    { 0x8CBCCC096F5088CB, 0xF93F87B7442E45D4 }, // 5^-12
+    { 0xAFEBFF0BCB24AAFE, 0xF78F69A51539D749 }, // 5^-11
+    { 0xDBE6FECEBDEDD5BE, 0xB573440E5A884D1C }, // 5^-10
+    { 0x89705F4136B4A597, 0x31680A88F8953031 }, // 5^-9
+    { 0xABCC77118461CEFC, 0xFDC20D2B36BA7C3E }, // 5^-8
+    { 0xD6BF94D5E57A42BC, 0x3D32907604691B4D }, // 5^-7
+    { 0x8637BD05AF6C69B5, 0xA63F9A49C2C1B110 }, // 5^-6
+    { 0xA7C5AC471B478423, 0x0FCF80DC33721D54 }, // 5^-5
+    { 0xD1B71758E219652B, 0xD3C36113404EA4A9 }, // 5^-4
+    { 0x83126E978D4FDF3B, 0x645A1CAC083126EA }, // 5^-3
+    { 0xA3D70A3D70A3D70A, 0x3D70A3D70A3D70A4 }, // 5^-2
+    { 0xCCCCCCCCCCCCCCCC, 0xCCCCCCCCCCCCCCCD }, // 5^-1
+    { 0x8000000000000000, 0x0000000000000000 }, // 5^0
+    { 0xA000000000000000, 0x0000000000000000 }, // 5^1
+    { 0xC800000000000000, 0x0000000000000000 }, // 5^2
+    { 0xFA00000000000000, 0x0000000000000000 }, // 5^3
+    { 0x9C40000000000000, 0x0000000000000000 }, // 5^4
+    { 0xC350000000000000, 0x0000000000000000 }, // 5^5
+    { 0xF424000000000000, 0x0000000000000000 }, // 5^6
+    { 0x9896800000000000, 0x0000000000000000 }, // 5^7
+    { 0xBEBC200000000000, 0x0000000000000000 }, // 5^8
+    { 0xEE6B280000000000, 0x0000000000000000 }, // 5^9
+    { 0x9502F90000000000, 0x0000000000000000 }, // 5^10
+    { 0xBA43B74000000000, 0x0000000000000000 }, // 5^11
+    { 0xE8D4A51000000000, 0x0000000000000000 }, // 5^12
+    { 0x9184E72A00000000, 0x0000000000000000 }, // 5^13
+    { 0xB5E620F480000000, 0x0000000000000000 }, // 5^14
+    { 0xE35FA931A0000000, 0x0000000000000000 }, // 5^15
+    { 0x8E1BC9BF04000000, 0x0000000000000000 }, // 5^16
+    { 0xB1A2BC2EC5000000, 0x0000000000000000 }, // 5^17
+    { 0xDE0B6B3A76400000, 0x0000000000000000 }, // 5^18
+    { 0x8AC7230489E80000, 0x0000000000000000 }, // 5^19
+    { 0xAD78EBC5AC620000, 0x0000000000000000 }, // 5^20
+    { 0xD8D726B7177A8000, 0x0000000000000000 }, // 5^21
+    { 0x878678326EAC9000, 0x0000000000000000 }, // 5^22
+    { 0xA968163F0A57B400, 0x0000000000000000 }, // 5^23
+    { 0xD3C21BCECCEDA100, 0x0000000000000000 }, // 5^24
+    { 0x84595161401484A0, 0x0000000000000000 }, // 5^25
+    { 0xA56FA5B99019A5C8, 0x0000000000000000 }, // 5^26
+    { 0xCECB8F27F4200F3A, 0x0000000000000000 }, // 5^27
+    { 0x813F3978F8940984, 0x4000000000000000 }, // 5^28
+    { 0xA18F07D736B90BE5, 0x5000000000000000 }, // 5^29
+    { 0xC9F2C9CD04674EDE, 0xA400000000000000 }, // 5^30
+    { 0xFC6F7C4045812296, 0x4D00000000000000 }, // 5^31
+    { 0x9DC5ADA82B70B59D, 0xF020000000000000 }, // 5^32
+    { 0xC5371912364CE305, 0x6C28000000000000 }, // 5^33
+    { 0xF684DF56C3E01BC6, 0xC732000000000000 }, // 5^34
+    { 0x9A130B963A6C115C, 0x3C7F400000000000 }, // 5^35
+    { 0xC097CE7BC90715B3, 0x4B9F100000000000 }, // 5^36
+    { 0xF0BDC21ABB48DB20, 0x1E86D40000000000 }, // 5^37
+    { 0x96769950B50D88F4, 0x1314448000000000 }, // 5^38
+};
+static_assert(sizeof(POWERS_OF_FIVE) / sizeof(POWERS_OF_FIVE[0]) == F32_LARGEST_POWER_OF_TEN - F32_SMALLEST_POWER_OF_TEN + 1);
+
+struct DecimalNumber {
+    u64 mantissa;
+    i64 exponent;
+    bool negative;
+    bool truncated; // There were more than MAX_MANTISSA_DIGITS significant digits and only the first ones were kept.
+};
+
+[[nodiscard]] bool parseDecimal(const char* s, addr_size len, DecimalNumber& out);
+[[nodiscard]] u32 eiselLemire(u64 w, i64 q);
+[[nodiscard]] core::expected<f32, WavefrontError> parseFloatFallback(const char* s, addr_size len);
+
+[[nodiscard]] constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+[[nodiscard]] u64 loadEightBytes(const char* s);
+[[nodiscard]] bool isEightDigits(u64 chunk);
+[[nodiscard]] u32 parseEightDigits(u64 chunk);
+[[nodiscard]] U128 multiply(u64 a, u64 b);
+[[nodiscard]] i32 leadingZeros(u64 x);
+[[nodiscard]] f32 f32FromBits(u32 bits);
+
+} // namespace
+
+core::expected<f32, WavefrontError> parseFloat(const char* s, addr_size len) {
+    DecimalNumber d;
+    if (!parseDecimal(s, len, d)) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    if (d.mantissa == 0) {
+        return d.negative ? -0.0f : 0.0f;
+    }
+
+    if (!d.truncated && d.mantissa <= FAST_PATH_MAX_MANTISSA &&
+        d.exponent >= -FAST_PATH_MAX_EXPONENT && d.exponent <= FAST_PATH_MAX_EXPONENT) {
+        f32 v = f32(d.mantissa);
+        if (d.exponent < 0) v /= FAST_PATH_POWERS_OF_TEN[-d.exponent];
+        else                v *= FAST_PATH_POWERS_OF_TEN[d.exponent];
+        return d.negative ? -v : v;
+    }
+
+    u32 bits = eiselLemire(d.mantissa, d.exponent);
+    if (d.truncated && bits != eiselLemire(d.mantissa + 1, d.exponent)) {
+        // The dropped digits decide the rounding.
+        return parseFloatFallback(s, len);
+    }
+
+    if (d.negative) bits |= u32(1) << 31;
+    return f32FromBits(bits);
+}
+
+core::expected<i32, WavefrontError> parseInt(const char* s, addr_size len) {
+    addr_size i = 0;
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+')) {
+        negative = s[i] == '-';
+        i++;
+    }
+    if (i == len) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    // Leading zeros would count against the 10 digit limit.
+    while (len - i > 1 && s[i] == '0') i++;
+
+    addr_size digitsCount = len - i;
+    if (digitsCount > 10) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    u64 value = 0;
+    for (; digitsCount > 8; digitsCount--, i++) {
+        if (!isDigit(s[i])) return core::unexpected(WavefrontError::InvalidFileFormat);
+        value = value * 10 + u64(s[i] - '0');
+    }
+
+    // The remaining 1 to 8 digits go in one chunk, padded in front with '0's.
+    u64 chunk = 0x3030303030303030;
+    core::memcopy(reinterpret_cast<char*>(&chunk) + (8 - digitsCount), s + i, digitsCount);
+    if (!isEightDigits(chunk)) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+    value = value * 100000000 + parseEightDigits(chunk);
+
+    u64 limit = negative ? u64(1) << 31 : (u64(1) << 31) - 1;
+    if (value > limit) {
+        return core::unexpected(WavefrontError::InvalidFileFormat);
+    }
+
+    return negative ? i32(-i64(value)) : i32(value);
+}
+
+namespace {
+
+bool parseDecimal(const char* s, addr_size len, DecimalNumber& out) {
+    out = {};
+    addr_size i = 0;
+
+    if (i < len && (s[i] == '-' || s[i] == '+')) {
+        out.negative = s[i] == '-';
+        i++;
+    }
+
+    i32 digitsCount = 0;
+    auto pushDigit = [&](char c) -> bool {
+        if (digitsCount < MAX_MANTISSA_DIGITS) {
+            out.mantissa = out.mantissa * 10 + u64(c - '0');
+            digitsCount++;
+            return true;
+        }
+        out.truncated |= c != '0';
+        return false;
+    };
+
+    // Integer part. Leading zeros are not significant.
+    addr_size intBegin = i;
+    while (i < len && s[i] == '0') i++;
+    for (; i < len && isDigit(s[i]); i++) {
+        if (!pushDigit(s[i])) out.exponent++;
+    }
+    bool hasDigits = i > intBegin;
+
+    // Fraction part. Zeros right after the dot are not significant either when nothing came before them.
+    if (i < len && s[i] == '.') {
+        i++;
+        addr_size fracBegin = i;
+        if (out.mantissa == 0) {
+            for (; i < len && s[i] == '0'; i++) out.exponent--;
+        }
+        while (len - i >= 8 && digitsCount + 8 <= MAX_MANTISSA_DIGITS) {
+            u64 chunk = loadEightBytes(s + i);
+            if (!isEightDigits(chunk)) break;
+            out.mantissa = out.mantissa * 100000000 + parseEightDigits(chunk);
+            digitsCount += 8;
+            out.exponent -= 8;
+            i += 8;
+        }
+        for (; i < len && isDigit(s[i]); i++) {
+            if (pushDigit(s[i])) out.exponent--;
+        }
+        hasDigits |= i > fracBegin;
+    }
+
+    if (!hasDigits) {
+        return false;
+    }
+
+    if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        bool negativeExponent = false;
+        if (i < len && (s[i] == '-' || s[i] == '+')) {
+            negativeExponent = s[i] == '-';
+            i++;
+        }
+        if (i == len || !isDigit(s[i])) {
+            return false;
+        }
+
+        // Anything this far out is zero or infinity anyway, so saturating keeps the sum from overflowing.
+        i64 exponent = 0;
+        for (; i < len && isDigit(s[i]); i++) {
+            if (exponent < MAX_EXPONENT_DIGITS_VALUE) exponent = exponent * 10 + i64(s[i] - '0');
+        }
+        out.exponent += negativeExponent ? -exponent : exponent;
+    }
+
+    return i == len;
+}
+
+u32 eiselLemire(u64 w, i64 q) {
+    // Returns the bits of the float nearest to w * 10^q, without the sign. See Daniel Lemire, "Number Parsing at a
+    // Gigabyte per Second", and Noble Mushtak and Daniel Lemire, "Fast Number Parsing Without Fallback", for why the
+    // 128 bit product is always enough when w holds every digit of the number.
+    if (w == 0 || q < F32_SMALLEST_POWER_OF_TEN) return 0;
+    if (q > F32_LARGEST_POWER_OF_TEN) return u32(F32_INFINITE_POWER) << F32_MANTISSA_BITS;
+
+    i32 lz = leadingZeros(w);
+    w <<= lz;
+
+    const U128& power = POWERS_OF_FIVE[q - F32_SMALLEST_POWER_OF_TEN];
+    constexpr u64 PRECISION_MASK = ~u64(0) >> (F32_MANTISSA_BITS + 3);
+    U128 product = multiply(w, power.high);
+    if ((product.high & PRECISION_MASK) == PRECISION_MASK) {
+        // The low bits are all ones, so the truncated part of 5^q can still carry into them.
+        U128 second = multiply(w, power.low);
+        product.low += second.high;
+        if (second.high > product.low) product.high++;
+    }
+
+    i32 upperBit = i32(product.high >> 63);
+    i32 shift = upperBit + 64 - F32_MANTISSA_BITS - 3;
+    u64 mantissa = product.high >> shift;
+    // floor(log2(10^q)) + 63, exact for the exponents that get here.
+    i32 power2 = i32((((152170 + 65536) * q) >> 16) + 63) + upperBit - lz - F32_MIN_EXPONENT;
+
+    if (power2 <= 0) {
+        // Subnormal.
+        if (-power2 + 1 >= 64) return 0;
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = mantissa < (u64(1) << F32_MANTISSA_BITS) ? 0 : 1;
+        return (u32(power2) << F32_MANTISSA_BITS) | u32(mantissa & ((u64(1) << F32_MANTISSA_BITS) - 1));
+    }
+
+    // Exactly halfway between two floats is only possible for small exponents, and then it rounds to even.
+    if (product.low <= 1 && q >= F32_MIN_EXPONENT_ROUND_TO_EVEN && q <= F32_MAX_EXPONENT_ROUND_TO_EVEN &&
+        (mantissa & 3) == 1) {
+        if ((mantissa << shift) == product.high) {
+            mantissa &= ~u64(1);
+        }
+    }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (u64(2) << F32_MANTISSA_BITS)) {
+        mantissa = u64(1) << F32_MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~(u64(1) << F32_MANTISSA_BITS);
+
+    if (power2 >= F32_INFINITE_POWER) {
+        return u32(F32_INFINITE_POWER) << F32_MANTISSA_BITS;
+    }
+
+    return (u32(power2) << F32_MANTISSA_BITS) | u32(mantissa);
+}
+
+core::expected<f32, WavefrontError> parseFloatFallback(const char* s, addr_size len) {
+    // Only numbers with more than 19 significant digits that sit right on a rounding boundary get here. strtof is
+    // correctly rounded, but needs a terminated copy.
+    char buf[128];
+    if (len >= sizeof(buf)) {
+        auto res = core::cstrToFloat<f32>(s, u32(len));
+        if (res.hasErr()) return core::unexpected(WavefrontError::InvalidFileFormat);
+        return f32(res.value());
+    }
+
+    core::memcopy(buf, s, len);
+    buf[len] = '\0';
+    return std::strtof(buf, nullptr);
+}
+
+u64 loadEightBytes(const char* s) {
+    u64 chunk;
+    core::memcopy(reinterpret_cast<char*>(&chunk), s, 8);
+    return chunk;
+}
+
+// The SWAR digit tricks below read the first character from the lowest byte, so they assume a little endian target.
+
+bool isEightDigits(u64 chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+           0x3333333333333333;
+}
+
+u32 parseEightDigits(u64 chunk) {
+    constexpr u64 MASK = 0x000000FF000000FF;
+    constexpr u64 MUL1 = 100 + (u64(1000000) << 32);
+    constexpr u64 MUL2 = 1 + (u64(10000) << 32);
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8); // Pairs of digits.
+    chunk = (((chunk & MASK) * MUL1) + (((chunk >> 16) & MASK) * MUL2)) >> 32;
+    return u32(chunk);
+}
+
+U128 multiply(u64 a, u64 b) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    U128 ret;
+    ret.low = _umul128(a, b, &ret.high);
+    return ret;
+#else
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    return { u64(r >> 64), u64(r) };
+#endif
+}
+
+i32 leadingZeros(u64 x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanReverse64(&idx, x);
+    return 63 - i32(idx);
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+f32 f32FromBits(u32 bits) {
+    f32 ret;
+    core::memcopy(reinterpret_cast<char*>(&ret), reinterpret_cast<const char*>(&bits), sizeof(ret));
+    return ret;
+}
+
+} // namespace
+
+} // Wavefront
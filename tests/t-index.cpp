@@ -89,6 +89,14 @@ i32 runAllTests() {
         .allocators = allAllocators
     });
 
+    testManager.addTest({
+        .suiteInfo = TestSuiteInfo("Surface Tests Suite", useAnsiColors),
+        .only = false,
+        .skip = false,
+        .testFn = runSurfaceTestsSuite,
+        .allocators = allAllocators
+    });
+
     i32 ret = testManager.runTests();
     return ret;
 }
@@ -4,5 +4,6 @@
 
 i32 runWavefrontTestsSuite(const core::testing::TestSuiteInfo& suiteInfo);
 i32 runTgaTestsSuite(const core::testing::TestSuiteInfo& suiteInfo);
+i32 runSurfaceTestsSuite(const core::testing::TestSuiteInfo& suiteInfo);
 
 i32 runAllTests();
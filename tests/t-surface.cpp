@@ -0,0 +1,562 @@
+#include "t-index.h"
+#include "surface.h"
+#include "surface_renderer.h"
+#include "surface_pool.h"
+#include "surface_scale.h"
+#include "surface_compare.h"
+#include "model.h"
+
+namespace {
+
+i32 verticalFlipIsAViewTest(const core::testing::TestSuiteInfo&) {
+    constexpr PixelFormat f = PixelFormat::BGRA8888;
+    constexpr i32 bpp = pixelFormatBytesPerPixel(f);
+    constexpr i32 WIDTH = 5;
+    constexpr i32 HEIGHT = 3;
+
+    u8 buf[WIDTH*HEIGHT*bpp] = {};
+    Surface s = Surface();
+    s.origin = Origin::BottomLeft;
+    s.pixelFormat = f;
+    s.width = WIDTH;
+    s.height = HEIGHT;
+    s.pitch = WIDTH * bpp;
+    s.data = buf;
+
+    fillPixel(s, 1, 0, RED);
+
+    Surface flipped = s.view().flippedVertically();
+    CT_CHECK(!flipped.isOwner());
+    CT_CHECK(flipped.origin == Origin::TopLeft);
+    CT_CHECK(flipped.pitch == -s.pitch);
+    CT_CHECK(flipped.size() == s.size());
+    CT_CHECK(flipped.memoryBegin() == buf);
+    CT_CHECK(flipped.row(HEIGHT - 1) == s.row(0));
+
+    // Writes through the view land in the mirrored row of the original.
+    fillPixel(flipped, 3, 0, GREEN);
+    CT_CHECK(s.row(HEIGHT - 1)[3*bpp + 1] == 255);
+    CT_CHECK(flipped.row(HEIGHT - 1)[1*bpp + 2] == 255);
+
+    Surface back = flipped.flippedVertically();
+    CT_CHECK(back.origin == s.origin);
+    CT_CHECK(back.pitch == s.pitch);
+    CT_CHECK(back.data == s.data);
+
+    return 0;
+}
+
+i32 horizontalFlipTest(const core::testing::TestSuiteInfo&) {
+    auto runForFormat = [](PixelFormat f, i32 width) -> i32 {
+        constexpr i32 MAX_WIDTH = 37;
+        u8 buf[MAX_WIDTH * 4 * 2] = {};
+        Surface s = Surface();
+        s.origin = Origin::TopLeft;
+        s.pixelFormat = f;
+        s.width = width;
+        s.height = 2;
+        s.pitch = MAX_WIDTH * 4; // padded rows
+        s.data = buf;
+
+        for (i32 x = 0; x < s.width; x++) {
+            fillPixel(s, x, 0, Color { .rgba = { u8(x * 8), u8(255 - x), u8(x * 3), 255 } });
+            fillPixel(s, x, 1, Color { .rgba = { u8(x * 5), u8(x), u8(200 - x), 255 } });
+        }
+
+        u8 expected[MAX_WIDTH * 4 * 2] = {};
+        core::memcopy(expected, buf, CORE_C_ARRLEN(buf));
+
+        flipSurfaceHorizontally(s);
+        CT_CHECK(s.origin == Origin::TopRight);
+
+        i32 bpp = s.bpp();
+        for (i32 y = 0; y < s.height; y++) {
+            for (i32 x = 0; x < s.width; x++) {
+                const u8* got = s.row(y) + x * bpp;
+                const u8* exp = expected + y * s.pitch + (s.width - 1 - x) * bpp;
+                CT_CHECK(core::memcmp(got, addr_size(bpp), exp, addr_size(bpp)) == 0);
+            }
+        }
+
+        return 0;
+    };
+
+    constexpr i32 widths[] = { 1, 2, 7, 8, 9, 16, 31, 37 };
+    for (i32 w : widths) {
+        CT_CHECK(runForFormat(PixelFormat::BGRA8888, w) == 0);
+        CT_CHECK(runForFormat(PixelFormat::BGR888, w) == 0);
+        CT_CHECK(runForFormat(PixelFormat::BGRA5551, w) == 0);
+    }
+
+    return 0;
+}
+
+i32 blendRectTest(const core::testing::TestSuiteInfo&) {
+    struct TestCase {
+        Color dst;
+        Color src;
+        BlendMode mode;
+        Color expected;
+    };
+
+    constexpr TestCase cases[] = {
+        { { .rgba = { 0, 0, 0, 255 } },       { .rgba = { 255, 255, 255, 0 } },   BlendMode::SourceOver,              { .rgba = { 0, 0, 0, 255 } } },
+        { { .rgba = { 0, 0, 0, 255 } },       { .rgba = { 255, 128, 0, 255 } },   BlendMode::SourceOver,              { .rgba = { 255, 128, 0, 255 } } },
+        { { .rgba = { 0, 0, 0, 255 } },       { .rgba = { 255, 255, 255, 128 } }, BlendMode::SourceOver,              { .rgba = { 128, 128, 128, 255 } } },
+        { { .rgba = { 200, 100, 50, 0 } },    { .rgba = { 10, 20, 30, 100 } },    BlendMode::SourceOver,              { .rgba = { 10, 20, 30, 100 } } },
+        { { .rgba = { 200, 100, 50, 128 } },  { .rgba = { 10, 20, 30, 100 } },    BlendMode::SourceOver,              { .rgba = { 93, 55, 39, 178 } } },
+        { { .rgba = { 200, 100, 50, 0 } },    { .rgba = { 10, 20, 30, 255 } },    BlendMode::SourceOver,              { .rgba = { 10, 20, 30, 255 } } },
+        { { .rgba = { 0, 0, 0, 255 } },       { .rgba = { 128, 128, 128, 128 } }, BlendMode::SourceOverPremultiplied, { .rgba = { 128, 128, 128, 255 } } },
+        { { .rgba = { 200, 100, 50, 0 } },    { .rgba = { 4, 8, 12, 100 } },      BlendMode::SourceOverPremultiplied, { .rgba = { 126, 69, 42, 100 } } },
+    };
+
+    i32 ret = core::testing::executeTestTable("blendRectTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        // Wide enough to go through both the SIMD and the scalar tail code paths.
+        constexpr i32 WIDTH = 11;
+        u8 buf[WIDTH * 4] = {};
+        Surface s = Surface();
+        s.origin = Origin::TopLeft;
+        s.pixelFormat = PixelFormat::BGRA8888;
+        s.width = WIDTH;
+        s.height = 1;
+        s.pitch = WIDTH * 4;
+        s.data = buf;
+
+        fillRect(s, 0, 0, tc.dst, s.width, s.height);
+        blendRect(s, 0, 0, tc.src, s.width, s.height, tc.mode);
+
+        for (i32 x = 0; x < WIDTH; x++) {
+            const u8* px = s.row(0) + x * 4;
+            CT_CHECK(px[0] == tc.expected.b(), cErr);
+            CT_CHECK(px[1] == tc.expected.g(), cErr);
+            CT_CHECK(px[2] == tc.expected.r(), cErr);
+            CT_CHECK(px[3] == tc.expected.a(), cErr);
+        }
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    // A straight alpha source over a transparent BGRA5551 destination keeps the source color.
+    {
+        constexpr i32 WIDTH = 11;
+        u8 buf[WIDTH * 2] = {};
+        Surface s = Surface();
+        s.origin = Origin::TopLeft;
+        s.pixelFormat = PixelFormat::BGRA5551;
+        s.width = WIDTH;
+        s.height = 1;
+        s.pitch = WIDTH * 2;
+        s.data = buf;
+
+        fillRect(s, 0, 0, Color { .rgba = { 200, 100, 48, 0 } }, s.width, s.height);
+        blendRect(s, 0, 0, Color { .rgba = { 240, 160, 80, 100 } }, s.width, s.height);
+
+        for (i32 x = 0; x < WIDTH; x++) {
+            u16 px = u16(buf[x * 2] | (buf[x * 2 + 1] << 8));
+            CT_CHECK(px == u16(10 | (20 << 5) | (30 << 10)));
+        }
+    }
+
+    return 0;
+}
+
+i32 surfacePoolRecyclesBuffersTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr i32 W = 16;
+    constexpr i32 H = 8;
+    constexpr addr_size SIZE = W * H * 4;
+
+    SurfacePoolCreateInfo info;
+    info.memoryCeiling = SIZE * 2;
+    info.maxSurfaces = 4;
+    SurfacePool pool = createSurfacePool(info, *suiteInfo.actx);
+    defer { pool.free(); };
+
+    // Same key gets the same buffer back.
+    Surface a = core::Unpack(pool.acquire(W, H, PixelFormat::BGRA8888, Origin::BottomLeft));
+    CT_CHECK(!a.isOwner());
+    u8* aData = a.data;
+    fillRect(a, 0, 0, WHITE, W, H);
+    CT_CHECK(!pool.release(a).hasErr());
+    CT_CHECK(a.data == nullptr);
+
+    Surface b = core::Unpack(pool.acquire(W, H, PixelFormat::BGRA8888, Origin::TopLeft, SurfaceClear::Zero));
+    CT_CHECK(b.data == aData);
+    CT_CHECK(b.origin == Origin::TopLeft);
+    for (i32 i = 0; i < b.size(); i++) {
+        CT_CHECK(b.data[i] == 0);
+    }
+
+    // A second buffer fits, a third one does not while both are leased. A new buffer is zero from the allocation, the
+    // Zero clear skips it.
+    Surface c = core::Unpack(pool.acquire(W, H, PixelFormat::BGRA8888, Origin::TopLeft, SurfaceClear::Zero));
+    CT_CHECK(c.data != b.data);
+    for (i32 i = 0; i < c.size(); i++) {
+        CT_CHECK(c.data[i] == 0);
+    }
+    {
+        auto res = pool.acquire(W, H, PixelFormat::BGRA8888, Origin::TopLeft);
+        CT_CHECK(res.hasErr());
+        CT_CHECK(res.err() == SurfacePoolError::MemoryCeilingReached);
+    }
+    CT_CHECK(pool.leasedCount() == 2);
+
+    // Releasing one allows a different key to evict it.
+    CT_CHECK(!pool.release(b).hasErr());
+    Surface d = core::Unpack(pool.acquire(W, H, PixelFormat::BGRA5551, Origin::TopLeft, SurfaceClear::Fill, &RED));
+    CT_CHECK(pool.idleCount() == 0);
+    CT_CHECK(pool.memoryInUse <= info.memoryCeiling);
+
+    Surface notFromPool = d;
+    notFromPool.data = nullptr;
+    CT_CHECK(pool.release(notFromPool).hasErr());
+
+    CT_CHECK(!pool.release(c).hasErr());
+    CT_CHECK(!pool.release(d).hasErr());
+    pool.trim();
+    CT_CHECK(pool.memoryInUse == 0);
+
+    return 0;
+}
+
+i32 downsampleMatchesAreaAverageTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    // For even sizes the 2x2 box filter and the area average at half size must agree exactly, and they are
+    // implemented independently. For odd sizes every destination pixel must match the area average of its source
+    // block, which is 3 pixels wide or tall for the last column and row.
+    struct TestCase { i32 w; i32 h; };
+    constexpr TestCase sizes[] = { { 38, 6 }, { 37, 5 }, { 5, 1 }, { 1, 7 } };
+    constexpr i32 MAX_W = 38;
+    constexpr i32 MAX_H = 7;
+    constexpr PixelFormat formats[] = {
+        PixelFormat::BGRA8888, PixelFormat::BGRX8888, PixelFormat::BGR888, PixelFormat::BGRA5551, PixelFormat::BGR555
+    };
+
+    core::rndInit();
+
+    for (const TestCase& size : sizes) {
+        for (PixelFormat f : formats) {
+            const i32 W = size.w;
+            const i32 H = size.h;
+            i32 bpp = pixelFormatBytesPerPixel(f);
+            u8 srcBuf[MAX_W * MAX_H * 4] = {};
+            u8 boxBuf[MAX_W * MAX_H * 4] = {};
+            u8 areaBuf[MAX_W * MAX_H * 4] = {};
+
+            for (u8& b : srcBuf) b = u8(core::rndU32());
+            if (f == PixelFormat::BGR555) {
+                for (i32 i = 1; i < W * H * 2; i += 2) srcBuf[i] &= 0x7F;
+            }
+
+            Surface src = Surface();
+            src.origin = Origin::BottomLeft;
+            src.pixelFormat = f;
+            src.width = W;
+            src.height = H;
+            src.pitch = W * bpp;
+            src.data = srcBuf;
+
+            Surface box = src;
+            box.width = core::core_max(1, W / 2);
+            box.height = core::core_max(1, H / 2);
+            box.pitch = box.width * bpp;
+            box.data = boxBuf;
+
+            downsample2x2(src, box);
+
+            if (W % 2 == 0 && H % 2 == 0) {
+                Surface area = box;
+                area.data = areaBuf;
+                downscaleAreaAverage(src, area, *suiteInfo.actx);
+                CT_CHECK(core::memcmp(boxBuf, addr_size(box.size()), areaBuf, addr_size(area.size())) == 0);
+                continue;
+            }
+
+            for (i32 y = 0; y < box.height; y++) {
+                for (i32 x = 0; x < box.width; x++) {
+                    i32 x0 = 2 * x;
+                    i32 y0 = 2 * y;
+                    i32 x1 = x == box.width - 1 ? W : core::core_min(x0 + 2, W);
+                    i32 y1 = y == box.height - 1 ? H : core::core_min(y0 + 2, H);
+
+                    Surface area = box;
+                    area.width = 1;
+                    area.height = 1;
+                    area.pitch = bpp;
+                    area.data = areaBuf;
+                    downscaleAreaAverage(src.subSurface(x0, y0, x1 - x0, y1 - y0), area, *suiteInfo.actx);
+                    CT_CHECK(core::memcmp(box.row(y) + x * bpp, addr_size(bpp), areaBuf, addr_size(bpp)) == 0);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+i32 downsampleBgr888MatchesScalarTest(const core::testing::TestSuiteInfo&) {
+    // The vector kernel for 3 byte pixels regroups the channels across registers. Every destination pixel outside the
+    // folded last column must equal the rounded average of its 2x2 block, for widths that end anywhere in a block.
+    constexpr i32 widths[] = { 1, 3, 15, 17, 31, 33, 35, 47, 49, 63, 65, 97 };
+    constexpr i32 MAX_W = 97;
+    constexpr i32 H = 4;
+    constexpr i32 BPP = 3;
+
+    core::rndInit();
+
+    for (i32 W : widths) {
+        u8 srcBuf[MAX_W * H * BPP] = {};
+        u8 dstBuf[MAX_W * H * BPP] = {};
+        for (u8& b : srcBuf) b = u8(core::rndU32());
+
+        Surface src = Surface();
+        src.origin = Origin::BottomLeft;
+        src.pixelFormat = PixelFormat::BGR888;
+        src.width = W;
+        src.height = H;
+        src.pitch = W * BPP;
+        src.data = srcBuf;
+
+        Surface dst = src;
+        dst.width = core::core_max(1, W / 2);
+        dst.height = H / 2;
+        dst.pitch = dst.width * BPP;
+        dst.data = dstBuf;
+
+        downsample2x2(src, dst);
+
+        i32 checkedWidth = W % 2 == 0 ? dst.width : dst.width - 1;
+        for (i32 y = 0; y < dst.height; y++) {
+            const u8* r0 = src.row(2 * y);
+            const u8* r1 = src.row(2 * y + 1);
+            for (i32 x = 0; x < checkedWidth; x++) {
+                for (i32 c = 0; c < BPP; c++) {
+                    i32 i0 = 2 * x * BPP + c;
+                    i32 i1 = i0 + BPP;
+                    u8 expected = u8((r0[i0] + r0[i1] + r1[i0] + r1[i1] + 2) >> 2);
+                    CT_CHECK(dst.row(y)[x * BPP + c] == expected);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+i32 mipChainTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr i32 W = 20;
+    constexpr i32 H = 5;
+    u8 buf[W * H * 4] = {};
+
+    Surface s = Surface();
+    s.origin = Origin::BottomLeft;
+    s.pixelFormat = PixelFormat::BGRA8888;
+    s.width = W;
+    s.height = H;
+    s.pitch = W * 4;
+    s.data = buf;
+    fillRect(s, 0, 0, GRAY, W, H);
+
+    MipChain chain = createMipChain(s, *suiteInfo.actx);
+    defer { chain.free(); };
+
+    // 20x5 -> 10x2 -> 5x1 -> 2x1 -> 1x1
+    CT_CHECK(chain.count() == 5);
+    CT_CHECK(!chain.levels[0].isOwner());
+    CT_CHECK(chain.levels[2].width == 5 && chain.levels[2].height == 1);
+    CT_CHECK(chain.levels[4].width == 1 && chain.levels[4].height == 1);
+    CT_CHECK(chain.levelAtLeast(4, 1).width == 5);
+    CT_CHECK(chain.levelAtLeast(100, 100).width == W);
+
+    // A uniform image stays uniform all the way down.
+    const u8* last = chain.levels[4].data;
+    CT_CHECK(last[0] == 128 && last[1] == 128 && last[2] == 128 && last[3] == 255);
+
+    return 0;
+}
+
+i32 compareSurfacesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr i32 W = 23;
+    constexpr i32 H = 9;
+    constexpr PixelFormat formats[] = {
+        PixelFormat::BGRA8888, PixelFormat::BGRX8888, PixelFormat::BGR888, PixelFormat::BGRA5551, PixelFormat::BGR555
+    };
+
+    for (PixelFormat f : formats) {
+        i32 bpp = pixelFormatBytesPerPixel(f);
+        u8 bufA[W * H * 4] = {};
+        u8 bufB[(W + 3) * H * 4] = {};
+
+        Surface a = Surface();
+        a.origin = Origin::BottomLeft;
+        a.pixelFormat = f;
+        a.width = W;
+        a.height = H;
+        a.pitch = W * bpp;
+        a.data = bufA;
+
+        // Same image, different pitch and top-right origin.
+        Surface b = a;
+        b.pitch = (W + 3) * bpp;
+        b.data = bufB;
+
+        for (i32 y = 0; y < H; y++) {
+            for (i32 x = 0; x < W; x++) {
+                Color c = { .rgba = { u8(x * 11), u8(y * 29), u8(x * y), 255 } };
+                fillPixel(a, x, y, c);
+                fillPixel(b, x, y, c);
+            }
+        }
+        flipSurfaceHorizontally(b);
+        b = b.flippedVertically();
+        CT_CHECK(b.origin == Origin::TopRight);
+
+        SurfaceDiff diff = core::Unpack(compareSurfaces(a, b, CompareMode::Full, *suiteInfo.actx));
+        CT_CHECK(diff.equal);
+        CT_CHECK(diff.mismatchedPixels == 0);
+        CT_CHECK(diff.maxChannelDelta == 0);
+
+        // Change two pixels of the original image through b.
+        fillPixel(b, W - 1 - 4, H - 1 - 2, WHITE);
+        fillPixel(b, W - 1 - 17, H - 1 - 6, WHITE);
+
+        diff = core::Unpack(compareSurfaces(a, b, CompareMode::ExactOnly, *suiteInfo.actx));
+        CT_CHECK(!diff.equal);
+
+        diff = core::Unpack(compareSurfaces(a, b, CompareMode::Full, *suiteInfo.actx));
+        CT_CHECK(!diff.equal);
+        CT_CHECK(diff.mismatchedPixels == 2);
+        CT_CHECK(diff.minX == 4 && diff.maxX == 17);
+        CT_CHECK(diff.minY == 2 && diff.maxY == 6);
+        CT_CHECK(diff.maxChannelDelta > 0);
+        CT_CHECK(diff.psnr > 0 && diff.psnr < 1000);
+    }
+
+    // Mismatched descriptions are errors, not differences.
+    {
+        u8 buf[16] = {};
+        Surface a = Surface();
+        a.origin = Origin::BottomLeft;
+        a.pixelFormat = PixelFormat::BGRA8888;
+        a.width = 2;
+        a.height = 2;
+        a.pitch = 8;
+        a.data = buf;
+
+        Surface b = a;
+        b.width = 1;
+        CT_CHECK(compareSurfaces(a, b).err() == SurfaceCompareError::SizeMismatch);
+
+        b = a;
+        b.pixelFormat = PixelFormat::BGRX8888;
+        CT_CHECK(compareSurfaces(a, b).err() == SurfaceCompareError::PixelFormatMismatch);
+
+        b = a;
+        b.origin = Origin::Center;
+        CT_CHECK(compareSurfaces(a, b).err() == SurfaceCompareError::UnsupportedOrigin);
+    }
+
+    return 0;
+}
+
+i32 bandedRenderMatchesFullRenderTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr i32 W = 48;
+    constexpr i32 H = 40;
+    constexpr i32 bpp = 3;
+
+    // A small fan of triangles in normalized device coordinates.
+    Model3D model = {};
+    model.actx = suiteInfo.actx;
+    model.vertices = core::memoryZeroAllocate<Model3D::Vertex>(5, *suiteInfo.actx);
+    model.faces = core::memoryZeroAllocate<Model3D::Face>(3, *suiteInfo.actx);
+    defer { model.free(); };
+
+    model.vertices[0].position = core::v(0.0f, 0.0f, 0.0f, 1.0f);
+    model.vertices[1].position = core::v(-0.9f, -0.8f, 0.0f, 1.0f);
+    model.vertices[2].position = core::v(0.9f, -0.9f, 0.0f, 1.0f);
+    model.vertices[3].position = core::v(0.8f, 0.95f, 0.0f, 1.0f);
+    model.vertices[4].position = core::v(-0.7f, 0.6f, 0.0f, 1.0f);
+    i32 faces[3][3] = { { 0, 2, 3 }, { 0, 3, 4 }, { 0, 4, 1 } };
+    for (i32 i = 0; i < 3; i++) {
+        for (i32 j = 0; j < 3; j++) model.faces[addr_size(i)][j] = faces[i][j];
+    }
+
+    // The banded renders go through submeshes, which are culled when the model is projected, the full render draws
+    // every face.
+    model.submeshes = core::memoryZeroAllocate<Model3D::Submesh>(2, *suiteInfo.actx);
+    model.submeshes[0] = { core::v(0.0f, -0.9f, 0.0f), core::v(0.9f, 0.95f, 0.0f), 0, 1, 0, 0 };
+    model.submeshes[1] = { core::v(-0.9f, -0.8f, 0.0f), core::v(0.8f, 0.95f, 0.0f), 1, 2, 0, 0 };
+    Model3D withoutSubmeshes = model;
+    withoutSubmeshes.submeshes = {};
+
+    auto makeSurface = [](u8* buf) {
+        Surface s = Surface();
+        s.origin = Origin::BottomLeft;
+        s.pixelFormat = PixelFormat::BGR888;
+        s.width = W;
+        s.height = H;
+        s.pitch = W * bpp;
+        s.data = buf;
+        return s;
+    };
+
+    // Row ranges of 7 over bins of 8 rows, so most ranges span two bins.
+    ProjectedModel projected = projectModel(model, W, H, 8, *suiteInfo.actx);
+    defer { projected.free(); };
+    CT_CHECK(projected.bandOffsets.len() == addr_size((H + 7) / 8 + 1));
+
+    for (bool wireframe : { false, true }) {
+        u8 fullBuf[W * H * bpp] = {};
+        u8 bandedBuf[W * H * bpp] = {};
+        u8 projectedBuf[W * H * bpp] = {};
+        Surface full = makeSurface(fullBuf);
+        Surface banded = makeSurface(bandedBuf);
+        Surface bandedProjected = makeSurface(projectedBuf);
+
+        renderModel(full, withoutSubmeshes, wireframe);
+        for (i32 y = 0; y < H; y += 7) {
+            renderModelRows(banded, model, y, core::core_min(y + 7, H), wireframe);
+            renderModelRows(bandedProjected, projected, y, core::core_min(y + 7, H), wireframe);
+        }
+
+        SurfaceDiff diff = core::Unpack(compareSurfaces(full, banded, CompareMode::ExactOnly, *suiteInfo.actx));
+        CT_CHECK(diff.equal);
+        diff = core::Unpack(compareSurfaces(full, bandedProjected, CompareMode::ExactOnly, *suiteInfo.actx));
+        CT_CHECK(diff.equal);
+
+        // Something was actually drawn.
+        bool anyPixel = false;
+        for (u8 b : fullBuf) anyPixel |= b != 0;
+        CT_CHECK(anyPixel);
+    }
+
+    return 0;
+}
+
+} // namespace
+
+i32 runSurfaceTestsSuite(const core::testing::TestSuiteInfo& suiteInfo) {
+    using namespace core::testing;
+
+    TestInfo tInfo = createTestInfo(suiteInfo);
+
+    tInfo.name = FN_NAME_TO_CPTR(verticalFlipIsAViewTest);
+    if (runTest(tInfo, verticalFlipIsAViewTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(horizontalFlipTest);
+    if (runTest(tInfo, horizontalFlipTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(blendRectTest);
+    if (runTest(tInfo, blendRectTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(surfacePoolRecyclesBuffersTest);
+    if (runTest(tInfo, surfacePoolRecyclesBuffersTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(downsampleMatchesAreaAverageTest);
+    if (runTest(tInfo, downsampleMatchesAreaAverageTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(downsampleBgr888MatchesScalarTest);
+    if (runTest(tInfo, downsampleBgr888MatchesScalarTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(mipChainTest);
+    if (runTest(tInfo, mipChainTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(compareSurfacesTest);
+    if (runTest(tInfo, compareSurfacesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(bandedRenderMatchesFullRenderTest);
+    if (runTest(tInfo, bandedRenderMatchesFullRenderTest, suiteInfo) != 0) { return -1; }
+
+    return 0;
+}
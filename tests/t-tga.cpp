@@ -1,6 +1,9 @@
 #include "t-index.h"
 #include "tga_files.h"
+#include "tga_batch.h"
+#include "surface_scale.h"
 #include "surface.h"
+#include "surface_compare.h"
 
 namespace {
 
@@ -57,6 +60,770 @@ i32 validTrueImageFilesCanBeReadTest(const core::testing::TestSuiteInfo& suiteIn
     return 0;
 }
 
+i32 sameImageWithDifferentOriginsTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* bottomOrigin;
+        const char* topOrigin;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga", TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t16.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b32.tga", TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t32.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b16.tga", TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t16.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t24.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b32.tga", TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t32.tga" },
+    };
+
+    auto loadSurface = [&](const char* path) -> Surface {
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx), "Failed to load file: \"{}\"", path);
+        defer { tgaImage.free(); };
+        return core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+    };
+
+    i32 ret = core::testing::executeTestTable("sameImageWithDifferentOriginsTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface bottom = loadSurface(tc.bottomOrigin);
+        defer { bottom.free(); };
+        Surface top = loadSurface(tc.topOrigin);
+        defer { top.free(); };
+
+        CT_CHECK(bottom.origin != top.origin, cErr);
+
+        SurfaceDiff diff = core::Unpack(compareSurfaces(bottom, top, CompareMode::Full, *suiteInfo.actx));
+        CT_CHECK(diff.equal, cErr);
+        CT_CHECK(diff.mismatchedPixels == 0, cErr);
+
+        // Comparing against the unflipped rows must find differences.
+        Surface topAsBottom = top.view();
+        topAsBottom.origin = bottom.origin;
+        diff = core::Unpack(compareSurfaces(bottom, topAsBottom, CompareMode::Full, *suiteInfo.actx));
+        CT_CHECK(!diff.equal, cErr);
+        CT_CHECK(diff.mismatchedPixels > 0, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 runLengthEncodedImagesMatchRawImagesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* raw;
+        const char* runLengthEncoded;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b16.tga", TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_b16_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_b24_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t32.tga", TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_t32_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t16.tga", TEST_ASSETS_DIRECTORY "/tga/rle_valid/flag_t16_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b32.tga", TEST_ASSETS_DIRECTORY "/tga/rle_valid/flag_b32_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga",    TEST_ASSETS_DIRECTORY "/tga/rle_valid/utc32_rle.tga" },
+    };
+
+    auto loadSurface = [&](const char* path) -> Surface {
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx), "Failed to load file: \"{}\"", path);
+        defer { tgaImage.free(); };
+        return core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+    };
+
+    i32 ret = core::testing::executeTestTable("runLengthEncodedImagesMatchRawImagesTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface raw = loadSurface(tc.raw);
+        defer { raw.free(); };
+        Surface decoded = loadSurface(tc.runLengthEncoded);
+        defer { decoded.free(); };
+
+        CT_CHECK(decoded.pixelFormat == raw.pixelFormat, cErr);
+        CT_CHECK(decoded.origin == raw.origin, cErr);
+
+        SurfaceDiff diff = core::Unpack(compareSurfaces(raw, decoded, CompareMode::ExactOnly, *suiteInfo.actx));
+        CT_CHECK(diff.equal, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 malformedRunLengthEncodedImagesAreRejectedTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/rle_invalid/truncated_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/rle_invalid/overflowing_run_rle.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/rle_invalid/overflowing_raw_rle.tga" },
+    };
+
+    i32 ret = core::testing::executeTestTable("malformedRunLengthEncodedImagesAreRejectedTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto tgaImage = core::Unpack(TGA::loadFile(tc.path, *suiteInfo.actx), "Failed to load file: \"{}\"", tc.path);
+        defer { tgaImage.free(); };
+
+        auto res = TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx);
+        CT_CHECK(res.hasErr(), cErr);
+        CT_CHECK(res.err() == TGA::TGAError::FailedToCreateSurface, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 runLengthEncodedRoundtripTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        bool expectSmallerFile;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b24.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t32.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc16.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc24.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t24.tga", false },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/lena3.tga", false },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb15.tga", false },
+    };
+
+    constexpr const char* outPath = OUT_DIRECTORY "/rle_roundtrip_test.tga";
+
+    auto loadSurface = [&](const char* path) -> Surface {
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx), "Failed to load file: \"{}\"", path);
+        defer { tgaImage.free(); };
+        return core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+    };
+
+    auto fileSize = [](const char* path) -> addr_size {
+        core::FileStat stat;
+        core::Expect(core::fileStat(path, stat));
+        return addr_size(stat.size);
+    };
+
+    i32 ret = core::testing::executeTestTable("runLengthEncodedRoundtripTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface original = loadSurface(tc.path);
+        defer { original.free(); };
+
+        // Write both the surface and a negative pitch view of it, which takes the row by row path.
+        Surface flipped = original.flippedVertically();
+        const Surface* toWrite[] = { &original, &flipped };
+
+        for (const Surface* s : toWrite) {
+            TGA::CreateFileFromSurfaceParams params = {
+                .surface = *s,
+                .path = outPath,
+                .imageType = 10,
+                .fileType = TGA::FileType::New,
+            };
+            CT_CHECK(!TGA::createFileFromSurface(params).hasErr(), cErr);
+
+            Surface decoded = loadSurface(outPath);
+            defer { decoded.free(); };
+
+            SurfaceDiff diff = core::Unpack(compareSurfaces(*s, decoded, CompareMode::ExactOnly, *suiteInfo.actx));
+            CT_CHECK(diff.equal, cErr);
+
+            if (tc.expectSmallerFile) {
+                CT_CHECK(fileSize(outPath) < fileSize(tc.path) / 2, cErr);
+            }
+        }
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 mappedImagesMatchReadImagesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        bool canBeViewed;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t24.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/earth.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb32.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_b24_rle.tga", false },
+    };
+
+    i32 ret = core::testing::executeTestTable("mappedImagesMatchReadImagesTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto readImage = core::Unpack(TGA::loadFile(tc.path, *suiteInfo.actx));
+        defer { readImage.free(); };
+        auto mappedImage = core::Unpack(TGA::loadFileMapped(tc.path));
+        defer { mappedImage.free(); };
+
+        CT_CHECK(mappedImage.mapping.isMapped(), cErr);
+        CT_CHECK(mappedImage.memory.len() == readImage.memory.len(), cErr);
+        CT_CHECK(mappedImage.imageDataOff == readImage.imageDataOff, cErr);
+        CT_CHECK(mappedImage.footerOff == readImage.footerOff, cErr);
+
+        Surface expected = core::Unpack(TGA::createSurfaceFromTgaImage(readImage, *suiteInfo.actx));
+        defer { expected.free(); };
+
+        // Decoding from the mapping works for every image type.
+        Surface decoded = core::Unpack(TGA::createSurfaceFromTgaImage(mappedImage, *suiteInfo.actx));
+        defer { decoded.free(); };
+        CT_CHECK(core::Unpack(compareSurfaces(expected, decoded, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+
+        auto viewRes = TGA::createSurfaceViewFromTgaImage(mappedImage);
+        if (!tc.canBeViewed) {
+            CT_CHECK(viewRes.hasErr(), cErr);
+            CT_CHECK(viewRes.err() == TGA::TGAError::UnsupportedImageType, cErr);
+            return 0;
+        }
+
+        CT_CHECK(!viewRes.hasErr(), cErr);
+        Surface view = viewRes.value();
+        CT_CHECK(!view.isOwner(), cErr);
+        CT_CHECK(view.data >= mappedImage.memory.data(), cErr);
+        CT_CHECK(view.data + view.size() <= mappedImage.memory.data() + mappedImage.memory.len(), cErr);
+        CT_CHECK(core::Unpack(compareSurfaces(expected, view, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+        view.free(); // no-op for views
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    auto missing = TGA::loadFileMapped(TEST_ASSETS_DIRECTORY "/tga/does_not_exist.tga");
+    CT_CHECK(missing.hasErr());
+    CT_CHECK(missing.err() == TGA::TGAError::FailedToOpenFile);
+
+    return 0;
+}
+
+i32 streamWriterMatchesSingleWriteTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        i32 imageType;
+        TGA::FileType fileType;
+        i32 bandHeight;
+        i32 maxQueuedBands;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", 2, TGA::FileType::New, 16, 4 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", 10, TGA::FileType::New, 7, 1 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t16.tga", 10, TGA::FileType::Original, 1, 2 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga", 10, TGA::FileType::New, 1000, 4 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb32.tga", 2, TGA::FileType::Original, 3, 3 },
+    };
+
+    constexpr const char* outPath = OUT_DIRECTORY "/stream_writer_test.tga";
+
+    auto loadSurface = [&](const char* path) -> Surface {
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx), "Failed to load file: \"{}\"", path);
+        defer { tgaImage.free(); };
+        return core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+    };
+
+    i32 ret = core::testing::executeTestTable("streamWriterMatchesSingleWriteTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface original = loadSurface(tc.path);
+        defer { original.free(); };
+
+        TGA::StreamWriterCreateInfo info = {
+            .surface = original,
+            .path = outPath,
+            .imageType = tc.imageType,
+            .fileType = tc.fileType,
+            .maxQueuedBands = tc.maxQueuedBands,
+        };
+        TGA::StreamWriter writer = core::Unpack(TGA::createStreamWriter(info, *suiteInfo.actx));
+        for (i32 y = 0; y < original.height; y += tc.bandHeight) {
+            i32 count = core::core_min(tc.bandHeight, original.height - y);
+            CT_CHECK(!writer.submitRows(y, count).hasErr(), cErr);
+        }
+        CT_CHECK(!writer.finish().hasErr(), cErr);
+        CT_CHECK(writer.state == nullptr, cErr);
+
+        auto tgaImage = core::Unpack(TGA::loadFile(outPath, *suiteInfo.actx));
+        defer { tgaImage.free(); };
+        CT_CHECK(tgaImage.fileType() == tc.fileType, cErr);
+        CT_CHECK(core::Unpack(tgaImage.imageType()) == tc.imageType, cErr);
+
+        Surface decoded = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        defer { decoded.free(); };
+        CT_CHECK(core::Unpack(compareSurfaces(original, decoded, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    // Bands reach the file while the rest is still being submitted. With a single queue slot the second submit waits
+    // until the first band has left the queue, which happens once it is written.
+    {
+        Surface original = loadSurface(TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga");
+        defer { original.free(); };
+
+        TGA::StreamWriterCreateInfo info = { .surface = original, .path = outPath, .imageType = 2, .maxQueuedBands = 1 };
+        TGA::StreamWriter writer = core::Unpack(TGA::createStreamWriter(info, *suiteInfo.actx));
+
+        constexpr i32 BAND_HEIGHT = 8;
+        CT_CHECK(!writer.submitRows(0, BAND_HEIGHT).hasErr());
+        CT_CHECK(!writer.submitRows(BAND_HEIGHT, original.height - BAND_HEIGHT).hasErr());
+
+        FileStamp stamp = core::Unpack(statFile(outPath));
+        CT_CHECK(stamp.size >= sizeof(TGA::Header) + addr_size(BAND_HEIGHT * original.width * original.bpp()));
+
+        CT_CHECK(!writer.finish().hasErr());
+    }
+
+    // Out of order and incomplete submissions are rejected.
+    {
+        Surface original = loadSurface(TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b32.tga");
+        defer { original.free(); };
+
+        TGA::StreamWriterCreateInfo info = { .surface = original, .path = outPath, .imageType = 10 };
+        TGA::StreamWriter writer = core::Unpack(TGA::createStreamWriter(info, *suiteInfo.actx));
+
+        CT_CHECK(!writer.submitRows(0, 4).hasErr());
+        auto res = writer.submitRows(8, 4);
+        CT_CHECK(res.hasErr());
+        CT_CHECK(res.err() == TGA::TGAError::InvalidArgument);
+
+        res = writer.finish();
+        CT_CHECK(res.hasErr());
+        CT_CHECK(res.err() == TGA::TGAError::ApplicationBug);
+    }
+
+    return 0;
+}
+
+i32 colorMappedAndGrayscaleImagesDecodeTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        const char* expected;
+    };
+
+    constexpr TestCase cases[] = {
+        // Color-mapped (types 1 and 9), against the true color image the palette was built from.
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/flag_b32_cm8.tga",              TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b32.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/flag_b24_cm8.tga",              TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b24.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb32_bottom_left_cm8.tga",     TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb32_bottom_left.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb32_bottom_left_cm8_rle.tga", TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb32_bottom_left.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/utc16_cm8_rle.tga",             TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc16.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb24_cm16.tga",                TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb24.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb24_cm16_rle.tga",            TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb24.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb15_cm16.tga",                TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb15.tga" },
+
+        // Black and white (types 3 and 11), against the same image stored as 32 bit true color.
+        { TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/xing_t_gray8.tga",      TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/xing_t_gray8_expected.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/xing_t_gray8_rle.tga",  TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/xing_t_gray8_expected.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/rgb32_gray16.tga",      TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/rgb32_gray16_expected.tga" },
+        { TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/rgb32_gray16_rle.tga",  TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/rgb32_gray16_expected.tga" },
+    };
+
+    auto loadSurface = [&](const char* path) -> Surface {
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx), "Failed to load file: \"{}\"", path);
+        defer { tgaImage.free(); };
+        return core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+    };
+
+    i32 ret = core::testing::executeTestTable("colorMappedAndGrayscaleImagesDecodeTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface decoded = loadSurface(tc.path);
+        defer { decoded.free(); };
+        Surface expected = loadSurface(tc.expected);
+        defer { expected.free(); };
+
+        CT_CHECK(decoded.pixelFormat == expected.pixelFormat, cErr);
+        CT_CHECK(decoded.origin == expected.origin, cErr);
+
+        SurfaceDiff diff = core::Unpack(compareSurfaces(expected, decoded, CompareMode::ExactOnly, *suiteInfo.actx));
+        CT_CHECK(diff.equal, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 batchLoadMatchesSerialLoadTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct Clojure {
+        const core::testing::TestSuiteInfo& suiteInfo;
+        i32 callbacks = 0;
+        i32 mismatches = 0;
+        u64 seenIndices = 0;
+    };
+
+    // The batch loader allocates from its worker threads, so it gets the (thread safe) default allocator.
+    auto& batchActx = DEF_ALLOC;
+
+    TGA::BatchLoadCallback callback = [](TGA::BatchLoadResult& result, void* userData) {
+        Clojure& c = *reinterpret_cast<Clojure*>(userData);
+        c.callbacks++;
+        if (result.index >= 0 && result.index < 64) c.seenIndices |= u64(1) << result.index;
+        if (result.err != TGA::TGAError::Undefined) return;
+        defer { result.surface.free(); };
+
+        auto tgaImage = core::Unpack(TGA::loadFile(result.path, *c.suiteInfo.actx));
+        defer { tgaImage.free(); };
+        Surface expected = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *c.suiteInfo.actx));
+        defer { expected.free(); };
+
+        auto diff = compareSurfaces(expected, result.surface, CompareMode::ExactOnly, *c.suiteInfo.actx);
+        if (diff.hasErr() || !diff.value().equal) c.mismatches++;
+    };
+
+    // Every file in the directory, with a budget smaller than the sum of the images.
+    {
+        i32 fileCount = 0;
+        core::dirWalk(TRUE_IMAGE_TYPE_VALID_DIRECTORY, [](const core::DirEntry& de, addr_size, void* userData) -> bool {
+            if (de.type == core::FileType::Regular) (*reinterpret_cast<i32*>(userData))++;
+            return true;
+        }, &fileCount);
+
+        Clojure clojure = { .suiteInfo = suiteInfo };
+        TGA::BatchLoadInfo info;
+        info.callback = callback;
+        info.userData = &clojure;
+        info.workerCount = 4;
+        info.inFlightByteBudget = 16 * core::CORE_MEGABYTE;
+
+        TGA::BatchLoadStats stats = core::Unpack(TGA::loadDirectoryBatch(TRUE_IMAGE_TYPE_VALID_DIRECTORY, info, batchActx));
+        CT_CHECK(stats.loaded == fileCount);
+        CT_CHECK(stats.failed == 0);
+        CT_CHECK(stats.peakInFlightBytes > 0);
+        CT_CHECK(stats.peakInFlightBytes <= info.inFlightByteBudget);
+        CT_CHECK(clojure.callbacks == fileCount);
+        CT_CHECK(clojure.mismatches == 0);
+    }
+
+    // A list with failures in it; every path gets exactly one callback.
+    {
+        const char* paths[] = {
+            TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga",
+            TEST_ASSETS_DIRECTORY "/tga/does_not_exist.tga",
+            TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_t32_rle.tga",
+            TEST_ASSETS_DIRECTORY "/tga/rle_invalid/truncated_rle.tga",
+            TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb24_cm16_rle.tga",
+        };
+
+        Clojure clojure = { .suiteInfo = suiteInfo };
+        TGA::BatchLoadInfo info;
+        info.callback = callback;
+        info.userData = &clojure;
+
+        TGA::BatchLoadStats stats = core::Unpack(TGA::loadFilesBatch(paths, CORE_C_ARRLEN(paths), info, batchActx));
+        CT_CHECK(stats.loaded == 3);
+        CT_CHECK(stats.failed == 2);
+        CT_CHECK(clojure.callbacks == 5);
+        CT_CHECK(clojure.seenIndices == 0b11111);
+        CT_CHECK(clojure.mismatches == 0);
+    }
+
+    return 0;
+}
+
+i32 probeMatchesLoadedImageTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr const char* cases[] = {
+        TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga",
+        TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t24.tga",
+        TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga",
+        TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/earth.tga",
+        TEST_ASSETS_DIRECTORY "/tga/rle_valid/flag_t16_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/rgb24_cm16_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/utc16_cm8_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/rgb32_gray16.tga",
+    };
+
+    i32 ret = core::testing::executeTestTable("probeMatchesLoadedImageTest failed at: ", cases, [&](const char* path, const char* cErr) {
+        TGA::ProbeInfo info = core::Unpack(TGA::probeFile(path));
+
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx));
+        defer { tgaImage.free(); };
+        Surface surface = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        defer { surface.free(); };
+
+        CT_CHECK(info.imageType == core::Unpack(tgaImage.imageType()), cErr);
+        CT_CHECK(info.fileType == tgaImage.fileType(), cErr);
+        CT_CHECK(info.fileSize == tgaImage.memory.len(), cErr);
+        CT_CHECK(info.width == surface.width, cErr);
+        CT_CHECK(info.height == surface.height, cErr);
+        CT_CHECK(info.pixelFormat == surface.pixelFormat, cErr);
+        CT_CHECK(info.origin == surface.origin, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    auto missing = TGA::probeFile(TEST_ASSETS_DIRECTORY "/tga/does_not_exist.tga");
+    CT_CHECK(missing.hasErr());
+    CT_CHECK(missing.err() == TGA::TGAError::FailedToOpenFile);
+
+    return 0;
+}
+
+i32 adoptedImagesMatchCopiedImagesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        bool adoptsBuffer;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_t24.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga", true },
+        { TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_b24_rle.tga", false },
+        { TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/flag_b32_cm8.tga", false },
+        { TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/xing_t_gray8.tga", false },
+    };
+
+    i32 ret = core::testing::executeTestTable("adoptedImagesMatchCopiedImagesTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface expected;
+        {
+            auto tgaImage = core::Unpack(TGA::loadFile(tc.path, *suiteInfo.actx));
+            defer { tgaImage.free(); };
+            expected = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        }
+        defer { expected.free(); };
+
+        auto tgaImage = core::Unpack(TGA::loadFile(tc.path, *suiteInfo.actx));
+        defer { tgaImage.free(); }; // no-op once the image is consumed
+        const u8* fileBegin = tgaImage.memory.data();
+        addr_size fileSize = tgaImage.memory.len();
+        addr_off imageDataOff = tgaImage.imageDataOff;
+
+        Surface adopted = core::Unpack(TGA::createSurfaceByAdoptingTgaImage(std::move(tgaImage), *suiteInfo.actx));
+        defer { adopted.free(); };
+
+        CT_CHECK(tgaImage.memory.data() == nullptr, cErr);
+        CT_CHECK(adopted.isOwner(), cErr);
+        CT_CHECK((adopted.data == fileBegin + imageDataOff) == tc.adoptsBuffer, cErr);
+        CT_CHECK((adopted.adoptedMemory.len() == fileSize) == tc.adoptsBuffer, cErr);
+        CT_CHECK(core::Unpack(compareSurfaces(expected, adopted, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    // Mapped images can't hand over their memory and are copied.
+    {
+        auto mappedImage = core::Unpack(TGA::loadFileMapped(TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b16.tga"));
+        defer { mappedImage.free(); };
+        Surface adopted = core::Unpack(TGA::createSurfaceByAdoptingTgaImage(std::move(mappedImage), *suiteInfo.actx));
+        defer { adopted.free(); };
+        CT_CHECK(!mappedImage.mapping.isMapped());
+        CT_CHECK(adopted.isOwner());
+        CT_CHECK(adopted.adoptedMemory.data() == nullptr);
+    }
+
+    return 0;
+}
+
+i32 stridedAndSubSurfaceWritesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        i32 imageType;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", 2 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", 10 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t16.tga", 2 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga", 2 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga", 10 },
+    };
+
+    constexpr const char* outPath = OUT_DIRECTORY "/strided_write_test.tga";
+
+    auto writeAndReadBack = [&](const Surface& surface, i32 imageType) -> Surface {
+        TGA::CreateFileFromSurfaceParams params = {
+            .surface = surface,
+            .path = outPath,
+            .imageType = imageType,
+            .fileType = TGA::FileType::New,
+        };
+        core::Expect(TGA::createFileFromSurface(params));
+        auto tgaImage = core::Unpack(TGA::loadFile(outPath, *suiteInfo.actx));
+        defer { tgaImage.free(); };
+        return core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+    };
+
+    i32 ret = core::testing::executeTestTable("stridedAndSubSurfaceWritesTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface original;
+        {
+            auto tgaImage = core::Unpack(TGA::loadFile(tc.path, *suiteInfo.actx));
+            defer { tgaImage.free(); };
+            original = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        }
+        defer { original.free(); };
+
+        // Same pixels with padding at the end of every row.
+        Surface padded = original.view();
+        padded.pitch = original.pitch + 13;
+        padded.actx = suiteInfo.actx;
+        padded.data = reinterpret_cast<u8*>(suiteInfo.actx->alloc(addr_size(padded.size()), sizeof(u8)));
+        defer { padded.free(); };
+        for (i32 y = 0; y < original.height; y++) {
+            core::memcopy(padded.row(y), original.row(y), addr_size(original.pitch));
+        }
+
+        const Surface layouts[] = {
+            padded.view(),
+            original.view().flippedVertically(),
+            original.subSurface(3, 5, original.width - 7, original.height - 11),
+            padded.subSurface(original.width / 2, 0, original.width / 2, original.height / 3),
+            original.subSurface(1, 1, 1, 1),
+        };
+
+        for (const Surface& layout : layouts) {
+            Surface readBack = writeAndReadBack(layout, tc.imageType);
+            defer { readBack.free(); };
+
+            CT_CHECK(readBack.width == layout.width, cErr);
+            CT_CHECK(readBack.height == layout.height, cErr);
+            CT_CHECK(readBack.isContiguous(), cErr);
+            CT_CHECK(core::Unpack(compareSurfaces(layout, readBack, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+        }
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 extensionAreaRoundtripTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        i32 imageType;
+        bool writeScanLineTable;
+        i32 postageStampSize;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", 10, true, 64 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/xing_b24.tga", 2, true, 0 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_t16.tga", 10, true, 32 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/utc32.tga", 10, false, 64 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/earth.tga", 10, true, 64 },
+        { TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/rgb32.tga", 2, false, 16 },
+    };
+
+    constexpr const char* outPath = OUT_DIRECTORY "/extension_area_test.tga";
+
+    i32 ret = core::testing::executeTestTable("extensionAreaRoundtripTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        Surface original;
+        {
+            auto tgaImage = core::Unpack(TGA::loadFile(tc.path, *suiteInfo.actx));
+            defer { tgaImage.free(); };
+            original = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        }
+        defer { original.free(); };
+
+        TGA::CreateFileFromSurfaceParams params = {
+            .surface = original,
+            .path = outPath,
+            .imageType = tc.imageType,
+            .fileType = TGA::FileType::New,
+            .writeScanLineTable = tc.writeScanLineTable,
+            .postageStampSize = tc.postageStampSize,
+        };
+        core::Expect(TGA::createFileFromSurface(params));
+
+        auto tgaImage = core::Unpack(TGA::loadFile(outPath, *suiteInfo.actx));
+        defer { tgaImage.free(); };
+
+        const TGA::ExtensionArea* ext = nullptr;
+        CT_CHECK(!tgaImage.extensionArea(ext).hasErr(), cErr);
+        CT_CHECK(ext->extensionSize == TGA::EXTENSION_AREA_SIZE, cErr);
+
+        Surface decoded = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        defer { decoded.free(); };
+        CT_CHECK(core::Unpack(compareSurfaces(original, decoded, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+
+        // Scan line table
+        addr_off rowOff = -1;
+        auto tableRes = tgaImage.scanLineOffset(0, rowOff);
+        CT_CHECK(tableRes.hasErr() == !tc.writeScanLineTable, cErr);
+        if (tc.writeScanLineTable) {
+            CT_CHECK(rowOff == tgaImage.imageDataOff, cErr);
+            for (i32 y = 1; y < original.height; y++) {
+                addr_off prevRowOff = rowOff;
+                CT_CHECK(!tgaImage.scanLineOffset(y, rowOff).hasErr(), cErr);
+                CT_CHECK(rowOff > prevRowOff, cErr);
+            }
+        }
+
+        // Bands decoded back to front match the full decode, with or without the table.
+        Surface bands = decoded;
+        bands.actx = suiteInfo.actx;
+        bands.data = reinterpret_cast<u8*>(suiteInfo.actx->alloc(addr_size(decoded.size()), sizeof(u8)));
+        defer { bands.free(); };
+        constexpr i32 bandHeight = 13;
+        for (i32 y = ((original.height - 1) / bandHeight) * bandHeight; y >= 0; y -= bandHeight) {
+            Surface band = bands.subSurface(0, y, bands.width, core::core_min(bandHeight, bands.height - y));
+            CT_CHECK(!TGA::decodeTgaImageRows(tgaImage, y, band, *suiteInfo.actx).hasErr(), cErr);
+        }
+        CT_CHECK(core::Unpack(compareSurfaces(decoded, bands, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+
+        // Postage stamp
+        auto stampRes = TGA::createPostageStampFromTgaImage(tgaImage, *suiteInfo.actx);
+        CT_CHECK(stampRes.hasErr() == (tc.postageStampSize == 0), cErr);
+        if (tc.postageStampSize > 0) {
+            Surface stamp = stampRes.value();
+            defer { stamp.free(); };
+            CT_CHECK(core::core_max(stamp.width, stamp.height) == core::core_min(tc.postageStampSize, core::core_max(original.width, original.height)), cErr);
+            CT_CHECK(stamp.pixelFormat == original.pixelFormat, cErr);
+            CT_CHECK(stamp.origin == original.origin, cErr);
+
+            Surface expected = stamp;
+            expected.actx = suiteInfo.actx;
+            expected.data = reinterpret_cast<u8*>(suiteInfo.actx->alloc(addr_size(stamp.size()), sizeof(u8)));
+            defer { expected.free(); };
+            downscaleAreaAverage(original, expected, *suiteInfo.actx);
+            CT_CHECK(core::Unpack(compareSurfaces(expected, stamp, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+        }
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    // Files without an extension area, where run-length packets may also cross scan lines.
+    constexpr const char* plainFiles[] = {
+        TEST_ASSETS_DIRECTORY "/tga/rle_valid/xing_b16_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/rle_valid/utc32_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/color_mapped_valid/utc16_cm8_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/grayscale_valid/rgb32_gray16_rle.tga",
+        TEST_ASSETS_DIRECTORY "/tga/true_image_type_valid/flag_b32.tga",
+    };
+    ret = core::testing::executeTestTable("extensionAreaRoundtripTest failed at: ", plainFiles, [&](const char* path, const char* cErr) {
+        auto tgaImage = core::Unpack(TGA::loadFile(path, *suiteInfo.actx));
+        defer { tgaImage.free(); };
+
+        const TGA::ExtensionArea* ext = nullptr;
+        auto extRes = tgaImage.extensionArea(ext);
+        CT_CHECK(extRes.hasErr() && extRes.err() == TGA::TGAError::MissingExtensionData, cErr);
+        auto stampRes = TGA::createPostageStampFromTgaImage(tgaImage, *suiteInfo.actx);
+        CT_CHECK(stampRes.hasErr() && stampRes.err() == TGA::TGAError::MissingExtensionData, cErr);
+
+        Surface decoded = core::Unpack(TGA::createSurfaceFromTgaImage(tgaImage, *suiteInfo.actx));
+        defer { decoded.free(); };
+
+        Surface rows = decoded;
+        rows.actx = suiteInfo.actx;
+        rows.data = reinterpret_cast<u8*>(suiteInfo.actx->alloc(addr_size(decoded.size()), sizeof(u8)));
+        defer { rows.free(); };
+        for (i32 y = decoded.height - 1; y >= 0; y--) {
+            Surface row = rows.subSurface(0, y, rows.width, 1);
+            CT_CHECK(!TGA::decodeTgaImageRows(tgaImage, y, row, *suiteInfo.actx).hasErr(), cErr);
+        }
+        CT_CHECK(core::Unpack(compareSurfaces(decoded, rows, CompareMode::ExactOnly, *suiteInfo.actx)).equal, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
 } // namespace
 
 i32 runTgaTestsSuite(const core::testing::TestSuiteInfo& suiteInfo) {
@@ -67,6 +834,30 @@ i32 runTgaTestsSuite(const core::testing::TestSuiteInfo& suiteInfo) {
 
     tInfo.name = FN_NAME_TO_CPTR(trueImageTypeTest);
     if (runTest(tInfo, validTrueImageFilesCanBeReadTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(sameImageWithDifferentOriginsTest);
+    if (runTest(tInfo, sameImageWithDifferentOriginsTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(runLengthEncodedImagesMatchRawImagesTest);
+    if (runTest(tInfo, runLengthEncodedImagesMatchRawImagesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(malformedRunLengthEncodedImagesAreRejectedTest);
+    if (runTest(tInfo, malformedRunLengthEncodedImagesAreRejectedTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(runLengthEncodedRoundtripTest);
+    if (runTest(tInfo, runLengthEncodedRoundtripTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(mappedImagesMatchReadImagesTest);
+    if (runTest(tInfo, mappedImagesMatchReadImagesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(streamWriterMatchesSingleWriteTest);
+    if (runTest(tInfo, streamWriterMatchesSingleWriteTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(colorMappedAndGrayscaleImagesDecodeTest);
+    if (runTest(tInfo, colorMappedAndGrayscaleImagesDecodeTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(batchLoadMatchesSerialLoadTest);
+    if (runTest(tInfo, batchLoadMatchesSerialLoadTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(probeMatchesLoadedImageTest);
+    if (runTest(tInfo, probeMatchesLoadedImageTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(adoptedImagesMatchCopiedImagesTest);
+    if (runTest(tInfo, adoptedImagesMatchCopiedImagesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(stridedAndSubSurfaceWritesTest);
+    if (runTest(tInfo, stridedAndSubSurfaceWritesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(extensionAreaRoundtripTest);
+    if (runTest(tInfo, extensionAreaRoundtripTest, suiteInfo) != 0) { return -1; }
 
     return ret;
 }
@@ -1,6 +1,9 @@
 #include "t-index.h"
 #include "testing/testing_framework.h"
 #include "wavefront_files.h"
+#include "wavefront_numbers.h"
+#include "model.h"
+#include "model_cache.h"
 
 using namespace Wavefront;
 
@@ -32,6 +35,46 @@ i32 facesAreEqual(const WavefrontObj::Face& f1, const WavefrontObj::Face& f2) {
     return 0;
 }
 
+bool namesAreEqual(core::StrView a, core::StrView b) {
+    return core::memcmp(a.data(), a.len(), b.data(), b.len()) == 0;
+}
+
+i32 objsAreEqual(const WavefrontObj& a, const WavefrontObj& b) {
+    CT_CHECK(a.verticesCount == b.verticesCount);
+    CT_CHECK(a.textureCoordsCount == b.textureCoordsCount);
+    CT_CHECK(a.normalsCount == b.normalsCount);
+    CT_CHECK(a.facesCount == b.facesCount);
+
+    for (i32 i = 0; i < a.verticesCount; i++) {
+        const core::vec4f& va = a.vertices[addr_size(i)];
+        const core::vec4f& vb = b.vertices[addr_size(i)];
+        CT_CHECK(va.x() == vb.x() && va.y() == vb.y() && va.z() == vb.z() && va.w() == vb.w());
+    }
+    for (i32 i = 0; i < a.textureCoordsCount; i++) {
+        const core::vec3f& va = a.textureCoords[addr_size(i)];
+        const core::vec3f& vb = b.textureCoords[addr_size(i)];
+        CT_CHECK(va.x() == vb.x() && va.y() == vb.y() && va.z() == vb.z());
+    }
+    for (i32 i = 0; i < a.normalsCount; i++) {
+        const core::vec3f& va = a.normals[addr_size(i)];
+        const core::vec3f& vb = b.normals[addr_size(i)];
+        CT_CHECK(va.x() == vb.x() && va.y() == vb.y() && va.z() == vb.z());
+    }
+    for (i32 i = 0; i < a.facesCount; i++) {
+        CT_CHECK(facesAreEqual(a.faces[addr_size(i)], b.faces[addr_size(i)]) == 0);
+    }
+
+    CT_CHECK(a.groupsCount == b.groupsCount);
+    for (i32 i = 0; i < a.groupsCount; i++) {
+        const WavefrontObj::Group& ga = a.groups[addr_size(i)];
+        const WavefrontObj::Group& gb = b.groups[addr_size(i)];
+        CT_CHECK(ga.firstFace == gb.firstFace);
+        CT_CHECK(namesAreEqual(a.groupName(ga), b.groupName(gb)));
+    }
+
+    return 0;
+}
+
 i32 simpleVerticesTest(const core::testing::TestSuiteInfo& suiteInfo) {
     constexpr const char* vertices1_valid_path = TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj";
 
@@ -44,10 +87,10 @@ i32 simpleVerticesTest(const core::testing::TestSuiteInfo& suiteInfo) {
     CT_CHECK(obj.verticesCount == 8);
 
     constexpr VertexTestCase cases[] = {
-        { 0, core::v(-1.0f, -1.0f, -1.0f, 0.0f), false },
-        { 1, core::v(1.0f, -1.0f, -1.0f, 0.0f), false },
-        { 2, core::v(1.0f, -1.0f, 1.25f, 0.0f), false },
-        { 3, core::v(-1.5f, -1.0f, 99.0001f, 0.0f), false },
+        { 0, core::v(-1.0f, -1.0f, -1.0f, 1.0f), true },
+        { 1, core::v(1.0f, -1.0f, -1.0f, 1.0f), true },
+        { 2, core::v(1.0f, -1.0f, 1.25f, 1.0f), true },
+        { 3, core::v(-1.5f, -1.0f, 99.0001f, 1.0f), true },
         { 4, core::v(-1.0f, -1.0f, -1.0f, 1.0f), true },
         { 5, core::v(1.0f, -1.0f, -1.0f, 0.5f), true },
         { 6, core::v(1.0f, -1.0f, 1.25f, 2.345f), true },
@@ -115,6 +158,735 @@ i32 simpleFacesTest(const core::testing::TestSuiteInfo& suiteInfo) {
 
 } // namespace
 
+i32 mixedWhitespaceTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    // Tabs, CRLF line endings, runs of blanks, lines longer than a tokenizer block and no newline at the end of file.
+    constexpr const char* whitespace1_valid_path = TEST_ASSETS_DIRECTORY "/obj/whitespace1_valid.obj";
+
+    auto obj = core::Unpack(
+        Wavefront::loadFile(whitespace1_valid_path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+        "Failed to load file: \"{}\"", whitespace1_valid_path
+    );
+    defer { obj.free(); };
+
+    CT_CHECK(obj.verticesCount == 3);
+    CT_CHECK(obj.facesCount == 2);
+
+    constexpr VertexTestCase vertexCases[] = {
+        { 0, core::v(1.5f, -2.0f, 3.0f, 1.0f), true },
+        { 1, core::v(0.25f, 0.5f, 0.75f, 1.0f), true },
+        { 2, core::v(7.0f, 8.0f, 9.0f, 1.0f), true },
+    };
+
+    i32 ret = core::testing::executeTestTable("mixedWhitespaceTest failed at: ", vertexCases, [&](const auto& tc, const char* cErr) {
+        const core::vec4f& v = obj.vertices[tc.index];
+        CT_CHECK(v.x() == tc.expected.x(), cErr);
+        CT_CHECK(v.y() == tc.expected.y(), cErr);
+        CT_CHECK(v.z() == tc.expected.z(), cErr);
+        if (tc.checkW) {
+            CT_CHECK(v.w() == tc.expected.w(), cErr);
+        }
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    FacesTestCase faceCases[] = {
+        { 0, { .data={ {1,4,7}, {2,-99,8}, {3,6,-99} }, .setFieldsMask=0b011101111 } },
+        { 1, { .data={ {1,2,3}, {-99,-99,-99}, {-99,-99,-99} }, .setFieldsMask=0b000000111 } },
+    };
+
+    ret = core::testing::executeTestTable("mixedWhitespaceTest failed at: ", faceCases, [&](const auto& tc, const char* cErr) {
+        CT_CHECK(tc.index < addr_size(obj.facesCount), cErr);
+        CT_CHECK(facesAreEqual(obj.faces[tc.index], tc.expected) == 0, cErr);
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 textureCoordsAndNormalsTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    // Two triangles of a quad share an edge and two vertices, the third triangle reuses the same positions with a
+    // different normal, so it needs vertices of its own.
+    constexpr const char* textured1_valid_path = TEST_ASSETS_DIRECTORY "/obj/textured1_valid.obj";
+
+    auto obj = core::Unpack(
+        Wavefront::loadFile(textured1_valid_path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+        "Failed to load file: \"{}\"", textured1_valid_path
+    );
+    defer { obj.free(); };
+
+    CT_CHECK(obj.verticesCount == 4);
+    CT_CHECK(obj.textureCoordsCount == 4);
+    CT_CHECK(obj.normalsCount == 2);
+    CT_CHECK(obj.facesCount == 3);
+    CT_CHECK(obj.textureCoords[1].x() == 1.0f && obj.textureCoords[1].y() == 0.0f && obj.textureCoords[1].z() == 0.0f);
+    CT_CHECK(obj.textureCoords[3].x() == 0.0f && obj.textureCoords[3].y() == 1.0f && obj.textureCoords[3].z() == 0.5f);
+    CT_CHECK(obj.normals[1].x() == 0.0f && obj.normals[1].y() == 0.0f && obj.normals[1].z() == -1.0f);
+
+    Model3D model = Wavefront::createModelFromWavefrontObj(obj, *suiteInfo.actx);
+    defer { model.free(); };
+
+    CT_CHECK(model.vertices.len() == 7);
+    CT_CHECK(model.faces.len() == 3);
+
+    struct FaceTestCase {
+        addr_size index;
+        i32 expected[3];
+    };
+
+    constexpr FaceTestCase faceCases[] = {
+        { 0, { 0, 1, 2 } },
+        { 1, { 0, 2, 3 } },
+        { 2, { 4, 5, 6 } },
+    };
+
+    i32 ret = core::testing::executeTestTable("textureCoordsAndNormalsTest failed at: ", faceCases, [&](const auto& tc, const char* cErr) {
+        for (i32 j = 0; j < 3; j++) {
+            CT_CHECK(model.faces[tc.index][j] == tc.expected[j], cErr);
+        }
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    struct VertexTestCase {
+        addr_size index;
+        core::vec3f position;
+        core::vec3f normal;
+        core::vec2f textureCoord;
+    };
+
+    constexpr VertexTestCase vertexCases[] = {
+        { 0, core::v(0.0f, 0.0f, 0.0f), core::v(0.0f, 0.0f, 1.0f), core::v(0.0f, 0.0f) },
+        { 3, core::v(0.0f, 1.0f, 0.0f), core::v(0.0f, 0.0f, 1.0f), core::v(0.0f, 1.0f) },
+        { 4, core::v(0.0f, 0.0f, 0.0f), core::v(0.0f, 0.0f, -1.0f), core::v(0.0f, 0.0f) },
+        { 6, core::v(1.0f, 0.0f, 0.0f), core::v(0.0f, 0.0f, -1.0f), core::v(1.0f, 0.0f) },
+    };
+
+    ret = core::testing::executeTestTable("textureCoordsAndNormalsTest failed at: ", vertexCases, [&](const auto& tc, const char* cErr) {
+        const Model3D::Vertex& v = model.vertices[tc.index];
+        CT_CHECK(v.position.x() == tc.position.x(), cErr);
+        CT_CHECK(v.position.y() == tc.position.y(), cErr);
+        CT_CHECK(v.position.z() == tc.position.z(), cErr);
+        CT_CHECK(v.normal.x() == tc.normal.x(), cErr);
+        CT_CHECK(v.normal.y() == tc.normal.y(), cErr);
+        CT_CHECK(v.normal.z() == tc.normal.z(), cErr);
+        CT_CHECK(v.textureCoord.x() == tc.textureCoord.x(), cErr);
+        CT_CHECK(v.textureCoord.y() == tc.textureCoord.y(), cErr);
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 groupsToSubmeshesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr const char* groups1_valid_path = TEST_ASSETS_DIRECTORY "/obj/groups1_valid.obj";
+
+    auto obj = core::Unpack(
+        Wavefront::loadFile(groups1_valid_path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+        "Failed to load file: \"{}\"", groups1_valid_path
+    );
+    defer { obj.free(); };
+
+    struct GroupTestCase {
+        addr_size index;
+        i32 firstFace;
+        const char* name;
+    };
+
+    constexpr GroupTestCase groupCases[] = {
+        { 0, 1, "robot" },
+        { 1, 1, "head" },
+        { 2, 3, "" },
+        { 3, 3, "eyes" },
+    };
+
+    CT_CHECK(obj.groupsCount == 4);
+    CT_CHECK(obj.groupNamesSize == 13);
+    i32 ret = core::testing::executeTestTable("groupsToSubmeshesTest failed at: ", groupCases, [&](const auto& tc, const char* cErr) {
+        const WavefrontObj::Group& g = obj.groups[tc.index];
+        CT_CHECK(g.firstFace == tc.firstFace, cErr);
+        CT_CHECK(namesAreEqual(obj.groupName(g), core::sv(tc.name, core::cstrLen(tc.name))), cErr);
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    // Groups without faces, here robot and the unnamed one, do not make a submesh.
+    Model3D model = Wavefront::createModelFromWavefrontObj(obj, *suiteInfo.actx);
+    defer { model.free(); };
+
+    struct SubmeshTestCase {
+        addr_size index;
+        i32 firstFace;
+        i32 facesCount;
+        const char* name;
+        core::vec3f boundsMin;
+        core::vec3f boundsMax;
+    };
+
+    constexpr SubmeshTestCase submeshCases[] = {
+        { 0, 0, 1, "", core::v(0.0f, 0.0f, 0.0f), core::v(1.0f, 1.0f, 0.0f) },
+        { 1, 1, 2, "head", core::v(0.0f, 0.0f, 0.0f), core::v(6.0f, 6.0f, 7.0f) },
+        { 2, 3, 1, "eyes", core::v(0.0f, 0.0f, 0.0f), core::v(1.0f, 1.0f, 0.0f) },
+    };
+
+    CT_CHECK(model.submeshes.len() == 3);
+    ret = core::testing::executeTestTable("groupsToSubmeshesTest failed at: ", submeshCases, [&](const auto& tc, const char* cErr) {
+        const Model3D::Submesh& s = model.submeshes[tc.index];
+        CT_CHECK(s.firstFace == tc.firstFace, cErr);
+        CT_CHECK(s.facesCount == tc.facesCount, cErr);
+        CT_CHECK(namesAreEqual(model.submeshName(s), core::sv(tc.name, core::cstrLen(tc.name))), cErr);
+        CT_CHECK(s.boundsMin.x() == tc.boundsMin.x() && s.boundsMin.y() == tc.boundsMin.y(), cErr);
+        CT_CHECK(s.boundsMin.z() == tc.boundsMin.z(), cErr);
+        CT_CHECK(s.boundsMax.x() == tc.boundsMax.x() && s.boundsMax.y() == tc.boundsMax.y(), cErr);
+        CT_CHECK(s.boundsMax.z() == tc.boundsMax.z(), cErr);
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 parseFloatTest(const core::testing::TestSuiteInfo&) {
+    struct TestCase {
+        const char* input;
+        f32 expected;
+        bool valid;
+    };
+
+    constexpr TestCase cases[] = {
+        { "0", 0.0f, true },
+        { "-1", -1.0f, true },
+        { "+2.5", 2.5f, true },
+        { ".5", 0.5f, true },
+        { "5.", 5.0f, true },
+        { "99.0001", 99.0001f, true },
+        { "-0.7071067811865476", -0.70710678f, true },
+        { "1.5e-3", 0.0015f, true },
+        { "2E+4", 20000.0f, true },
+        { "16777217", 16777216.0f, true },                            // Halfway, rounds to even.
+        { "16777219", 16777220.0f, true },                            // Halfway, rounds to even.
+        { "1.00000005960464477539062500001", 1.00000012f, true },     // Just above halfway, past 19 digits.
+        { "3.4028235e38", 3.4028235e38f, true },
+        { "1e-45", 1e-45f, true },                                    // Subnormal.
+        { "1e-50", 0.0f, true },
+        { "00000000000000000000000000001.25", 1.25f, true },
+        { "", 0.0f, false },
+        { ".", 0.0f, false },
+        { "-", 0.0f, false },
+        { "e5", 0.0f, false },
+        { "1e", 0.0f, false },
+        { "1e+", 0.0f, false },
+        { "1.2.3", 0.0f, false },
+        { "1.5x", 0.0f, false },
+        { " 1.5", 0.0f, false },
+        { "nan", 0.0f, false },
+        { "inf", 0.0f, false },
+    };
+
+    i32 ret = core::testing::executeTestTable("parseFloatTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto res = Wavefront::parseFloat(tc.input, core::cstrLen(tc.input));
+        CT_CHECK(res.hasValue() == tc.valid, cErr);
+        if (tc.valid) {
+            CT_CHECK(res.value() == tc.expected, cErr);
+        }
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 parseIntTest(const core::testing::TestSuiteInfo&) {
+    struct TestCase {
+        const char* input;
+        i32 expected;
+        bool valid;
+    };
+
+    constexpr TestCase cases[] = {
+        { "0", 0, true },
+        { "7", 7, true },
+        { "-9", -9, true },
+        { "+12", 12, true },
+        { "12345678", 12345678, true },
+        { "123456789", 123456789, true },
+        { "2147483647", 2147483647, true },
+        { "-2147483648", -2147483647 - 1, true },
+        { "0000000000001000000", 1000000, true },
+        { "2147483648", 0, false },
+        { "-2147483649", 0, false },
+        { "99999999999", 0, false },
+        { "", 0, false },
+        { "-", 0, false },
+        { "1/2", 0, false },
+        { "12a", 0, false },
+        { "1234567a", 0, false },
+        { "1.0", 0, false },
+    };
+
+    i32 ret = core::testing::executeTestTable("parseIntTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto res = Wavefront::parseInt(tc.input, core::cstrLen(tc.input));
+        CT_CHECK(res.hasValue() == tc.valid, cErr);
+        if (tc.valid) {
+            CT_CHECK(res.value() == tc.expected, cErr);
+        }
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 emptyAndMissingFilesTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr const char* empty_valid_path = TEST_ASSETS_DIRECTORY "/obj/empty_valid.obj";
+    constexpr const char* missing_path = TEST_ASSETS_DIRECTORY "/obj/does_not_exist.obj";
+
+    {
+        auto obj = core::Unpack(
+            Wavefront::loadFile(empty_valid_path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", empty_valid_path
+        );
+        defer { obj.free(); };
+        CT_CHECK(obj.verticesCount == 0);
+        CT_CHECK(obj.facesCount == 0);
+    }
+
+    {
+        auto obj = core::Unpack(
+            Wavefront::loadFileParallel(empty_valid_path, WavefrontVersion::VERSION_3_0, {}, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", empty_valid_path
+        );
+        defer { obj.free(); };
+        CT_CHECK(obj.verticesCount == 0);
+        CT_CHECK(obj.facesCount == 0);
+    }
+
+    {
+        auto obj = core::Unpack(
+            Wavefront::loadFileStreaming(empty_valid_path, WavefrontVersion::VERSION_3_0, {}, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", empty_valid_path
+        );
+        defer { obj.free(); };
+        CT_CHECK(obj.verticesCount == 0);
+        CT_CHECK(obj.facesCount == 0);
+    }
+
+    CT_CHECK(Wavefront::loadFile(missing_path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx).hasErr());
+    CT_CHECK(Wavefront::loadFileParallel(missing_path, WavefrontVersion::VERSION_3_0, {}, *suiteInfo.actx).hasErr());
+    CT_CHECK(Wavefront::loadFileStreaming(missing_path, WavefrontVersion::VERSION_3_0, {}, *suiteInfo.actx).hasErr());
+
+    return 0;
+}
+
+i32 storageIsExactlySizedTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        i32 expectedVertices;
+        i32 expectedFaces;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", 8, 0 },
+        { TEST_ASSETS_DIRECTORY "/obj/faces1_valid.obj", 0, 11 },
+    };
+
+    i32 ret = core::testing::executeTestTable("storageIsExactlySizedTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto obj = core::Unpack(
+            Wavefront::loadFile(tc.path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", tc.path
+        );
+        defer { obj.free(); };
+
+        CT_CHECK(obj.verticesCount == tc.expectedVertices, cErr);
+        CT_CHECK(obj.facesCount == tc.expectedFaces, cErr);
+        CT_CHECK(obj.vertices.len() == addr_size(obj.verticesCount), cErr);
+        CT_CHECK(obj.faces.len() == addr_size(obj.facesCount), cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 parallelLoadMatchesSerialLoadTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    struct TestCase {
+        const char* path;
+        i32 workerCount;
+        addr_size minChunkSize;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", 0, core::CORE_MEGABYTE },
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", 3, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", 64, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/faces1_valid.obj", 2, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/faces1_valid.obj", 5, 16 },
+        { TEST_ASSETS_DIRECTORY "/obj/faces1_valid.obj", 64, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/whitespace1_valid.obj", 4, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/textured1_valid.obj", 3, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/groups1_valid.obj", 4, 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/groups1_valid.obj", 64, 1 },
+    };
+
+    i32 ret = core::testing::executeTestTable("parallelLoadMatchesSerialLoadTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto serial = core::Unpack(
+            Wavefront::loadFile(tc.path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", tc.path
+        );
+        defer { serial.free(); };
+
+        ParallelLoadInfo info;
+        info.workerCount = tc.workerCount;
+        info.minChunkSize = tc.minChunkSize;
+        auto parallel = core::Unpack(
+            Wavefront::loadFileParallel(tc.path, WavefrontVersion::VERSION_3_0, info, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", tc.path
+        );
+        defer { parallel.free(); };
+
+        CT_CHECK(objsAreEqual(serial, parallel) == 0, cErr);
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 streamingLoadMatchesLoadTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    // Chunks smaller than a line force lines to straddle chunks and the buffer to grow.
+    struct TestCase {
+        const char* path;
+        addr_size chunkSize;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", core::CORE_MEGABYTE },
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", 1 },
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", 17 },
+        { TEST_ASSETS_DIRECTORY "/obj/faces1_valid.obj", 7 },
+        { TEST_ASSETS_DIRECTORY "/obj/faces1_valid.obj", 64 },
+        { TEST_ASSETS_DIRECTORY "/obj/whitespace1_valid.obj", 5 },
+        { TEST_ASSETS_DIRECTORY "/obj/whitespace1_valid.obj", 33 },
+        { TEST_ASSETS_DIRECTORY "/obj/textured1_valid.obj", 10 },
+        { TEST_ASSETS_DIRECTORY "/obj/groups1_valid.obj", 3 },
+    };
+
+    i32 ret = core::testing::executeTestTable("streamingLoadMatchesLoadTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto mapped = core::Unpack(
+            Wavefront::loadFile(tc.path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", tc.path
+        );
+        defer { mapped.free(); };
+
+        StreamingLoadInfo info;
+        info.chunkSize = tc.chunkSize;
+        auto streamed = core::Unpack(
+            Wavefront::loadFileStreaming(tc.path, WavefrontVersion::VERSION_3_0, info, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", tc.path
+        );
+        defer { streamed.free(); };
+
+        CT_CHECK(objsAreEqual(mapped, streamed) == 0, cErr);
+
+        // The callbacks see the same statements, in file order.
+        struct Received {
+            const WavefrontObj* expected;
+            i32 vertices;
+            i32 textureCoords;
+            i32 normals;
+            i32 faces;
+            bool inOrder;
+        };
+        Received received = {};
+        received.expected = &mapped;
+        received.inOrder = true;
+
+        StreamingCallbacks callbacks;
+        callbacks.userData = &received;
+        callbacks.vertex = [](const core::vec4f& v, void* userData) {
+            Received& r = *reinterpret_cast<Received*>(userData);
+            const core::vec4f& e = r.expected->vertices[addr_size(r.vertices++)];
+            r.inOrder &= e.x() == v.x() && e.y() == v.y() && e.z() == v.z();
+        };
+        callbacks.textureCoord = [](const core::vec3f&, void* userData) {
+            reinterpret_cast<Received*>(userData)->textureCoords++;
+        };
+        callbacks.normal = [](const core::vec3f&, void* userData) {
+            reinterpret_cast<Received*>(userData)->normals++;
+        };
+        callbacks.face = [](const WavefrontObj::Face& f, void* userData) {
+            Received& r = *reinterpret_cast<Received*>(userData);
+            r.inOrder &= facesAreEqual(r.expected->faces[addr_size(r.faces++)], f) == 0;
+        };
+
+        CT_CHECK(Wavefront::streamFile(tc.path, WavefrontVersion::VERSION_3_0, callbacks, info, *suiteInfo.actx).hasValue(), cErr);
+        CT_CHECK(received.inOrder, cErr);
+        CT_CHECK(received.vertices == mapped.verticesCount, cErr);
+        CT_CHECK(received.textureCoords == mapped.textureCoordsCount, cErr);
+        CT_CHECK(received.normals == mapped.normalsCount, cErr);
+        CT_CHECK(received.faces == mapped.facesCount, cErr);
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 modelsAreEqual(const Model3D& a, const Model3D& b) {
+    CT_CHECK(a.layout == b.layout);
+    CT_CHECK(a.verticesCount() == b.verticesCount());
+    CT_CHECK(a.vertices.len() == b.vertices.len());
+    CT_CHECK(a.faces.len() == b.faces.len());
+
+    for (addr_size i = 0; i < a.verticesCount(); i++) {
+        core::vec4f pa = a.position(i);
+        core::vec4f pb = b.position(i);
+        CT_CHECK(pa.x() == pb.x() && pa.y() == pb.y() && pa.z() == pb.z() && pa.w() == pb.w());
+    }
+    for (addr_size i = 0; i < a.vertices.len(); i++) {
+        const Model3D::Vertex& va = a.vertices[i];
+        const Model3D::Vertex& vb = b.vertices[i];
+        CT_CHECK(va.normal.x() == vb.normal.x() && va.normal.y() == vb.normal.y() && va.normal.z() == vb.normal.z());
+        CT_CHECK(va.textureCoord.x() == vb.textureCoord.x() && va.textureCoord.y() == vb.textureCoord.y());
+    }
+    for (addr_size i = 0; i < a.faces.len(); i++) {
+        for (i32 j = 0; j < 3; j++) {
+            CT_CHECK(a.faces[i][j] == b.faces[i][j]);
+        }
+    }
+
+    CT_CHECK(a.submeshes.len() == b.submeshes.len());
+    for (addr_size i = 0; i < a.submeshes.len(); i++) {
+        const Model3D::Submesh& sa = a.submeshes[i];
+        const Model3D::Submesh& sb = b.submeshes[i];
+        CT_CHECK(sa.firstFace == sb.firstFace && sa.facesCount == sb.facesCount);
+        CT_CHECK(sa.boundsMin.x() == sb.boundsMin.x() && sa.boundsMin.y() == sb.boundsMin.y());
+        CT_CHECK(sa.boundsMin.z() == sb.boundsMin.z());
+        CT_CHECK(sa.boundsMax.x() == sb.boundsMax.x() && sa.boundsMax.y() == sb.boundsMax.y());
+        CT_CHECK(sa.boundsMax.z() == sb.boundsMax.z());
+        CT_CHECK(namesAreEqual(a.submeshName(sa), b.submeshName(sb)));
+    }
+
+    return 0;
+}
+
+i32 vertexLayoutsTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    // Every layout, from a borrowed or a consumed object, describes the same vertices.
+    // Files without normals and texture coordinates get VertexLayout::Positions when they ask for Interleaved.
+    struct TestCase {
+        const char* path;
+        bool expectW;
+        bool expectNormals;
+        bool expectTextureCoords;
+        VertexLayout expectDefaultLayout;
+    };
+
+    constexpr TestCase cases[] = {
+        { TEST_ASSETS_DIRECTORY "/obj/vertices1_valid.obj", true, false, false, VertexLayout::Positions },
+        { TEST_ASSETS_DIRECTORY "/obj/textured1_valid.obj", false, true, true, VertexLayout::Interleaved },
+    };
+
+    i32 ret = core::testing::executeTestTable("vertexLayoutsTest failed at: ", cases, [&](const auto& tc, const char* cErr) {
+        auto obj = core::Unpack(
+            Wavefront::loadFile(tc.path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", tc.path
+        );
+        defer { obj.free(); };
+
+        Model3D interleaved = Wavefront::createModelFromWavefrontObj(obj, *suiteInfo.actx);
+        defer { interleaved.free(); };
+        Model3D separate = Wavefront::createModelFromWavefrontObj(obj, *suiteInfo.actx, VertexLayout::Separate);
+        defer { separate.free(); };
+        Model3D consumed = Wavefront::createModelFromWavefrontObj(std::move(obj), *suiteInfo.actx, VertexLayout::Separate);
+        defer { consumed.free(); };
+
+        CT_CHECK(obj.vertices.data() == nullptr && obj.faces.data() == nullptr && obj.verticesCount == 0, cErr);
+
+        CT_CHECK(interleaved.layout == tc.expectDefaultLayout, cErr);
+        CT_CHECK(interleaved.vertices.len() == 0 || interleaved.positions.len() == 0, cErr);
+        CT_CHECK(separate.layout == VertexLayout::Separate, cErr);
+        CT_CHECK(separate.vertices.len() == 0, cErr);
+        CT_CHECK((separate.streams.w.len() > 0) == tc.expectW, cErr);
+        CT_CHECK((separate.streams.normals.len() > 0) == tc.expectNormals, cErr);
+        CT_CHECK((separate.streams.textureCoords.len() > 0) == tc.expectTextureCoords, cErr);
+
+        for (const Model3D* m : { &separate, &consumed }) {
+            CT_CHECK(m->verticesCount() == interleaved.verticesCount(), cErr);
+            CT_CHECK(m->faces.len() == interleaved.faces.len(), cErr);
+
+            for (addr_size i = 0; i < interleaved.verticesCount(); i++) {
+                core::vec4f a = interleaved.position(i);
+                core::vec4f b = m->position(i);
+                CT_CHECK(a.x() == b.x() && a.y() == b.y() && a.z() == b.z() && a.w() == b.w(), cErr);
+
+                if (tc.expectNormals) {
+                    const core::vec3f& vn = interleaved.vertices[i].normal;
+                    const core::vec3f& n = m->streams.normals[i];
+                    CT_CHECK(vn.x() == n.x() && vn.y() == n.y() && vn.z() == n.z(), cErr);
+                }
+                if (tc.expectTextureCoords) {
+                    const core::vec2f& vt = interleaved.vertices[i].textureCoord;
+                    const core::vec2f& t = m->streams.textureCoords[i];
+                    CT_CHECK(vt.x() == t.x() && vt.y() == t.y(), cErr);
+                }
+            }
+            for (addr_size i = 0; i < interleaved.faces.len(); i++) {
+                for (i32 j = 0; j < 3; j++) {
+                    CT_CHECK(m->faces[i][j] == interleaved.faces[i][j], cErr);
+                }
+            }
+        }
+
+        // A consumed positions only object hands its vertex array over to the model.
+        if (tc.expectDefaultLayout == VertexLayout::Positions) {
+            auto positionsObj = core::Unpack(
+                Wavefront::loadFile(tc.path, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+                "Failed to load file: \"{}\"", tc.path
+            );
+            const core::vec4f* parsedVertices = positionsObj.vertices.data();
+            Model3D moved = Wavefront::createModelFromWavefrontObj(std::move(positionsObj), *suiteInfo.actx);
+            defer { moved.free(); };
+
+            CT_CHECK(moved.layout == VertexLayout::Positions, cErr);
+            CT_CHECK(moved.positions.data() == parsedVertices, cErr);
+            CT_CHECK(positionsObj.vertices.data() == nullptr, cErr);
+            CT_CHECK(moved.verticesCount() == interleaved.verticesCount(), cErr);
+            for (addr_size i = 0; i < interleaved.verticesCount(); i++) {
+                core::vec4f a = interleaved.position(i);
+                core::vec4f b = moved.position(i);
+                CT_CHECK(a.x() == b.x() && a.y() == b.y() && a.z() == b.z() && a.w() == b.w(), cErr);
+            }
+        }
+
+        return 0;
+    });
+    CT_CHECK(ret == 0);
+
+    return 0;
+}
+
+i32 modelCacheRoundtripTest(const core::testing::TestSuiteInfo& suiteInfo) {
+    constexpr const char* sourcePath = TEST_ASSETS_DIRECTORY "/obj/textured1_valid.obj";
+    constexpr const char* cachePath = OUT_DIRECTORY "/model_cache_roundtrip.m3dcache";
+    constexpr const char* corruptedCachePath = OUT_DIRECTORY "/model_cache_corrupted.m3dcache";
+
+    auto obj = core::Unpack(
+        Wavefront::loadFile(sourcePath, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+        "Failed to load file: \"{}\"", sourcePath
+    );
+    Model3D parsed = Wavefront::createModelFromWavefrontObj(obj, *suiteInfo.actx);
+    obj.free();
+    defer { parsed.free(); };
+
+    ModelCacheSource source = core::Unpack(modelCacheSourceFor(sourcePath));
+    core::Expect(writeModelCache(parsed, cachePath, source));
+
+    // Loaded straight from the mapping.
+    {
+        auto cached = core::Unpack(loadModelCache(cachePath, &source));
+        defer { cached.free(); };
+        CT_CHECK(cached.mapping.isMapped());
+        CT_CHECK(addr_size(reinterpret_cast<const u8*>(cached.vertices.data()) - cached.mapping.memory.data()) %
+                 MODEL_CACHE_BLOCK_ALIGNMENT == 0);
+        CT_CHECK(modelsAreEqual(parsed, cached) == 0);
+    }
+
+    // Rewriting a mapped cache replaces the file instead of truncating it, so the mapping still shows the old header.
+    {
+        auto cached = core::Unpack(loadModelCache(cachePath, &source));
+        defer { cached.free(); };
+
+        ModelCacheSource other = source;
+        other.modifiedTimeNs++;
+        core::Expect(writeModelCache(parsed, cachePath, other));
+
+        const auto* mappedHeader = reinterpret_cast<const ModelCacheHeader*>(cached.mapping.memory.data());
+        CT_CHECK(mappedHeader->source.modifiedTimeNs == source.modifiedTimeNs);
+        CT_CHECK(modelsAreEqual(parsed, cached) == 0);
+
+        core::Expect(writeModelCache(parsed, cachePath, source));
+    }
+
+    // A different source makes the cache stale.
+    {
+        ModelCacheSource other = source;
+        other.modifiedTimeNs++;
+        auto res = loadModelCache(cachePath, &other);
+        CT_CHECK(res.hasErr() && res.err() == ModelCacheError::StaleCache);
+    }
+
+    // A flipped bit in the vertex block fails the checksum. The mapping is copy-on-write, so the corrupted bytes have to
+    // be written out to another file.
+    {
+        auto cached = core::Unpack(loadModelCache(cachePath));
+        defer { cached.free(); };
+        reinterpret_cast<u8*>(cached.vertices.data())[5] ^= 0x10;
+
+        WriteOnlyFile file = core::Unpack(createWriteOnlyFile(corruptedCachePath));
+        FileWriteSpan span = { cached.mapping.memory.data(), cached.mapping.memory.len() };
+        auto writeRes = writeFileGathered(file, &span, 1);
+        file.free();
+        core::Expect(writeRes);
+
+        auto res = loadModelCache(corruptedCachePath);
+        CT_CHECK(res.hasErr() && res.err() == ModelCacheError::ChecksumMismatch);
+    }
+
+    // A face pointing past the vertices is rejected even when the checksum matches.
+    {
+        i32 validIdx = parsed.faces[0][1];
+        parsed.faces[0][1] = i32(parsed.verticesCount());
+        auto writeRes = writeModelCache(parsed, corruptedCachePath);
+        parsed.faces[0][1] = validIdx;
+        core::Expect(writeRes);
+
+        auto res = loadModelCache(corruptedCachePath);
+        CT_CHECK(res.hasErr() && res.err() == ModelCacheError::InvalidFileFormat);
+    }
+
+    // The automatic cache serves the second load from the cache file.
+    for (i32 i = 0; i < 2; i++) {
+        auto model = core::Unpack(
+            Wavefront::loadModelCached(sourcePath, WavefrontVersion::VERSION_3_0, OUT_DIRECTORY, *suiteInfo.actx)
+        );
+        defer { model.free(); };
+        if (i == 1) CT_CHECK(model.mapping.isMapped());
+        CT_CHECK(modelsAreEqual(parsed, model) == 0);
+    }
+
+    // Models without normals and texture coordinates store 16 byte positions instead of interleaved vertices.
+    {
+        constexpr const char* positionsPath = TEST_ASSETS_DIRECTORY "/obj/groups1_valid.obj";
+        constexpr const char* positionsCachePath = OUT_DIRECTORY "/model_cache_positions.m3dcache";
+
+        auto positionsObj = core::Unpack(
+            Wavefront::loadFile(positionsPath, WavefrontVersion::VERSION_3_0, *suiteInfo.actx),
+            "Failed to load file: \"{}\"", positionsPath
+        );
+        Model3D positions = Wavefront::createModelFromWavefrontObj(std::move(positionsObj), *suiteInfo.actx);
+        defer { positions.free(); };
+        CT_CHECK(positions.layout == VertexLayout::Positions);
+
+        core::Expect(writeModelCache(positions, positionsCachePath));
+        auto cached = core::Unpack(loadModelCache(positionsCachePath));
+        defer { cached.free(); };
+        CT_CHECK(cached.layout == VertexLayout::Positions);
+        CT_CHECK(cached.mapping.memory.len() < sizeof(ModelCacheHeader) +
+                                               4 * MODEL_CACHE_BLOCK_ALIGNMENT +
+                                               cached.verticesCount() * sizeof(core::vec4f) +
+                                               cached.faces.len() * sizeof(Model3D::Face) +
+                                               cached.submeshes.len() * sizeof(Model3D::Submesh) +
+                                               cached.submeshNames.len());
+        CT_CHECK(modelsAreEqual(positions, cached) == 0);
+    }
+
+    return 0;
+}
+
 i32 runWavefrontTestsSuite(const core::testing::TestSuiteInfo& suiteInfo) {
     using namespace core::testing;
 
@@ -124,6 +896,29 @@ i32 runWavefrontTestsSuite(const core::testing::TestSuiteInfo& suiteInfo) {
     if (runTest(tInfo, simpleVerticesTest, suiteInfo) != 0) { return -1; }
     tInfo.name = FN_NAME_TO_CPTR(simpleFacesTest);
     if (runTest(tInfo, simpleFacesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(mixedWhitespaceTest);
+    if (runTest(tInfo, mixedWhitespaceTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(textureCoordsAndNormalsTest);
+    if (runTest(tInfo, textureCoordsAndNormalsTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(groupsToSubmeshesTest);
+    if (runTest(tInfo, groupsToSubmeshesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(parseFloatTest);
+    if (runTest(tInfo, parseFloatTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(parseIntTest);
+    if (runTest(tInfo, parseIntTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(emptyAndMissingFilesTest);
+    if (runTest(tInfo, emptyAndMissingFilesTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(storageIsExactlySizedTest);
+    if (runTest(tInfo, storageIsExactlySizedTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(parallelLoadMatchesSerialLoadTest);
+    if (runTest(tInfo, parallelLoadMatchesSerialLoadTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(streamingLoadMatchesLoadTest);
+    if (runTest(tInfo, streamingLoadMatchesLoadTest, suiteInfo) != 0) { return -1; }
+
+    tInfo.name = FN_NAME_TO_CPTR(vertexLayoutsTest);
+    if (runTest(tInfo, vertexLayoutsTest, suiteInfo) != 0) { return -1; }
+    tInfo.name = FN_NAME_TO_CPTR(modelCacheRoundtripTest);
+    if (runTest(tInfo, modelCacheRoundtripTest, suiteInfo) != 0) { return -1; }
 
     return 0;
 }